@@ -30,27 +30,67 @@
 #include <stdint.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "mx-texture-cache-index.h"
+
 
 #ifndef PATH_MAX
 #define PATH_MAX 1024
 #endif
 
 struct imgcache_element {
-  char  filename[256];
+  char *filename;
   int   width, height;
+  int   page;
   int   posX, posY;
   void *ptr;
+
+  /* what the manifest records about the file */
+  gint64 size, mtime;
+  char  *checksum;
+};
+
+/* A page of the cache. Pages that don't need redrawing keep the image
+ * written for them by an earlier run. */
+struct page_info {
+  int   width;
+  char *filename;
+  int   dirty;
 };
 
 GList *images;
+GArray *pages;
 
 int totalarea = 0;
 
+/* The manifest records the images that went into the cache the last time
+ * it was built, and where they were placed. Images whose file hasn't
+ * changed since are left where they are, without being decoded again. */
+struct manifest_entry {
+  int    page;
+  int    posX, posY;
+  int    width, height;
+  gint64 size, mtime;
+  char   checksum[41];
+};
+
+GHashTable *manifest;
+GArray *old_pages;
+GPtrArray *stale_pages;
+int generation = 0;
+
 
 int sizes[] = { 0, 256, 384, 512, 640, 768, 896, 1024, 1280, 1536, 1792,  2048, -1};
 
+/* the largest page, and the largest image that goes on one */
+int max_size = 2048;
+int max_image = 256;
+
+int skipped = 0;
+
 
 static gint sort_by_size(gconstpointer a,
                          gconstpointer b)
@@ -67,317 +107,665 @@ static gint sort_by_size(gconstpointer a,
   return 0;
 
 }
+static struct imgcache_element *add_element(const char *filename,
+                                            int         width,
+                                            int         height)
+{
+  struct imgcache_element *element;
+
+  element = g_new0(struct imgcache_element, 1);
+  element->filename = g_strdup(filename);
+  element->width = width;
+  element->height = height;
+  element->posX = -1;
+  element->posY = -1;
+  totalarea += width * height;
+
+  if (width > sizes[0])
+    sizes[0] = width;
+
+  images = g_list_prepend(images, element);
+  return element;
+}
+
 static void do_one_file(char *filename)
 {
   GdkPixbuf *image;
+  GInputStream *stream;
   struct imgcache_element *element;
+  struct manifest_entry *entry = NULL;
+  GStatBuf info;
+  char *contents, *checksum;
+  gsize length;
 
-  if (strlen(filename) >= 256)
+  if (g_stat(filename, &info) != 0)
     return;
 
-  image = gdk_pixbuf_new_from_file(filename, NULL);
-  if (!image)
-    return;
+  if (manifest)
+    entry = g_hash_table_lookup(manifest, filename);
+
+  /* an image that is still the same keeps its place */
+  if (entry && entry->size == info.st_size && entry->mtime == info.st_mtime) {
+      element = add_element(filename, entry->width, entry->height);
+      element->page = entry->page;
+      element->posX = entry->posX;
+      element->posY = entry->posY;
+      element->size = entry->size;
+      element->mtime = entry->mtime;
+      element->checksum = g_strdup(entry->checksum);
+      g_hash_table_remove(manifest, filename);
+      return;
+    }
 
-  /* we don't want to do files > 256x256 */
+  if (!g_file_get_contents(filename, &contents, &length, NULL))
+    return;
 
-  if (gdk_pixbuf_get_width(image) > 256) {
-      gdk_pixbuf_unref(image);
+  /* even when it was only touched */
+  checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1,
+                                         (const guchar *) contents, length);
+  if (entry && !strcmp(entry->checksum, checksum)) {
+      element = add_element(filename, entry->width, entry->height);
+      element->page = entry->page;
+      element->posX = entry->posX;
+      element->posY = entry->posY;
+      element->size = info.st_size;
+      element->mtime = info.st_mtime;
+      element->checksum = checksum;
+      g_hash_table_remove(manifest, filename);
+      g_free(contents);
       return;
     }
-  if (gdk_pixbuf_get_height(image) > 256) {
-      gdk_pixbuf_unref(image);
+
+  stream = g_memory_input_stream_new_from_data(contents, length, NULL);
+  image = gdk_pixbuf_new_from_stream(stream, NULL, NULL);
+  g_object_unref(stream);
+  g_free(contents);
+  if (!image) {
+      g_free(checksum);
       return;
     }
-  element = malloc(sizeof(struct imgcache_element));
-  if (!element) {
+
+  /* large images are better off with a texture of their own */
+  if (gdk_pixbuf_get_width(image) > max_image ||
+      gdk_pixbuf_get_height(image) > max_image) {
+      printf("Skipping %s, larger than %ix%i\n", filename, max_image, max_image);
+      skipped++;
+      g_free(checksum);
       gdk_pixbuf_unref(image);
       return;
     }
-
-  memset(element, 0, sizeof(struct imgcache_element));
-  element->width = gdk_pixbuf_get_width(image);
-  element->height = gdk_pixbuf_get_height(image);
-  element->posX = -1;
-  element->posY = -1;
+  element = add_element(filename, gdk_pixbuf_get_width(image),
+                        gdk_pixbuf_get_height(image));
   element->ptr = image;
-  totalarea += element->width * element->height;
-  strncpy(element->filename, filename, 256);
-
-  if (element->width > sizes[0])
-    sizes[0] = element->width;
-
-  images = g_list_append(images, element);
+  element->size = info.st_size;
+  element->mtime = info.st_mtime;
+  element->checksum = checksum;
 }
 
-static int get_effective_Y(int X1,
-                           int X2)
-{
-  int Y = 0;
-  GList *item;
-  struct imgcache_element *element;
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX == -1)
-        continue;
-      if (element->posX >= X2)
-        continue;
-      if (element->posX + element->width <= X1)
-        continue;
-      /* at this point we know the element overlaps our range */
-      if (element->posY + element->height > Y)
-        Y = element->posY + element->height;
-    }
-  return Y;
-
-}
+/* Images are placed with a skyline packer: the top edge of the images
+ * placed so far is kept as a sorted array of segments, and each image goes
+ * where its top edge ends up lowest, leftmost first. Once an image
+ * doesn't fit on a page any more, a new page is started. Every candidate
+ * width is packed on a thread of its own, and the one using the least
+ * area wins. */
+struct skyline_segment {
+  int x, y, width;
+};
 
-static inline uint32_t get_pixel(struct imgcache_element *element,
-                                 int                      X,
-                                 int                      Y)
-{
-  GdkPixbuf *buf;
-  unsigned char *p;
-  buf = element->ptr;
+struct placement {
+  int maxX;
+  int *page, *posX, *posY;
+  int n_pages;
+  int overlap;
+  gint64 score;
+  int failed;
+};
 
-  p = gdk_pixbuf_get_pixels(buf);
-  p += Y * gdk_pixbuf_get_rowstride(buf);
-  p += X * 4;
+struct imgcache_element **elements;
+int n_elements;
 
-  return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
-}
+/* the area saved by overlapping identical edges */
+int overlaparea = 0;
 
+/* returns how many columns at the right edge of one are identical to those
+ * at the left edge of two, so that two can overlap one by that much */
 static int can_scooch(struct imgcache_element *one,
                       struct imgcache_element *two)
 {
-  int i,x,y;
+  const guchar *p1, *p2;
+  int stride1, stride2, n_channels;
+  int i, y;
 
   if (!one)
     return 0;
   if (!two)
     return 0;
 
-  if (one->posY != two->posY)
-    return 0;
   if (one->height != two->height)
     return 0;
-  if (one->posX + one->width != two->posX)
-    return 0;
 
+  n_channels = gdk_pixbuf_get_n_channels(one->ptr);
+  if (n_channels != gdk_pixbuf_get_n_channels(two->ptr))
+    return 0;
 
-  i = 0;
+  p1 = gdk_pixbuf_get_pixels(one->ptr);
+  p2 = gdk_pixbuf_get_pixels(two->ptr);
+  stride1 = gdk_pixbuf_get_rowstride(one->ptr);
+  stride2 = gdk_pixbuf_get_rowstride(two->ptr);
 
-  while (i < one->width && i < two->width) {
-      i ++;
+  for (i = 1; i <= one->width && i <= two->width; i++) {
       for (y = 0; y < one->height; y++) {
-          for (x = 0; x < i; x++ ) {
-              int p1, p2;
-
-              p1 = get_pixel(one, one->width - i + x,y);
-              p2 = get_pixel(two, x, y);
-              if ( p1 != p2)
-                return i-1;
-            }
+          if (memcmp(p1 + y * stride1 + (one->width - i) * n_channels,
+                     p2 + y * stride2, i * n_channels) != 0)
+            return i - 1;
         }
     }
-  return i;
+  return i - 1;
 }
-static int do_placement(int maxX)
+
+/* returns the height at which an image of the given width can sit when its
+ * left edge is at the start of segment i, or -1 if it doesn't fit */
+static int skyline_fit(GArray *skyline,
+                       guint   i,
+                       int     width,
+                       int     maxX)
 {
-  int maxY;
-  int X, Y, baseY;
-  int tempY, tempX, biggestX = -1;
-  struct imgcache_element *element, *element2, *prev = NULL;
-  GList *item, *item2;
-  int workdone = 1;
+  struct skyline_segment *seg;
+  int Y = 0, remaining = width;
 
-  maxY = 0;
+  seg = &g_array_index(skyline, struct skyline_segment, i);
+  if (seg->x + width > maxX)
+    return -1;
 
-  X = 0;
-  Y = 0;
+  /* the skyline covers the whole width, so this can't run off the end */
+  while (remaining > 0) {
+      seg = &g_array_index(skyline, struct skyline_segment, i++);
+      if (seg->y > Y)
+        Y = seg->y;
+      remaining -= seg->width;
+    }
+  return Y;
+}
 
+/* raises the skyline between X and X + width to top */
+static void skyline_add(GArray **skyline,
+                        GArray **scratch,
+                        int      X,
+                        int      width,
+                        int      top)
+{
+  struct skyline_segment *seg, part;
+  GArray *old = *skyline, *new = *scratch;
+  guint i;
 
-  while (workdone) {
-      workdone = 0;
+  g_array_set_size(new, 0);
 
-      X = 0;
-      item = g_list_first(images);
-      while (item) {
-          int sc;
-          element = item->data;
-          item = g_list_next(item);
+  /* the segments left of the new one */
+  for (i = 0; i < old->len; i++) {
+      seg = &g_array_index(old, struct skyline_segment, i);
+      if (seg->x >= X)
+        break;
+      part = *seg;
+      if (part.x + part.width > X)
+        part.width = X - part.x;
+      g_array_append_val(new, part);
+    }
 
-          if (element->posX != -1)               /* already placed */
-            continue;
+  part.x = X;
+  part.y = top;
+  part.width = width;
+  g_array_append_val(new, part);
 
-          /* first, check if we fit */
-          if (X + element->width > maxX)
-            continue;
+  /* and the ones right of it, starting with the one the new segment may
+   * have been cut out of */
+  for (i = i > 0 ? i - 1 : 0; i < old->len; i++) {
+      seg = &g_array_index(old, struct skyline_segment, i);
+      if (seg->x + seg->width <= X + width)
+        continue;
+      part = *seg;
+      if (part.x < X + width) {
+          part.width -= X + width - part.x;
+          part.x = X + width;
+        }
+      g_array_append_val(new, part);
+    }
 
-          tempY = get_effective_Y(X, X + element->width);
+  /* merge neighbours of the same height */
+  for (i = 1; i < new->len; i++) {
+      struct skyline_segment *prev;
+      prev = &g_array_index(new, struct skyline_segment, i - 1);
+      seg = &g_array_index(new, struct skyline_segment, i);
+      if (prev->y == seg->y) {
+          prev->width += seg->width;
+          g_array_remove_index(new, i);
+          i--;
+        }
+    }
 
-          element->posX = X;
-          element->posY = tempY;
-          workdone ++;
+  *skyline = new;
+  *scratch = old;
+}
 
+/* finds the position where an image ends up lowest on the page, if any */
+static int skyline_find(GArray *skyline,
+                        int     width,
+                        int     height,
+                        int     maxX,
+                        int    *X,
+                        int    *Y)
+{
+  int bestTop = INT_MAX;
+  guint i;
+
+  for (i = 0; i < skyline->len; i++) {
+      int tempY = skyline_fit(skyline, i, width, maxX);
 
-          sc = can_scooch(prev, element);
+      if (tempY < 0)
+        break;
+      if (tempY + height <= max_size && tempY + height < bestTop) {
+          bestTop = tempY + height;
+          *X = g_array_index(skyline, struct skyline_segment, i).x;
+          *Y = tempY;
+        }
+    }
+  return bestTop != INT_MAX;
+}
 
-          element->posX -= sc;
+static void skyline_reset(GArray *skyline,
+                          int     maxX)
+{
+  struct skyline_segment seg;
 
-          if (element->posY + element->height > maxY)
-            maxY = element->posY + element->height;
+  seg.x = 0;
+  seg.y = 0;
+  seg.width = maxX;
+  g_array_set_size(skyline, 0);
+  g_array_append_val(skyline, seg);
+}
 
-          prev = element;
-
-
-          /* shortcut .. find other icons that fit us without expanding vertically*/
-
-          tempX = X;
-          tempY += element->height;
-repeat:
-          biggestX = -1;
-          item2 = item;
-          baseY = element->posY + element->height;
-          while (item2 && !sc) {
-              element2 = item2->data;
-              item2 = g_list_next(item2);
-              if (element2->posX != -1)
-                continue;
-              if (tempX + element2->width > X + element->width)
-                continue;
-              if (element2->height > maxY - baseY)
-                continue;
-
-              tempY = get_effective_Y(tempX, tempX+element2->width);
-
-              if (element2->height > maxY - tempY)
-                continue;
-              element2->posX = tempX;
-              element2->posY = tempY;
-
-              if (element2->posX + element2->width > biggestX && element2->width != element->width)
-                biggestX = element2->posX + element2->width;
-              if (element2->width == element->width)
-                biggestX = -1;
-              workdone++;
-              prev = NULL;
-            }
-          if (biggestX > 0) {
-              tempX = biggestX;
-              goto repeat;
+static void do_placement(gpointer data,
+                         gpointer user_data)
+{
+  struct placement *placement = data;
+  struct imgcache_element *prev = NULL;
+  GArray *skyline, *scratch;
+  int prevX = 0, prevY = 0;
+  int maxX = 0, maxY = 0;
+  int page = 0;
+  int n;
+
+  skyline = g_array_new(FALSE, FALSE, sizeof(struct skyline_segment));
+  scratch = g_array_new(FALSE, FALSE, sizeof(struct skyline_segment));
+  skyline_reset(skyline, placement->maxX);
+
+  for (n = 0; n < n_elements; n++) {
+      struct imgcache_element *element = elements[n];
+      int X, Y;
+
+      if (!skyline_find(skyline, element->width, element->height,
+                        placement->maxX, &X, &Y)) {
+          /* the page is full, start a new one */
+          placement->score += (gint64) maxX * maxY;
+          page++;
+          maxX = maxY = 0;
+          prev = NULL;
+          skyline_reset(skyline, placement->maxX);
+
+          if (!skyline_find(skyline, element->width, element->height,
+                            placement->maxX, &X, &Y)) {
+              /* wider than the candidate width */
+              placement->failed = 1;
+              break;
             }
-          X = element->posX +  element->width;
         }
+
+      /* overlap the image to our left where their edges are identical */
+      if (prev && prevX + prev->width == X && prevY == Y) {
+          int sc = can_scooch(prev, element);
+          X -= sc;
+          placement->overlap += sc * element->height;
+        }
+
+      placement->page[n] = page;
+      placement->posX[n] = X;
+      placement->posY[n] = Y;
+      skyline_add(&skyline, &scratch, X, element->width, Y + element->height);
+
+      if (X + element->width > maxX)
+        maxX = X + element->width;
+      if (Y + element->height > maxY)
+        maxY = Y + element->height;
+
+      prev = element;
+      prevX = X;
+      prevY = Y;
     }
 
-  X = 0;
-  Y = 0;
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX + element->width > X)
-        X = element->posX + element->width;
-      if (element->posY + element->height > Y)
-        Y = element->posY + element->height;
-    }
-
-  /* penalties for getting too big for a texture */
-  if (X > 2048)
-    X *= 4;
-  if (Y > 2048)
-    Y *= 4;
-  return X * Y;
+  g_array_free(skyline, TRUE);
+  g_array_free(scratch, TRUE);
+
+  placement->score += (gint64) maxX * maxY;
+  placement->n_pages = page + 1;
 }
 
-static void clear_placement(void)
+static void collect_elements(void)
 {
-  struct imgcache_element *element;
   GList *item;
+  int n;
 
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      element->posX = -1;
-      element->posY = -1;
-    }
+  images = g_list_sort(images, sort_by_size);
+
+  g_free(elements);
+  n_elements = g_list_length(images);
+  elements = g_new(struct imgcache_element *, n_elements);
+  for (item = g_list_first(images), n = 0; item; item = g_list_next(item))
+    elements[n++] = item->data;
+}
+
+static void add_page(int width)
+{
+  struct page_info page;
+
+  page.width = width;
+  page.filename = NULL;
+  page.dirty = 1;
+  g_array_append_val(pages, page);
 }
 
 static void optimal_placement(void)
 {
-  int bestX = -1;
-  int best_score = INT_MAX;
-  int score;
-  int i;
-  int minX;
-  i = 0;
+  struct placement *placements, *best = NULL;
+  GThreadPool *pool;
+  int n_placements = 0;
+  int i, n;
 
-  /* skip X values that would lead to a too large Y dimension */
-  minX = totalarea / 2048;
+  collect_elements();
+  if (!n_elements)
+    return;
 
-  if (minX > 1000)
-    minX = 0;
-  while (sizes[i] > 0) {
-      if (sizes[i] < minX) {
-          i++;
-          continue;
+  placements = g_new0(struct placement, G_N_ELEMENTS(sizes) + 1);
+  pool = g_thread_pool_new(do_placement, NULL, g_get_num_processors(),
+                           TRUE, NULL);
+
+  /* try the candidate widths that fit the widest image, followed by the
+   * largest width allowed */
+  for (i = 0; i < (int) G_N_ELEMENTS(sizes); i++) {
+      int width = sizes[i] > 0 ? sizes[i] : max_size;
+
+      if (width >= sizes[0] && width <= max_size) {
+          struct placement *placement = &placements[n_placements++];
+
+          placement->maxX = width;
+          placement->page = g_new(int, n_elements);
+          placement->posX = g_new(int, n_elements);
+          placement->posY = g_new(int, n_elements);
+          g_thread_pool_push(pool, placement, NULL);
         }
-      score = do_placement(sizes[i]);
-      if (score < best_score) {
-          bestX = sizes[i];
-          best_score = score;
+
+      if (sizes[i] <= 0 || width == max_size)
+        break;
+    }
+
+  /* wait for all the candidates */
+  g_thread_pool_free(pool, FALSE, TRUE);
+
+  for (i = 0; i < n_placements; i++) {
+      if (placements[i].failed)
+        continue;
+      if (!best || placements[i].score < best->score)
+        best = &placements[i];
+    }
+
+  if (best) {
+      for (n = 0; n < n_elements; n++) {
+          elements[n]->page = best->page[n];
+          elements[n]->posX = best->posX[n];
+          elements[n]->posY = best->posY[n];
         }
-      clear_placement();
-      i++;
+      overlaparea = best->overlap;
+      for (i = 0; i < best->n_pages; i++)
+        add_page(best->maxX);
+      printf("Best width is %i, %i pages\n", best->maxX, best->n_pages);
     }
 
-  do_placement(bestX);
-  printf("Best score is %i, %0.1f %% waste\n", best_score, (100.0*best_score / totalarea) -100.0);
+  for (i = 0; i < n_placements; i++) {
+      g_free(placements[i].page);
+      g_free(placements[i].posX);
+      g_free(placements[i].posY);
+    }
+  g_free(placements);
 }
 
-static int make_final_image(char *filename)
+static int sort_by_bottom(const void *a,
+                          const void *b)
 {
-  int maxX = 0, maxY = 0;
-  struct imgcache_element *element;
-  GList *item;
-  GdkPixbuf *final;
+  const struct imgcache_element *A = *(struct imgcache_element **) a;
+  const struct imgcache_element *B = *(struct imgcache_element **) b;
+  return (A->posY + A->height) - (B->posY + B->height);
+}
 
-  /* find the bounding box */
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX + element->width > maxX)
-        maxX = element->posX + element->width;
-      if (element->posY + element->height > maxY)
-        maxY = element->posY + element->height;
+/* Places the new and changed images around the ones that are unchanged
+ * since the last run, so that only the pages they end up on have to be
+ * redrawn. Returns 0 if everything should be packed from scratch. */
+static int incremental_placement(void)
+{
+  struct imgcache_element **fixed = NULL;
+  struct manifest_entry *entry;
+  GHashTableIter iter;
+  GArray **skylines, *scratch;
+  gint64 pagearea = 0;
+  int n_fixed = 0, widest = 0;
+  int i, n, result = 0;
+
+  collect_elements();
+
+  for (i = 0; i < (int) old_pages->len; i++) {
+      struct page_info page = g_array_index(old_pages, struct page_info, i);
+      if (!g_file_test(page.filename, G_FILE_TEST_EXISTS))
+        goto out;
+      page.filename = g_strdup(page.filename);
+      page.dirty = 0;
+      g_array_append_val(pages, page);
+      if (page.width > widest)
+        widest = page.width;
     }
 
-  printf("Final image is %ix%i\n", maxX, maxY);
+  /* the pages that images were removed from */
+  g_hash_table_iter_init(&iter, manifest);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &entry)) {
+      if (entry->page >= 0 && entry->page < (int) pages->len)
+        g_array_index(pages, struct page_info, entry->page).dirty = 1;
+    }
 
-  if (!maxX)
-    return 0;
-  if (!maxY)
-    return 0;
-  final = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, maxX, maxY);
-  assert(final != NULL);
+  /* rebuild the skyline of each page from the images staying on it,
+   * lowest first so that each one raises it */
+  fixed = g_new(struct imgcache_element *, n_elements);
+  for (n = 0; n < n_elements; n++) {
+      if (elements[n]->ptr)
+        continue;
+      if (elements[n]->page < 0 || elements[n]->page >= (int) pages->len ||
+          elements[n]->posX < 0 || elements[n]->posY < 0 ||
+          elements[n]->posX + elements[n]->width >
+          g_array_index(pages, struct page_info, elements[n]->page).width)
+        goto out;
+      fixed[n_fixed++] = elements[n];
+    }
+  qsort(fixed, n_fixed, sizeof(struct imgcache_element *), sort_by_bottom);
 
-  item = g_list_first(images);
-  while (item) {
-      element = item->data;
-      item = g_list_next(item);
-      if (element->posX == -1)
+  skylines = g_new(GArray *, pages->len);
+  scratch = g_array_new(FALSE, FALSE, sizeof(struct skyline_segment));
+  for (i = 0; i < (int) pages->len; i++) {
+      skylines[i] = g_array_new(FALSE, FALSE, sizeof(struct skyline_segment));
+      skyline_reset(skylines[i], g_array_index(pages, struct page_info, i).width);
+    }
+  for (n = 0; n < n_fixed; n++)
+    skyline_add(&skylines[fixed[n]->page], &scratch, fixed[n]->posX,
+                fixed[n]->width, fixed[n]->posY + fixed[n]->height);
+
+  if (widest < sizes[0])
+    widest = sizes[0];
+
+  /* the biggest new images go first, as they are sorted by size */
+  for (n = 0; n < n_elements; n++) {
+      struct imgcache_element *element = elements[n];
+      int X, Y;
+
+      if (!element->ptr)
         continue;
-      gdk_pixbuf_copy_area(element->ptr, 0, 0, element->width, element->height, final, element->posX, element->posY);
+
+      for (i = 0; i < (int) pages->len; i++) {
+          if (skyline_find(skylines[i], element->width, element->height,
+                           g_array_index(pages, struct page_info, i).width,
+                           &X, &Y))
+            break;
+        }
+
+      if (i == (int) pages->len) {
+          add_page(widest);
+          skylines = g_renew(GArray *, skylines, pages->len);
+          skylines[i] = g_array_new(FALSE, FALSE, sizeof(struct skyline_segment));
+          skyline_reset(skylines[i], widest);
+          skyline_find(skylines[i], element->width, element->height, widest,
+                       &X, &Y);
+        }
+
+      element->page = i;
+      element->posX = X;
+      element->posY = Y;
+      skyline_add(&skylines[i], &scratch, X, element->width,
+                  Y + element->height);
+      g_array_index(pages, struct page_info, i).dirty = 1;
+    }
+
+  for (i = 0; i < (int) pages->len; i++)
+    g_array_free(skylines[i], TRUE);
+  g_free(skylines);
+  g_array_free(scratch, TRUE);
+
+  /* the space left by removed images isn't reused, so start again once
+   * too much of it has built up */
+  for (i = 0; i < (int) pages->len; i++) {
+      int maxX = 0, maxY = 0;
+
+      for (n = 0; n < n_elements; n++) {
+          if (elements[n]->page != i)
+            continue;
+          if (elements[n]->posX + elements[n]->width > maxX)
+            maxX = elements[n]->posX + elements[n]->width;
+          if (elements[n]->posY + elements[n]->height > maxY)
+            maxY = elements[n]->posY + elements[n]->height;
+        }
+      pagearea += (gint64) maxX * maxY;
+    }
+  if (pagearea - totalarea > pagearea / 2) {
+      printf("Too much unused space, repacking all images\n");
+      goto out;
+    }
+
+  result = 1;
+
+out:
+  g_free(fixed);
+  return result;
+}
+
+static int make_final_images(char *base)
+{
+  gint64 pagearea = 0;
+  int page;
+
+  for (page = 0; page < (int) pages->len; page++) {
+      struct page_info *info = &g_array_index(pages, struct page_info, page);
+      int maxX = 0, maxY = 0;
+      struct imgcache_element *element;
+      GdkPixbuf *final, *old = NULL;
+      GError *error = NULL;
+      char *filename;
+      int n;
+
+      /* find the bounding box */
+      for (n = 0; n < n_elements; n++) {
+          element = elements[n];
+          if (element->posX == -1 || element->page != page)
+            continue;
+          if (element->posX + element->width > maxX)
+            maxX = element->posX + element->width;
+          if (element->posY + element->height > maxY)
+            maxY = element->posY + element->height;
+        }
+
+      if (!maxX)
+        return 0;
+      if (!maxY)
+        return 0;
+
+      pagearea += (gint64) maxX * maxY;
+
+      if (!info->dirty) {
+          printf("Page %i is unchanged\n", page);
+          continue;
+        }
+
+      printf("Page %i is %ix%i\n", page, maxX, maxY);
+
+      /* images that haven't changed are copied from the old page */
+      if (info->filename) {
+          old = gdk_pixbuf_new_from_file(info->filename, &error);
+          if (!old) {
+              fprintf(stderr, "Cannot read %s: %s\n", info->filename,
+                      error->message);
+              g_error_free(error);
+              return 0;
+            }
+        }
+
+      final = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, maxX, maxY);
+      assert(final != NULL);
+      gdk_pixbuf_fill(final, 0);
+
+      for (n = 0; n < n_elements; n++) {
+          element = elements[n];
+          if (element->posX == -1 || element->page != page)
+            continue;
+          if (element->ptr) {
+              gdk_pixbuf_copy_area(element->ptr, 0, 0, element->width, element->height, final, element->posX, element->posY);
+            } else if (old &&
+                       element->posX + element->width <= gdk_pixbuf_get_width(old) &&
+                       element->posY + element->height <= gdk_pixbuf_get_height(old)) {
+              gdk_pixbuf_copy_area(old, element->posX, element->posY, element->width, element->height, final, element->posX, element->posY);
+            } else {
+              fprintf(stderr, "%s is missing from the old page\n", element->filename);
+              if (old)
+                g_object_unref(old);
+              g_object_unref(final);
+              return 0;
+            }
+        }
+
+      if (old)
+        g_object_unref(old);
+
+      /* Running applications may still use the old page with the old
+       * index, so the new page is written to a new file */
+      filename = g_strdup_printf("%s-%i-%i.png", base, page, generation);
+      if (!gdk_pixbuf_save(final, filename, "png", &error, NULL)) {
+          fprintf(stderr, "Cannot write %s: %s\n", filename, error->message);
+          g_error_free(error);
+          g_free(filename);
+          g_object_unref(final);
+          return 0;
+        }
+      g_object_unref(final);
+
+      g_free(info->filename);
+      info->filename = filename;
     }
 
-  gdk_pixbuf_save(final, filename, "png", NULL, NULL);
+  if (!pagearea)
+    return 0;
+
+  printf("%i pages, %0.1f %% waste\n", (int) pages->len,
+         100.0 * (pagearea - totalarea + overlaparea) / pagearea);
   return 1;
 }
 
@@ -414,60 +802,403 @@ static void makecache(char *directory,
   }
 
   g_dir_close (dir);
+}
 
-  images = g_list_sort(images, sort_by_size);
+struct index_record {
+  MxTextureCacheIndexEntry entry;
+  char *uri;
+};
+
+static int compare_records(const void *a,
+                           const void *b)
+{
+  const struct index_record *A=a, *B=b;
+  if (A->entry.hash < B->entry.hash)
+    return -1;
+  if (A->entry.hash > B->entry.hash)
+    return 1;
+  return strcmp(A->uri, B->uri);
+}
+
+/* the texture cache looks images up by URI, so store them as absolute URIs */
+static char *filename_to_uri(const char *filename)
+{
+  char *path, *uri, *cwd;
+
+  if (g_path_is_absolute(filename))
+    return g_filename_to_uri(filename, NULL, NULL);
+
+  cwd = g_get_current_dir();
+  path = g_build_filename(cwd, filename, NULL);
+  uri = g_filename_to_uri(path, NULL, NULL);
+  g_free(path);
+  g_free(cwd);
+  return uri;
 }
 
-static void write_cache_file(char *directory,
-                             char *pngfile)
+/* Writes the index described in mx-texture-cache-index.h */
+static int write_cache_file(char *directory)
 {
   FILE *file;
-  char *filename = NULL;
-  struct imgcache_element element;
+  char *filename, *tmpname;
+  MxTextureCacheIndexHeader header;
+  struct index_record *records;
   struct imgcache_element *elm;
+  GString *strings;
+  guint32 *page_names;
   GList *item;
+  int i, n = 0, failed = 1;
 
-  memset(&element, 0, sizeof(element));
+  records = g_new0(struct index_record, g_list_length(images));
 
-  strcpy(&element.filename[0], pngfile);
+  item = g_list_first(images);
+  while (item) {
+      elm = item->data;
+      item = g_list_next(item);
+      if (elm->posX == -1)
+        continue;
+      records[n].uri = filename_to_uri(elm->filename);
+      if (!records[n].uri)
+        continue;
+      records[n].entry.hash = mx_texture_cache_index_hash(records[n].uri);
+      records[n].entry.page = elm->page;
+      records[n].entry.x = elm->posX;
+      records[n].entry.y = elm->posY;
+      records[n].entry.width = elm->width;
+      records[n].entry.height = elm->height;
+      n++;
+    }
+
+  qsort(records, n, sizeof(struct index_record), compare_records);
 
+  /* the pages come first in the string table */
+  strings = g_string_new(NULL);
+  page_names = g_new(guint32, pages->len);
+  for (i = 0; i < (int) pages->len; i++) {
+      char *pngfile = g_array_index(pages, struct page_info, i).filename;
+      page_names[i] = strings->len;
+      g_string_append_len(strings, pngfile, strlen(pngfile) + 1);
+    }
+  for (i = 0; i < n; i++) {
+      records[i].entry.uri = strings->len;
+      g_string_append_len(strings, records[i].uri, strlen(records[i].uri) + 1);
+    }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MX_TEXTURE_CACHE_INDEX_MAGIC, sizeof(header.magic));
+  header.version = MX_TEXTURE_CACHE_INDEX_VERSION;
+  header.byte_order = MX_TEXTURE_CACHE_INDEX_BYTE_ORDER;
+  header.n_pages = pages->len;
+  header.n_entries = n;
+  header.strings_size = strings->len;
+
+  /* Applications map the index, so it is replaced rather than rewritten
+   * in place */
   filename = g_strdup_printf("%s/mx.cache", directory);
+  tmpname = g_strdup_printf("%s.tmp", filename);
 
-  file = fopen(filename, "w");
+  file = fopen(tmpname, "w");
   if (!file) {
+      fprintf(stderr, "Cannot write cache file: %s\n", tmpname);
+      goto out;
+    }
+  fwrite(&header, 1, sizeof(header), file);
+  fwrite(page_names, sizeof(guint32), pages->len, file);
+  for (i = 0; i < n; i++)
+    fwrite(&records[i].entry, 1, sizeof(MxTextureCacheIndexEntry), file);
+  fwrite(strings->str, 1, strings->len, file);
+
+  failed = ferror(file);
+  if (fclose(file) != 0)
+    failed = 1;
+
+  if (failed || g_rename(tmpname, filename) != 0) {
       fprintf(stderr, "Cannot write cache file: %s\n", filename);
-      g_free (filename);
+      g_unlink(tmpname);
+      failed = 1;
+    }
+
+out:
+  for (i = 0; i < n; i++)
+    g_free(records[i].uri);
+  g_free(records);
+  g_free(page_names);
+  g_string_free(strings, TRUE);
+  g_free(tmpname);
+  g_free(filename);
+  return !failed;
+}
+
+/* The manifest is a text file, starting with a line giving its version,
+ * the generation of the cache and the size limits it was built with:
+ *
+ *   mx-image-cache-manifest 1 <generation> <max size> <max image size>
+ *
+ * followed by a line for each page and each image, and for each page of
+ * the previous generation that is no longer used:
+ *
+ *   page <width> <filename>
+ *   image <page> <x> <y> <width> <height> <size> <mtime> <sha1> <filename>
+ *   old-page <filename>
+ *
+ * Running applications may still be using the previous index, and load its
+ * pages lazily, so the pages of the previous generation are only removed
+ * by the next update.
+ */
+#define MANIFEST_VERSION 1
+
+/* Reads the pages and, if the cache can be updated, the images of the
+ * manifest */
+static void read_manifest(const char *filename,
+                          int         rebuild)
+{
+  char *contents, **lines;
+  int i, version, old_max_size, old_max_image;
+
+  if (!g_file_get_contents(filename, &contents, NULL, NULL))
+    return;
+
+  lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+
+  if (!lines[0] ||
+      sscanf(lines[0], "mx-image-cache-manifest %d %d %d %d", &version,
+             &generation, &old_max_size, &old_max_image) != 4 ||
+      version != MANIFEST_VERSION) {
+      generation = 0;
+      g_strfreev(lines);
       return;
     }
-  fwrite(&element, 1, sizeof(element), file);
 
-  item = g_list_first(images);
-  while (item) {
-      elm = item->data;
-      item = g_list_next(item);
-      elm->ptr = NULL;
-      fwrite(elm, 1, sizeof(element), file);
+  old_pages = g_array_new(FALSE, FALSE, sizeof(struct page_info));
+  stale_pages = g_ptr_array_new_with_free_func(g_free);
+
+  /* the old pages are still removed once the new ones are written */
+  if (!rebuild && old_max_size == max_size && old_max_image == max_image)
+    manifest = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  else
+    printf("Building the image cache from scratch\n");
+
+  for (i = 1; lines[i]; i++) {
+      struct manifest_entry entry;
+      struct page_info page;
+      int offset;
+
+      if (sscanf(lines[i], "page %d %n", &page.width, &offset) == 1 &&
+          lines[i][offset]) {
+          page.filename = g_strdup(&lines[i][offset]);
+          page.dirty = 0;
+          g_array_append_val(old_pages, page);
+        }
+      else if (g_str_has_prefix(lines[i], "old-page ") &&
+               lines[i][strlen("old-page ")]) {
+          g_ptr_array_add(stale_pages,
+                          g_strdup(&lines[i][strlen("old-page ")]));
+        }
+      else if (sscanf(lines[i], "image %d %d %d %d %d %" G_GINT64_FORMAT
+                      " %" G_GINT64_FORMAT " %40s %n", &entry.page,
+                      &entry.posX, &entry.posY, &entry.width, &entry.height,
+                      &entry.size, &entry.mtime, entry.checksum,
+                      &offset) == 8 && lines[i][offset] && manifest) {
+          g_hash_table_insert(manifest, g_strdup(&lines[i][offset]),
+                              g_memdup(&entry, sizeof(entry)));
+        }
     }
-  g_free (filename);
-  fclose(file);
 
+  g_strfreev(lines);
+}
+
+/* whether @filename is a page of the cache being written */
+static int is_current_page(const char *filename)
+{
+  int i;
+
+  for (i = 0; i < (int) pages->len; i++)
+    if (!strcmp(filename, g_array_index(pages, struct page_info, i).filename))
+      return 1;
+
+  return 0;
+}
+
+static int write_manifest(const char *filename)
+{
+  struct imgcache_element *element;
+  char *tmpname;
+  FILE *file;
+  GList *item;
+  int i, failed;
+
+  tmpname = g_strdup_printf("%s.tmp", filename);
+  file = fopen(tmpname, "w");
+  if (!file) {
+      fprintf(stderr, "Cannot write manifest: %s\n", tmpname);
+      g_free(tmpname);
+      return 0;
+    }
+
+  fprintf(file, "mx-image-cache-manifest %d %d %d %d\n", MANIFEST_VERSION,
+          generation, max_size, max_image);
+
+  for (i = 0; i < (int) pages->len; i++) {
+      struct page_info *page = &g_array_index(pages, struct page_info, i);
+      fprintf(file, "page %d %s\n", page->width, page->filename);
+    }
+
+  for (i = 0; old_pages && i < (int) old_pages->len; i++) {
+      struct page_info *page = &g_array_index(old_pages, struct page_info, i);
+      if (!is_current_page(page->filename))
+        fprintf(file, "old-page %s\n", page->filename);
+    }
+
+  for (item = g_list_first(images); item; item = g_list_next(item)) {
+      element = item->data;
+      if (element->posX == -1)
+        continue;
+      fprintf(file, "image %d %d %d %d %d %" G_GINT64_FORMAT
+              " %" G_GINT64_FORMAT " %s %s\n", element->page, element->posX,
+              element->posY, element->width, element->height, element->size,
+              element->mtime, element->checksum, element->filename);
+    }
+
+  failed = ferror(file);
+  if (fclose(file) != 0)
+    failed = 1;
+
+  if (failed || g_rename(tmpname, filename) != 0) {
+      fprintf(stderr, "Cannot write manifest: %s\n", filename);
+      g_unlink(tmpname);
+      failed = 1;
+    }
+
+  g_free(tmpname);
+  return !failed;
+}
+
+/* drops everything found by makecache(), so that it can be run again */
+static void reset_images(void)
+{
+  GList *item;
+  int i;
+
+  for (item = g_list_first(images); item; item = g_list_next(item)) {
+      struct imgcache_element *element = item->data;
+      if (element->ptr)
+        g_object_unref(element->ptr);
+      g_free(element->filename);
+      g_free(element->checksum);
+      g_free(element);
+    }
+  g_list_free(images);
+  images = NULL;
+
+  g_free(elements);
+  elements = NULL;
+  n_elements = 0;
+
+  totalarea = 0;
+  overlaparea = 0;
+  skipped = 0;
+  sizes[0] = 0;
+
+  for (i = 0; i < (int) pages->len; i++)
+    g_free(g_array_index(pages, struct page_info, i).filename);
+  g_array_set_size(pages, 0);
+}
+
+/* removes the pages that were replaced by the previous update, which no
+ * index refers to any more */
+static void remove_stale_pages(void)
+{
+  int i, j;
+
+  if (!stale_pages)
+    return;
+
+  for (i = 0; i < (int) stale_pages->len; i++) {
+      char *filename = g_ptr_array_index(stale_pages, i);
+
+      if (is_current_page(filename))
+        continue;
+
+      for (j = 0; j < (int) old_pages->len; j++)
+        if (!strcmp(filename, g_array_index(old_pages, struct page_info, j).filename))
+          break;
+
+      if (j == (int) old_pages->len)
+        g_unlink(filename);
+    }
 }
 
 int main(int    argc,
          char **argv)
 {
-  char *image_file = NULL;
+  GOptionContext *context;
+  GError *error = NULL;
+  char *image_base = NULL, *manifest_file;
+  gboolean rebuild = FALSE;
+  GOptionEntry entries[] = {
+    { "max-size", 's', 0, G_OPTION_ARG_INT, &max_size,
+      "The largest width and height of a page (default 2048)", "SIZE" },
+    { "max-image-size", 'i', 0, G_OPTION_ARG_INT, &max_image,
+      "The largest width and height of an image to cache (default 256)",
+      "SIZE" },
+    { "rebuild", 'r', 0, G_OPTION_ARG_NONE, &rebuild,
+      "Pack all images again rather than only the ones that changed", NULL },
+    { NULL }
+  };
+
+  context = g_option_context_new("<directory> - create an image cache");
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free(context);
 
-  if (argc <= 1) {
-      printf("Usage:\n\t\tmakecache <directory>\n");
+  if (argc <= 1 || max_size <= 0 || max_image <= 0) {
+      printf("Usage:\n\t\tmakecache [--max-size=SIZE] "
+             "[--max-image-size=SIZE] [--rebuild] <directory>\n");
       return EXIT_FAILURE;
     }
+  if (max_image > max_size)
+    max_image = max_size;
+
   g_type_init();
+
+  manifest_file = g_strdup_printf("%s/mx.cache.manifest", argv[1]);
+  read_manifest(manifest_file, rebuild);
+  generation++;
+
+  pages = g_array_new(FALSE, FALSE, sizeof(struct page_info));
+  image_base = g_strdup_printf("/var/cache/mx/%08x", g_str_hash(argv[1]));
+
   makecache(argv[1], 1);
-  optimal_placement();
-  image_file = g_strdup_printf("/var/cache/mx/%08x.png", g_str_hash(argv[1]));
-  if (make_final_image(image_file))
-    write_cache_file(argv[1], image_file);
-  g_free (image_file);
+
+  if (!manifest || !incremental_placement() || !make_final_images(image_base)) {
+      /* images that didn't change weren't decoded */
+      if (manifest) {
+          g_hash_table_destroy(manifest);
+          manifest = NULL;
+          reset_images();
+          makecache(argv[1], 1);
+        }
+
+      optimal_placement();
+      if (!make_final_images(image_base)) {
+          g_free (image_base);
+          g_free (manifest_file);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (skipped)
+    printf("Skipped %i images larger than %ix%i\n", skipped, max_image, max_image);
+
+  if (write_cache_file(argv[1]) && write_manifest(manifest_file))
+    remove_stale_pages();
+
+  g_free (image_base);
+  g_free (manifest_file);
   return EXIT_SUCCESS;
 }
@@ -23,6 +23,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <glib/gstdio.h>
 
 #include "mx-private.h"
 
@@ -30,6 +31,27 @@ struct _MxStyleSheet
 {
   GList *selectors;
   GList *filenames;
+
+  /* Selectors bucketed by the key of their rightmost simple selector (id,
+   * class, type or universal), so that a node is only tested against the
+   * selectors that could possibly match it. The index is rebuilt lazily
+   * whenever the list of selectors changes.
+   */
+  GHashTable *id_index;
+  GHashTable *class_index;
+  GHashTable *type_index;
+  GPtrArray  *universal_index;
+  gboolean    index_valid;
+
+  /* The ids, classes and pseudo-classes used in the parent and ancestor
+   * parts of selectors. A change to any other property of a stylable can
+   * not change which selectors match its descendants. These are built
+   * along with the index.
+   */
+  GHashTable *ancestor_ids;
+  GHashTable *ancestor_classes;
+  guint64     ancestor_pseudo_classes;
+  gboolean    ancestor_pseudo_overflow;
 };
 
 typedef struct _MxSelector MxSelector;
@@ -46,23 +68,143 @@ struct _MxSelector
   guint line;
   guint position;
   gint priority;
+
+  /* compiled form of the selector, filled in by mx_selector_compile() */
+  GQuark  type_quark;
+  GQuark  id_quark;
+  GQuark  class_quark;
+  guint64 pseudo_classes;
+  guint   pseudo_overflow : 1;
+  guint   compiled : 1;
+  gint    specificity;
+};
+
+/* The properties of a stylable that can be matched against, resolved once
+ * per lookup. Parent nodes are created on demand when a selector needs to
+ * look further up the tree.
+ */
+typedef struct _CssNode CssNode;
+struct _CssNode
+{
+  MxStylable  *stylable;
+  GType        type;
+  GQuark       id;
+  GQuark       class;
+  guint64      pseudo_classes;
+  const gchar *pseudo_class;
+  CssNode     *parent;
+  guint        parent_resolved : 1;
 };
 
+/* Every pseudo-class name used in a selector is assigned a bit, so that
+ * pseudo-class matching is a mask comparison. Selectors using pseudo-classes
+ * beyond the first 64 fall back to comparing strings.
+ */
+#define CSS_MAX_PSEUDO_CLASSES 64
+
+static GHashTable *pseudo_class_bits = NULL;
+
 
 /* MxStyleSheetValue */
 
 static MxStyleSheetValue *
-mx_style_sheet_value_new ()
+mx_style_sheet_value_new (gchar       *string,
+                          const gchar *source)
+{
+  MxStyleSheetValue *value;
+
+  value = g_slice_new0 (MxStyleSheetValue);
+  value->ref_count = 1;
+  value->string = string;
+  value->source = source;
+
+  return value;
+}
+
+MxStyleSheetValue *
+mx_style_sheet_value_ref (MxStyleSheetValue *value)
 {
-  return g_slice_new0 (MxStyleSheetValue);
+  g_atomic_int_inc (&value->ref_count);
+
+  return value;
 }
 
 static void
-mx_style_sheet_value_free (MxStyleSheetValue *value)
+mx_style_sheet_parsed_value_free (MxStyleSheetParsedValue *parsed)
 {
+  g_value_unset (&parsed->value);
+  g_slice_free (MxStyleSheetParsedValue, parsed);
+}
+
+void
+mx_style_sheet_value_unref (MxStyleSheetValue *value)
+{
+  MxStyleSheetParsedValue *parsed, *next;
+
+  if (!g_atomic_int_dec_and_test (&value->ref_count))
+    return;
+
+  for (parsed = value->parsed; parsed; parsed = next)
+    {
+      next = parsed->next;
+      mx_style_sheet_parsed_value_free (parsed);
+    }
+
+  g_free ((gchar *) value->string);
   g_slice_free (MxStyleSheetValue, value);
 }
 
+/* Returns the parsed form of @value for properties of @type, or %NULL if it
+ * hasn't been added */
+const GValue *
+mx_style_sheet_value_get_parsed (MxStyleSheetValue *value,
+                                 GType              type)
+{
+  MxStyleSheetParsedValue *parsed;
+
+  for (parsed = g_atomic_pointer_get (&value->parsed);
+       parsed;
+       parsed = parsed->next)
+    if (parsed->type == type)
+      return &parsed->value;
+
+  return NULL;
+}
+
+/* Adds @parsed, which is taken over, as the parsed form of @value for
+ * properties of @type, and returns the parsed form that is kept. If
+ * another thread added one for @type first, that one is kept instead and
+ * @parsed is unset. */
+const GValue *
+mx_style_sheet_value_add_parsed (MxStyleSheetValue *value,
+                                 GType              type,
+                                 GValue            *parsed)
+{
+  MxStyleSheetParsedValue *entry, *head, *p;
+
+  entry = g_slice_new (MxStyleSheetParsedValue);
+  entry->type = type;
+  entry->value = *parsed;
+
+  do
+    {
+      head = g_atomic_pointer_get (&value->parsed);
+
+      for (p = head; p; p = p->next)
+        if (p->type == type)
+          {
+            mx_style_sheet_parsed_value_free (entry);
+            return &p->value;
+          }
+
+      entry->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&value->parsed,
+                                                 head, entry));
+
+  return &entry->value;
+}
+
 
 static gchar*
 append (gchar *str1, const gchar *str2)
@@ -201,9 +343,16 @@ css_parse_style (GScanner *scanner, GHashTable *table)
 
       token = css_parse_key_value (scanner, &key, &value);
       if (token != G_TOKEN_NONE)
-        return token;
+        {
+          g_free (key);
+          g_free (value);
+          return token;
+        }
 
-      g_hash_table_insert (table, key, value);
+      /* later declarations in the same block replace earlier ones */
+      g_hash_table_insert (table, key,
+                           mx_style_sheet_value_new (value,
+                                                     scanner->input_name));
 
       token = g_scanner_peek_next_token (scanner);
     }
@@ -378,13 +527,92 @@ mx_selector_free (MxSelector *selector)
   g_free (selector->class);
   g_free (selector->pseudo_class);
 
-  g_hash_table_unref (selector->style);
+  if (selector->style)
+    g_hash_table_unref (selector->style);
 
   mx_selector_free (selector->parent);
+  mx_selector_free (selector->ancestor);
 
   g_slice_free (MxSelector, selector);
 }
 
+static gint
+css_pseudo_class_bit (GQuark pseudo_class)
+{
+  gpointer bit;
+
+  if (!pseudo_class_bits)
+    pseudo_class_bits = g_hash_table_new (NULL, NULL);
+
+  bit = g_hash_table_lookup (pseudo_class_bits, GUINT_TO_POINTER (pseudo_class));
+  if (!bit)
+    {
+      bit = GINT_TO_POINTER (g_hash_table_size (pseudo_class_bits) + 1);
+      g_hash_table_insert (pseudo_class_bits, GUINT_TO_POINTER (pseudo_class),
+                           bit);
+    }
+
+  return GPOINTER_TO_INT (bit) - 1;
+}
+
+static void
+mx_selector_compile (MxSelector *selector)
+{
+  gint a, b;
+
+  if (!selector || selector->compiled)
+    return;
+
+  selector->compiled = TRUE;
+
+  a = 0;
+  b = 0;
+
+  if (selector->type && selector->type[0] != '*')
+    selector->type_quark = g_quark_from_string (selector->type);
+
+  if (selector->id)
+    {
+      selector->id_quark = g_quark_from_string (selector->id);
+      a += 10;
+    }
+
+  if (selector->class)
+    {
+      selector->class_quark = g_quark_from_string (selector->class);
+      b += 10;
+    }
+
+  if (selector->pseudo_class)
+    {
+      gchar **pseudo_classes;
+      gint i;
+
+      pseudo_classes = g_strsplit (selector->pseudo_class, ":", -1);
+      for (i = 0; pseudo_classes[i]; i++)
+        {
+          gint bit;
+
+          bit = css_pseudo_class_bit (g_quark_from_string (pseudo_classes[i]));
+
+          if (bit < CSS_MAX_PSEUDO_CLASSES)
+            selector->pseudo_classes |= G_GUINT64_CONSTANT (1) << bit;
+          else
+            selector->pseudo_overflow = TRUE;
+
+          b += 10;
+        }
+      g_strfreev (pseudo_classes);
+    }
+
+  /* the 'a' and 'b' parts of the score only depend on the selector, the 'c'
+   * part depends on the type hierarchy of the node that is matched */
+  selector->specificity = a * 10000 + b * 100;
+
+  mx_selector_compile (selector->parent);
+  mx_selector_compile (selector->ancestor);
+}
+
 static GTokenType
 css_parse_ruleset (GScanner *scanner, GList **selectors)
 {
@@ -497,8 +725,8 @@ css_parse_block (GScanner *scanner, GList **selectors)
 
 
   /* create a hash table for the properties */
-  table = g_hash_table_new_full (g_str_hash, g_direct_equal, g_free,
-                                 (GDestroyNotify) mx_style_sheet_value_free);
+  table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                 (GDestroyNotify) mx_style_sheet_value_unref);
 
   token = css_parse_style (scanner, table);
 
@@ -618,58 +846,173 @@ list_contains (const gchar *needle,
   return FALSE;
 }
 
-static gint
-css_node_matches_selector (MxSelector *selector,
-                           MxStylable *stylable)
+static guint64
+css_pseudo_class_mask (const gchar *pseudo_class)
 {
-  gint score;
-  gint a, b, c;
+  const gchar *start, *end;
+  guint64 mask = 0;
 
-  const gchar *type = "*";
-  const gchar *class, *pseudo_class;
-  const gchar *id;
-  ClutterActor *actor;
-  MxStylable *parent;
+  if (!pseudo_class || !pseudo_class_bits)
+    return 0;
 
-  a = 0;
-  b = 0;
-  c = 0;
+  for (start = pseudo_class; start; start = end ? end + 1 : NULL)
+    {
+      gchar buffer[64];
+      gpointer bit;
+      GQuark quark;
+      gint len;
+
+      end = strchr (start, ':');
+      len = end ? end - start : strlen (start);
+
+      if (len == 0)
+        continue;
+
+      if (len < (gint) sizeof (buffer))
+        {
+          memcpy (buffer, start, len);
+          buffer[len] = '\0';
+          quark = g_quark_try_string (buffer);
+        }
+      else
+        {
+          gchar *name = g_strndup (start, len);
+          quark = g_quark_try_string (name);
+          g_free (name);
+        }
+
+      /* pseudo-classes that are not interned cannot appear in any selector */
+      if (!quark)
+        continue;
+
+      bit = g_hash_table_lookup (pseudo_class_bits, GUINT_TO_POINTER (quark));
+      if (bit && GPOINTER_TO_INT (bit) <= CSS_MAX_PSEUDO_CLASSES)
+        mask |= G_GUINT64_CONSTANT (1) << (GPOINTER_TO_INT (bit) - 1);
+    }
+
+  return mask;
+}
+
+static void
+css_node_init (CssNode    *node,
+               MxStylable *stylable)
+{
+  const gchar *id, *class;
+
+  node->stylable = stylable;
+  node->type = G_OBJECT_TYPE (stylable);
 
-  /* get properties for this stylable */
   id = clutter_actor_get_name (CLUTTER_ACTOR (stylable));
+  node->id = id ? g_quark_try_string (id) : 0;
+
   class = mx_stylable_get_style_class (stylable);
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+  node->class = class ? g_quark_try_string (class) : 0;
+
+  node->pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+  node->pseudo_classes = css_pseudo_class_mask (node->pseudo_class);
+
+  node->parent = NULL;
+  node->parent_resolved = FALSE;
+}
 
-  /* check type */
-  if (selector->type == NULL || selector->type[0] == '*')
+static CssNode *
+css_node_get_parent (CssNode *node)
+{
+  ClutterActor *actor;
+
+  if (node->parent_resolved)
+    return node->parent;
+
+  node->parent_resolved = TRUE;
+
+  actor = clutter_actor_get_parent (CLUTTER_ACTOR (node->stylable));
+  if (MX_IS_STYLABLE (actor))
     {
-      /* NULL or universal selector match, but are ignored for score */
+      node->parent = g_slice_new (CssNode);
+      css_node_init (node->parent, MX_STYLABLE (actor));
     }
-  else
+
+  return node->parent;
+}
+
+static void
+css_node_clear (CssNode *node)
+{
+  CssNode *parent, *next;
+
+  for (parent = node->parent; parent; parent = next)
+    {
+      next = parent->parent;
+      g_slice_free (CssNode, parent);
+    }
+
+  node->parent = NULL;
+  node->parent_resolved = FALSE;
+}
+
+static gboolean
+css_node_matches_pseudo_class_strings (MxSelector *selector,
+                                       CssNode    *node)
+{
+  gchar *needle;
+
+  if (!node->pseudo_class)
+    return FALSE;
+
+  /* check that each pseudo-class from the selector appears in the
+   * pseudo-classes from the node, i.e. the selector pseudo-class list
+   * is a subset of the node's pseudo-class list */
+  for (needle = selector->pseudo_class;
+       needle; needle = strchr (needle, ':'))
+    {
+      gint needle_len;
+      gchar *next;
+
+      /* move beyond ':' */
+      if (needle[0] == ':')
+        needle++;
+
+      /* calculate the length of this needle */
+      next = strchr (needle, ':');
+      if (next)
+        needle_len = next - needle;
+      else
+        needle_len = strlen (needle);
+
+      if (!list_contains (needle, needle_len, node->pseudo_class, ':'))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+css_node_matches_selector (MxSelector *selector,
+                           CssNode    *node)
+{
+  gint c = 0;
+
+  /* check type, NULL or universal selectors match but are ignored for
+   * score */
+  if (selector->type_quark)
     {
       GType type_id;
-      gint matched;
+      gboolean matched;
       gint depth;
 
-      type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-      type = g_type_name (type_id);
       matched = FALSE;
-
       depth = 10;
-      while (type)
+
+      for (type_id = node->type; type_id; type_id = g_type_parent (type_id))
         {
-          if (!strcmp (selector->type, type))
+          if (g_type_qname (type_id) == selector->type_quark)
             {
-              matched = depth;
+              matched = TRUE;
               break;
             }
-          else
-            {
-              type_id = g_type_parent (type_id);
-              type = g_type_name (type_id);
-              if (depth > 1)
-                depth--;
-            }
+
+          if (depth > 1)
+            depth--;
         }
 
       if (!matched)
@@ -679,79 +1022,29 @@ css_node_matches_selector (MxSelector *selector,
     }
 
   /* check id */
-  if (selector->id)
-    {
-      if (!id || strcmp (selector->id, id))
-        return -1;
-      else
-        a += 10;
-    }
+  if (selector->id_quark && selector->id_quark != node->id)
+    return -1;
 
   /* check pseudo_class */
-  if (selector->pseudo_class)
-    {
-      gchar *needle;
-      gint n_matches;
-
-      /* if no pseudo class is supplied on the node, return instantly */
-      if (!pseudo_class)
-        return -1;
-
-      /* check that each pseudo-class from the selector appears in the
-       * pseudo-classes from the node, i.e. the selector pseudo-class list
-       * is a subset of the node's pseudo-class list */
-      n_matches = 0;
-      for (needle = selector->pseudo_class;
-           needle; needle = strchr (needle, ':'))
-        {
-          gint needle_len;
-          gchar *next;
-
-          /* move beyond ':' */
-          if (needle[0] == ':')
-            needle++;
-
-          /* calculate the length of this needle */
-          next = strchr (needle, ':');
-          if (next)
-            needle_len = next - needle;
-          else
-            needle_len = strlen (needle);
+  if ((node->pseudo_classes & selector->pseudo_classes) !=
+      selector->pseudo_classes)
+    return -1;
 
-          /* if the pseudo-class from the selector does not appear in the
-           * list of pseudo-classes from the node, then this is not a
-           * match */
-          if (!list_contains (needle, needle_len, pseudo_class, ':'))
-            return -1;
-          else
-            n_matches++;
-        }
-
-      /* increase the 'b' score by the number of pseudo-classes in the
-       * selector */
-      b = b + (10 * n_matches);
-    }
+  if (selector->pseudo_overflow &&
+      !css_node_matches_pseudo_class_strings (selector, node))
+    return -1;
 
   /* check class */
-  if (selector->class)
-    {
-      if (!class || strcmp (selector->class, class))
-        return -1;
-      else
-        b += 10;
-    }
+  if (selector->class_quark && selector->class_quark != node->class)
+    return -1;
 
   /* check parent */
-  actor = clutter_actor_get_parent (CLUTTER_ACTOR (stylable));
-  if (MX_IS_STYLABLE (actor))
-    parent = MX_STYLABLE (actor);
-  else
-    parent = NULL;
-
   if (selector->parent)
     {
+      CssNode *parent;
       gint parent_matches;
 
+      parent = css_node_get_parent (node);
       if (!parent)
         return -1;
 
@@ -766,23 +1059,15 @@ css_node_matches_selector (MxSelector *selector,
   /* check ancestor */
   if (selector->ancestor)
     {
+      CssNode *ancestor;
       gint ancestor_matches;
-      MxStylable *pparent, *ancestor;
-      ClutterActor *parent_actor;
 
-      if (!parent)
+      ancestor = css_node_get_parent (node);
+      if (!ancestor)
         return -1;
 
-      ancestor = parent;
       while (ancestor)
         {
-          parent_actor = clutter_actor_get_parent (CLUTTER_ACTOR (ancestor));
-          if (MX_IS_STYLABLE (parent_actor))
-            pparent = MX_STYLABLE (parent_actor);
-          else
-            pparent = NULL;
-
-
           ancestor_matches = css_node_matches_selector (selector->ancestor,
                                                         ancestor);
 
@@ -794,19 +1079,13 @@ css_node_matches_selector (MxSelector *selector,
               break;
             }
 
-          ancestor = pparent;
-          if (!ancestor || !MX_IS_STYLABLE (ancestor))
+          ancestor = css_node_get_parent (ancestor);
+          if (!ancestor)
             return -1;
         }
     }
 
-
-  a = a * 10000;
-  b = b * 100;
-
-  score = a + b + c;
-
-  return score;
+  return selector->specificity + c;
 }
 
 typedef struct _SelectorMatch
@@ -836,30 +1115,173 @@ compare_selector_matches (SelectorMatch *a,
     return 0;
 }
 
-struct _css_table_copy_data
+static void
+css_table_copy (const gchar       *key,
+                MxStyleSheetValue *value,
+                GHashTable        *table)
 {
-  GHashTable *table;
-  const gchar *filename;
-};
+  /* the declarations are shared with the selector, so this only needs to
+   * take a reference rather than copying them */
+  g_hash_table_insert (table, (gpointer) key,
+                       mx_style_sheet_value_ref (value));
+}
+
+static void
+free_selector_match (SelectorMatch *data)
+{
+  g_slice_free (SelectorMatch, data);
+}
 
 static void
-css_table_copy (gpointer                    *key,
-                gpointer                    *value,
-                struct _css_table_copy_data *data)
+css_index_add (GHashTable *index,
+               GQuark      key,
+               MxSelector *selector)
 {
-  MxStyleSheetValue *css_value;
+  GPtrArray *bucket;
 
-  css_value = mx_style_sheet_value_new ();
-  css_value->source = data->filename;
-  css_value->string = (gchar*) value;
+  bucket = g_hash_table_lookup (index, GUINT_TO_POINTER (key));
+  if (!bucket)
+    {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (index, GUINT_TO_POINTER (key), bucket);
+    }
 
-  g_hash_table_insert (data->table, key, css_value);
+  g_ptr_array_add (bucket, selector);
 }
 
 static void
-free_selector_match (SelectorMatch *data)
+css_sheet_clear_index (MxStyleSheet *sheet)
 {
-  g_slice_free (SelectorMatch, data);
+  if (sheet->id_index)
+    {
+      g_hash_table_unref (sheet->id_index);
+      g_hash_table_unref (sheet->class_index);
+      g_hash_table_unref (sheet->type_index);
+      g_ptr_array_unref (sheet->universal_index);
+
+      sheet->id_index = NULL;
+      sheet->class_index = NULL;
+      sheet->type_index = NULL;
+      sheet->universal_index = NULL;
+
+      g_hash_table_unref (sheet->ancestor_ids);
+      g_hash_table_unref (sheet->ancestor_classes);
+
+      sheet->ancestor_ids = NULL;
+      sheet->ancestor_classes = NULL;
+    }
+
+  sheet->ancestor_pseudo_classes = 0;
+  sheet->ancestor_pseudo_overflow = FALSE;
+  sheet->index_valid = FALSE;
+}
+
+static void
+css_sheet_add_ancestor_dependencies (MxStyleSheet *sheet,
+                                     MxSelector   *selector)
+{
+  if (!selector)
+    return;
+
+  if (selector->id_quark)
+    g_hash_table_add (sheet->ancestor_ids,
+                      GUINT_TO_POINTER (selector->id_quark));
+
+  if (selector->class_quark)
+    g_hash_table_add (sheet->ancestor_classes,
+                      GUINT_TO_POINTER (selector->class_quark));
+
+  sheet->ancestor_pseudo_classes |= selector->pseudo_classes;
+  if (selector->pseudo_overflow)
+    sheet->ancestor_pseudo_overflow = TRUE;
+
+  css_sheet_add_ancestor_dependencies (sheet, selector->parent);
+  css_sheet_add_ancestor_dependencies (sheet, selector->ancestor);
+}
+
+static void
+css_sheet_build_index (MxStyleSheet *sheet)
+{
+  gboolean use_index;
+  GList *l;
+
+  css_sheet_clear_index (sheet);
+
+  /* the keys are the quarks of the selector id, class and type names */
+  sheet->id_index = g_hash_table_new_full (NULL, NULL, NULL,
+                                           (GDestroyNotify) g_ptr_array_unref);
+  sheet->class_index = g_hash_table_new_full (NULL, NULL, NULL,
+                                              (GDestroyNotify) g_ptr_array_unref);
+  sheet->type_index = g_hash_table_new_full (NULL, NULL, NULL,
+                                             (GDestroyNotify) g_ptr_array_unref);
+  sheet->universal_index = g_ptr_array_new ();
+  sheet->ancestor_ids = g_hash_table_new (NULL, NULL);
+  sheet->ancestor_classes = g_hash_table_new (NULL, NULL);
+
+  /* MX_DEBUG=no-css-index puts every selector in the universal bucket, so
+   * that each node is tested against every selector as before the index
+   * existed */
+  use_index = !_mx_debug (MX_DEBUG_NO_CSS_INDEX);
+
+  /* Each selector is placed in exactly one bucket, using its most
+   * selective key. A node that does not have that key can never match the
+   * selector, so it never needs to be tested against it.
+   */
+  for (l = sheet->selectors; l; l = l->next)
+    {
+      MxSelector *selector = l->data;
+
+      /* Selectors are compiled here rather than when they are parsed, as
+       * the pseudo-class registry is only used from the main thread while
+       * style sheets may be parsed from other threads */
+      mx_selector_compile (selector);
+
+      if (!use_index)
+        g_ptr_array_add (sheet->universal_index, selector);
+      else if (selector->id_quark)
+        css_index_add (sheet->id_index, selector->id_quark, selector);
+      else if (selector->class_quark)
+        css_index_add (sheet->class_index, selector->class_quark, selector);
+      else if (selector->type_quark)
+        css_index_add (sheet->type_index, selector->type_quark, selector);
+      else
+        g_ptr_array_add (sheet->universal_index, selector);
+
+      css_sheet_add_ancestor_dependencies (sheet, selector->parent);
+      css_sheet_add_ancestor_dependencies (sheet, selector->ancestor);
+    }
+
+  sheet->index_valid = TRUE;
+}
+
+static GList *
+css_match_bucket (GPtrArray *bucket,
+                  CssNode   *node,
+                  GList     *matching_selectors)
+{
+  guint i;
+
+  if (!bucket)
+    return matching_selectors;
+
+  for (i = 0; i < bucket->len; i++)
+    {
+      MxSelector *selector = g_ptr_array_index (bucket, i);
+      gint score;
+
+      score = css_node_matches_selector (selector, node);
+
+      if (score >= 0)
+        {
+          SelectorMatch *selector_match = g_slice_new (SelectorMatch);
+          selector_match->selector = selector;
+          selector_match->score = score;
+          matching_selectors = g_list_prepend (matching_selectors,
+                                               selector_match);
+        }
+    }
+
+  return matching_selectors;
 }
 
 GHashTable *
@@ -868,8 +1290,9 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
 {
   GTimer *timer = NULL;
   GList *l, *matching_selectors = NULL;
-  SelectorMatch *selector_match = NULL;
   GHashTable *result;
+  CssNode css_node;
+  GType type_id;
 
   if (_mx_debug (MX_DEBUG_CSS))
     {
@@ -891,22 +1314,35 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
       g_print ("\x1b[22m");
     }
 
-  /* find matching selectors */
-  for (l = sheet->selectors; l; l = l->next)
-    {
-      gint score;
+  if (!sheet->index_valid)
+    css_sheet_build_index (sheet);
 
-      score = css_node_matches_selector (l->data, node);
+  css_node_init (&css_node, node);
 
-      if (score >= 0)
-        {
-          selector_match = g_slice_new (SelectorMatch);
-          selector_match->selector = l->data;
-          selector_match->score = score;
-          matching_selectors = g_list_prepend (matching_selectors,
-                                               selector_match);
-        }
-    }
+  /* find matching selectors, only looking at the buckets for the keys this
+   * node actually has */
+  if (css_node.id)
+    matching_selectors =
+      css_match_bucket (g_hash_table_lookup (sheet->id_index,
+                                             GUINT_TO_POINTER (css_node.id)),
+                        &css_node, matching_selectors);
+
+  if (css_node.class)
+    matching_selectors =
+      css_match_bucket (g_hash_table_lookup (sheet->class_index,
+                                             GUINT_TO_POINTER (css_node.class)),
+                        &css_node, matching_selectors);
+
+  for (type_id = css_node.type; type_id; type_id = g_type_parent (type_id))
+    matching_selectors =
+      css_match_bucket (g_hash_table_lookup (sheet->type_index,
+                                             GUINT_TO_POINTER (g_type_qname (type_id))),
+                        &css_node, matching_selectors);
+
+  matching_selectors = css_match_bucket (sheet->universal_index, &css_node,
+                                         matching_selectors);
+
+  css_node_clear (&css_node);
 
   /* score the selectors by their score */
   matching_selectors = g_list_sort (matching_selectors,
@@ -916,17 +1352,13 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
   result = g_hash_table_new_full (g_str_hash,
                                   g_str_equal,
                                   NULL,
-                                  (GDestroyNotify)mx_style_sheet_value_free);
+                                  (GDestroyNotify)mx_style_sheet_value_unref);
   for (l = matching_selectors; l; l = l->next)
     {
       SelectorMatch *match = l->data;
-      struct _css_table_copy_data copy_data;
-
-      copy_data.filename = match->selector->filename;
-      copy_data.table = result;
 
       g_hash_table_foreach (match->selector->style, (GHFunc) css_table_copy,
-                            &copy_data);
+                            result);
 
       if (_mx_debug (MX_DEBUG_CSS))
         print_selector (match->selector, match->score);
@@ -946,6 +1378,64 @@ mx_style_sheet_get_properties (MxStyleSheet *sheet,
   return result;
 }
 
+static gboolean
+css_quark_set_contains (GHashTable  *set,
+                        const gchar *string)
+{
+  GQuark quark;
+
+  if (!string)
+    return FALSE;
+
+  quark = g_quark_try_string (string);
+
+  return quark && g_hash_table_contains (set, GUINT_TO_POINTER (quark));
+}
+
+/* Returns whether changing the id, class and pseudo-class of @node from the
+ * given old values could change which selectors match its descendants. */
+gboolean
+mx_style_sheet_descendants_depend_on (MxStyleSheet *sheet,
+                                      MxStylable   *node,
+                                      const gchar  *old_id,
+                                      const gchar  *old_class,
+                                      const gchar  *old_pseudo_class)
+{
+  const gchar *id, *class, *pseudo_class;
+
+  if (!sheet->index_valid)
+    css_sheet_build_index (sheet);
+
+  id = clutter_actor_get_name (CLUTTER_ACTOR (node));
+  if (g_strcmp0 (id, old_id) &&
+      (css_quark_set_contains (sheet->ancestor_ids, id) ||
+       css_quark_set_contains (sheet->ancestor_ids, old_id)))
+    return TRUE;
+
+  class = mx_stylable_get_style_class (node);
+  if (g_strcmp0 (class, old_class) &&
+      (css_quark_set_contains (sheet->ancestor_classes, class) ||
+       css_quark_set_contains (sheet->ancestor_classes, old_class)))
+    return TRUE;
+
+  pseudo_class = mx_stylable_get_style_pseudo_class (node);
+  if (g_strcmp0 (pseudo_class, old_pseudo_class))
+    {
+      guint64 changed;
+
+      if (sheet->ancestor_pseudo_overflow)
+        return TRUE;
+
+      changed = css_pseudo_class_mask (pseudo_class) ^
+        css_pseudo_class_mask (old_pseudo_class);
+
+      if (changed & sheet->ancestor_pseudo_classes)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
 MxStyleSheet *
 mx_style_sheet_new ()
 {
@@ -955,6 +1445,8 @@ mx_style_sheet_new ()
 void
 mx_style_sheet_destroy (MxStyleSheet *sheet)
 {
+  css_sheet_clear_index (sheet);
+
   g_list_foreach (sheet->selectors, (GFunc) mx_selector_free, NULL);
   g_list_free (sheet->selectors);
 
@@ -979,6 +1471,7 @@ mx_style_sheet_add_from_file (MxStyleSheet *sheet,
   input_name = g_strdup (filename);
   result = css_parse_file (sheet, input_name, NULL, g_list_length (sheet->filenames));
   sheet->filenames = g_list_prepend (sheet->filenames, input_name);
+  sheet->index_valid = FALSE;
 
   return result;
 }
@@ -1000,10 +1493,615 @@ mx_style_sheet_add_from_data (MxStyleSheet  *sheet,
   input_name = g_strdup (id);
   result = css_parse_file (sheet, input_name, data, g_list_length (sheet->filenames));
   sheet->filenames = g_list_prepend (sheet->filenames, input_name);
+  sheet->index_valid = FALSE;
 
   return result;
 }
 
+/* Compiled style sheets
+ *
+ * A compiled style sheet is the parsed form of a CSS file, serialized so
+ * that it can be loaded without going through the scanner. It is laid out
+ * as a header followed by the arrays of root selectors, selectors,
+ * declaration blocks and declarations, and a string table that all the
+ * strings are offsets into. Selectors refer to their parent and ancestor
+ * selectors by index, and these always come after the selector referring
+ * to them.
+ *
+ * The header records the size, modification time and hash of the CSS it
+ * was compiled from, so that a compiled style sheet that no longer matches
+ * its source is ignored.
+ */
+
+#define CSS_BLOB_MAGIC   "MXCSS\0\0\0"
+#define CSS_BLOB_VERSION 1
+#define CSS_BLOB_NONE    G_MAXUINT32
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint64 source_size;
+  gint64  source_mtime;
+  guint32 source_hash;
+  guint32 n_roots;
+  guint32 n_selectors;
+  guint32 n_blocks;
+  guint32 n_declarations;
+  guint32 strings_size;
+} CssBlobHeader;
+
+typedef struct
+{
+  guint32 type;
+  guint32 id;
+  guint32 class;
+  guint32 pseudo_class;
+  guint32 parent;
+  guint32 ancestor;
+  guint32 block;
+  guint32 line;
+  guint32 position;
+} CssBlobSelector;
+
+typedef struct
+{
+  guint32 first_declaration;
+  guint32 n_declarations;
+} CssBlobBlock;
+
+typedef struct
+{
+  guint32 property;
+  guint32 value;
+} CssBlobDeclaration;
+
+typedef struct
+{
+  GArray     *roots;
+  GArray     *selectors;
+  GArray     *blocks;
+  GArray     *declarations;
+  GString    *strings;
+  GHashTable *string_offsets;
+  GHashTable *block_indices;
+} CssBlobWriter;
+
+static guint32
+css_blob_hash (const gchar *data,
+               gsize        length)
+{
+  guint32 hash = 2166136261u;
+  gsize i;
+
+  /* FNV-1a */
+  for (i = 0; i < length; i++)
+    {
+      hash ^= (guchar) data[i];
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+static guint32
+css_blob_add_string (CssBlobWriter *writer,
+                     const gchar   *string)
+{
+  gpointer offset;
+
+  if (!string)
+    return CSS_BLOB_NONE;
+
+  if (g_hash_table_lookup_extended (writer->string_offsets, string,
+                                    NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (writer->strings->len);
+  g_string_append_len (writer->strings, string, strlen (string) + 1);
+  g_hash_table_insert (writer->string_offsets, (gpointer) string, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static guint32
+css_blob_add_block (CssBlobWriter *writer,
+                    GHashTable    *style)
+{
+  GHashTableIter iter;
+  gpointer key, value, index;
+  CssBlobBlock block;
+
+  if (!style)
+    return CSS_BLOB_NONE;
+
+  if (g_hash_table_lookup_extended (writer->block_indices, style,
+                                    NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  block.first_declaration = writer->declarations->len;
+  block.n_declarations = g_hash_table_size (style);
+
+  g_hash_table_iter_init (&iter, style);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      CssBlobDeclaration declaration;
+
+      declaration.property = css_blob_add_string (writer, key);
+      declaration.value =
+        css_blob_add_string (writer, ((MxStyleSheetValue *) value)->string);
+      g_array_append_val (writer->declarations, declaration);
+    }
+
+  index = GUINT_TO_POINTER (writer->blocks->len);
+  g_array_append_val (writer->blocks, block);
+  g_hash_table_insert (writer->block_indices, style, index);
+
+  return GPOINTER_TO_UINT (index);
+}
+
+static guint32
+css_blob_add_selector (CssBlobWriter *writer,
+                       MxSelector    *selector)
+{
+  CssBlobSelector record;
+  guint32 index;
+
+  if (!selector)
+    return CSS_BLOB_NONE;
+
+  /* reserve the record first, so that the parent and ancestor selectors
+   * are stored after the selector that refers to them */
+  index = writer->selectors->len;
+  g_array_set_size (writer->selectors, index + 1);
+
+  record.type = css_blob_add_string (writer, selector->type);
+  record.id = css_blob_add_string (writer, selector->id);
+  record.class = css_blob_add_string (writer, selector->class);
+  record.pseudo_class = css_blob_add_string (writer, selector->pseudo_class);
+  record.block = css_blob_add_block (writer, selector->style);
+  record.line = selector->line;
+  record.position = selector->position;
+  record.parent = css_blob_add_selector (writer, selector->parent);
+  record.ancestor = css_blob_add_selector (writer, selector->ancestor);
+
+  g_array_index (writer->selectors, CssBlobSelector, index) = record;
+
+  return index;
+}
+
+/* Serializes the selectors that were loaded from @id. @source is the CSS
+ * they were parsed from, and @source_mtime its modification time, which
+ * are used to tell whether the result is still current when it is
+ * loaded. */
+gchar *
+mx_style_sheet_compile (MxStyleSheet *sheet,
+                        const gchar  *id,
+                        const gchar  *source,
+                        gsize         source_length,
+                        gint64        source_mtime,
+                        gsize        *length)
+{
+  CssBlobWriter writer;
+  CssBlobHeader header;
+  GString *blob;
+  GList *l;
+
+  g_return_val_if_fail (sheet != NULL, NULL);
+  g_return_val_if_fail (id != NULL, NULL);
+  g_return_val_if_fail (source != NULL, NULL);
+
+  writer.roots = g_array_new (FALSE, FALSE, sizeof (guint32));
+  writer.selectors = g_array_new (FALSE, TRUE, sizeof (CssBlobSelector));
+  writer.blocks = g_array_new (FALSE, FALSE, sizeof (CssBlobBlock));
+  writer.declarations = g_array_new (FALSE, FALSE, sizeof (CssBlobDeclaration));
+  writer.strings = g_string_new (NULL);
+  writer.string_offsets = g_hash_table_new (g_str_hash, g_str_equal);
+  writer.block_indices = g_hash_table_new (NULL, NULL);
+
+  for (l = sheet->selectors; l; l = l->next)
+    {
+      MxSelector *selector = l->data;
+      guint32 index;
+
+      if (g_strcmp0 (selector->filename, id))
+        continue;
+
+      index = css_blob_add_selector (&writer, selector);
+      g_array_append_val (writer.roots, index);
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CSS_BLOB_MAGIC, sizeof (header.magic));
+  header.version = CSS_BLOB_VERSION;
+  header.byte_order = G_BYTE_ORDER;
+  header.source_size = source_length;
+  header.source_mtime = source_mtime;
+  header.source_hash = css_blob_hash (source, source_length);
+  header.n_roots = writer.roots->len;
+  header.n_selectors = writer.selectors->len;
+  header.n_blocks = writer.blocks->len;
+  header.n_declarations = writer.declarations->len;
+  header.strings_size = writer.strings->len;
+
+  blob = g_string_new (NULL);
+  g_string_append_len (blob, (gchar *) &header, sizeof (header));
+  g_string_append_len (blob, writer.roots->data,
+                       writer.roots->len * sizeof (guint32));
+  g_string_append_len (blob, writer.selectors->data,
+                       writer.selectors->len * sizeof (CssBlobSelector));
+  g_string_append_len (blob, writer.blocks->data,
+                       writer.blocks->len * sizeof (CssBlobBlock));
+  g_string_append_len (blob, writer.declarations->data,
+                       writer.declarations->len * sizeof (CssBlobDeclaration));
+  g_string_append_len (blob, writer.strings->str, writer.strings->len);
+
+  g_array_free (writer.roots, TRUE);
+  g_array_free (writer.selectors, TRUE);
+  g_array_free (writer.blocks, TRUE);
+  g_array_free (writer.declarations, TRUE);
+  g_string_free (writer.strings, TRUE);
+  g_hash_table_destroy (writer.string_offsets);
+  g_hash_table_destroy (writer.block_indices);
+
+  if (length)
+    *length = blob->len;
+
+  return g_string_free (blob, FALSE);
+}
+
+typedef struct
+{
+  const CssBlobHeader      *header;
+  const guint32            *roots;
+  const CssBlobSelector    *selectors;
+  const CssBlobBlock       *blocks;
+  const CssBlobDeclaration *declarations;
+  const gchar              *strings;
+
+  gchar      *input_name;
+  gint        priority;
+  GHashTable **styles;
+} CssBlobReader;
+
+static const gchar *
+css_blob_get_string (CssBlobReader *reader,
+                     guint32        offset)
+{
+  return (offset == CSS_BLOB_NONE) ? NULL : reader->strings + offset;
+}
+
+/* Checks that every offset and index in the blob is in range, and that the
+ * selectors form trees, so that loading it can't read out of bounds */
+static gboolean
+css_blob_validate (CssBlobReader *reader,
+                   gsize          length)
+{
+  const CssBlobHeader *header = reader->header;
+  gboolean *referenced;
+  gboolean valid = TRUE;
+  guint64 size;
+  guint32 i;
+
+  size = sizeof (CssBlobHeader) +
+    (guint64) header->n_roots * sizeof (guint32) +
+    (guint64) header->n_selectors * sizeof (CssBlobSelector) +
+    (guint64) header->n_blocks * sizeof (CssBlobBlock) +
+    (guint64) header->n_declarations * sizeof (CssBlobDeclaration) +
+    header->strings_size;
+
+  if (size != length)
+    return FALSE;
+
+  if (header->strings_size &&
+      reader->strings[header->strings_size - 1] != '\0')
+    return FALSE;
+
+#define CHECK_STRING(o) \
+  ((o) == CSS_BLOB_NONE || (o) < header->strings_size)
+
+  for (i = 0; i < header->n_declarations; i++)
+    if (!CHECK_STRING (reader->declarations[i].property) ||
+        reader->declarations[i].property == CSS_BLOB_NONE ||
+        !CHECK_STRING (reader->declarations[i].value))
+      return FALSE;
+
+  for (i = 0; i < header->n_blocks; i++)
+    if ((guint64) reader->blocks[i].first_declaration +
+        reader->blocks[i].n_declarations > header->n_declarations)
+      return FALSE;
+
+  /* every selector must be referenced exactly once, either as a root or
+   * as the parent or ancestor of a selector stored before it */
+  referenced = g_new0 (gboolean, header->n_selectors);
+
+  for (i = 0; valid && i < header->n_roots; i++)
+    {
+      guint32 root = reader->roots[i];
+
+      if (root >= header->n_selectors || referenced[root])
+        valid = FALSE;
+      else
+        referenced[root] = TRUE;
+    }
+
+  for (i = 0; valid && i < header->n_selectors; i++)
+    {
+      const CssBlobSelector *selector = &reader->selectors[i];
+      guint32 links[2] = { selector->parent, selector->ancestor };
+      gint j;
+
+      if (!CHECK_STRING (selector->type) ||
+          !CHECK_STRING (selector->id) ||
+          !CHECK_STRING (selector->class) ||
+          !CHECK_STRING (selector->pseudo_class) ||
+          (selector->block != CSS_BLOB_NONE &&
+           selector->block >= header->n_blocks))
+        {
+          valid = FALSE;
+          break;
+        }
+
+      for (j = 0; j < 2; j++)
+        {
+          if (links[j] == CSS_BLOB_NONE)
+            continue;
+
+          if (links[j] <= i || links[j] >= header->n_selectors ||
+              referenced[links[j]])
+            {
+              valid = FALSE;
+              break;
+            }
+
+          referenced[links[j]] = TRUE;
+        }
+    }
+
+  for (i = 0; valid && i < header->n_selectors; i++)
+    if (!referenced[i])
+      valid = FALSE;
+
+#undef CHECK_STRING
+
+  g_free (referenced);
+
+  return valid;
+}
+
+static GHashTable *
+css_blob_load_block (CssBlobReader *reader,
+                     guint32        index)
+{
+  const CssBlobBlock *block;
+  GHashTable *table;
+  guint32 i;
+
+  if (index == CSS_BLOB_NONE)
+    return NULL;
+
+  if (reader->styles[index])
+    return g_hash_table_ref (reader->styles[index]);
+
+  block = &reader->blocks[index];
+  table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                 (GDestroyNotify) mx_style_sheet_value_unref);
+
+  for (i = 0; i < block->n_declarations; i++)
+    {
+      const CssBlobDeclaration *declaration =
+        &reader->declarations[block->first_declaration + i];
+      const gchar *value = css_blob_get_string (reader, declaration->value);
+
+      g_hash_table_insert (table,
+                           g_strdup (css_blob_get_string (reader,
+                                                          declaration->property)),
+                           mx_style_sheet_value_new (g_strdup (value),
+                                                     reader->input_name));
+    }
+
+  reader->styles[index] = table;
+
+  return g_hash_table_ref (table);
+}
+
+static MxSelector *
+css_blob_load_selector (CssBlobReader *reader,
+                        guint32        index)
+{
+  const CssBlobSelector *record;
+  MxSelector *selector;
+
+  if (index == CSS_BLOB_NONE)
+    return NULL;
+
+  record = &reader->selectors[index];
+
+  selector = mx_selector_new (reader->input_name, reader->priority,
+                              record->line, record->position);
+  selector->type = g_strdup (css_blob_get_string (reader, record->type));
+  selector->id = g_strdup (css_blob_get_string (reader, record->id));
+  selector->class = g_strdup (css_blob_get_string (reader, record->class));
+  selector->pseudo_class =
+    g_strdup (css_blob_get_string (reader, record->pseudo_class));
+  selector->style = css_blob_load_block (reader, record->block);
+  selector->parent = css_blob_load_selector (reader, record->parent);
+  selector->ancestor = css_blob_load_selector (reader, record->ancestor);
+
+  return selector;
+}
+
+/* Adds the selectors of a compiled style sheet, if it is valid and was
+ * compiled from a source of @source_length bytes and either the contents
+ * @source or, if that is %NULL, the modification time @source_mtime */
+static gboolean
+css_blob_load (MxStyleSheet *sheet,
+               const gchar  *id,
+               const gchar  *data,
+               gsize         length,
+               const gchar  *source,
+               gsize         source_length,
+               gint64        source_mtime)
+{
+  CssBlobReader reader;
+  const CssBlobHeader *header;
+  GList *selectors = NULL;
+  guint32 i;
+
+  if (length < sizeof (CssBlobHeader))
+    return FALSE;
+
+  header = (const CssBlobHeader *) data;
+  if (memcmp (header->magic, CSS_BLOB_MAGIC, sizeof (header->magic)) ||
+      header->version != CSS_BLOB_VERSION ||
+      header->byte_order != G_BYTE_ORDER)
+    return FALSE;
+
+  if (header->source_size != source_length)
+    return FALSE;
+
+  if (source)
+    {
+      if (header->source_hash != css_blob_hash (source, source_length))
+        return FALSE;
+    }
+  else if (header->source_mtime != source_mtime)
+    return FALSE;
+
+  reader.header = header;
+  reader.roots = (const guint32 *) (header + 1);
+  reader.selectors = (const CssBlobSelector *) (reader.roots + header->n_roots);
+  reader.blocks = (const CssBlobBlock *) (reader.selectors + header->n_selectors);
+  reader.declarations =
+    (const CssBlobDeclaration *) (reader.blocks + header->n_blocks);
+  reader.strings = (const gchar *) (reader.declarations + header->n_declarations);
+
+  if (!css_blob_validate (&reader, length))
+    {
+      g_warning ("Compiled style sheet for '%s' is corrupt", id);
+      return FALSE;
+    }
+
+  reader.input_name = g_strdup (id);
+  reader.priority = g_list_length (sheet->filenames);
+  reader.styles = g_new0 (GHashTable *, header->n_blocks);
+
+  for (i = 0; i < header->n_roots; i++)
+    {
+      MxSelector *selector = css_blob_load_selector (&reader, reader.roots[i]);
+
+      selectors = g_list_prepend (selectors, selector);
+    }
+
+  for (i = 0; i < header->n_blocks; i++)
+    if (reader.styles[i])
+      g_hash_table_unref (reader.styles[i]);
+  g_free (reader.styles);
+
+  sheet->selectors = g_list_concat (sheet->selectors,
+                                    g_list_reverse (selectors));
+  sheet->filenames = g_list_prepend (sheet->filenames, reader.input_name);
+  sheet->index_valid = FALSE;
+
+  MX_NOTE (CSS, "Loaded %d selectors from compiled style sheet '%s'",
+           header->n_roots, id);
+
+  return TRUE;
+}
+
+/* Loads the compiled form of the CSS file @filename, which is expected to
+ * be @filename with ".compiled" appended. Returns %FALSE if there is none,
+ * or if it is out of date, in which case @filename should be parsed. */
+gboolean
+mx_style_sheet_add_from_compiled_file (MxStyleSheet *sheet,
+                                       const gchar  *filename)
+{
+  GMappedFile *mapped_file;
+  GStatBuf source_info;
+  gchar *compiled;
+  gboolean result;
+
+  g_return_val_if_fail (sheet != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  if (g_stat (filename, &source_info) != 0)
+    return FALSE;
+
+  compiled = g_strconcat (filename, ".compiled", NULL);
+  mapped_file = g_mapped_file_new (compiled, FALSE, NULL);
+  g_free (compiled);
+
+  if (!mapped_file)
+    return FALSE;
+
+  result = css_blob_load (sheet, filename,
+                          g_mapped_file_get_contents (mapped_file),
+                          g_mapped_file_get_length (mapped_file),
+                          NULL, source_info.st_size, source_info.st_mtime);
+
+  g_mapped_file_unref (mapped_file);
+
+  if (!result)
+    MX_NOTE (CSS, "Compiled style sheet for '%s' is out of date", filename);
+
+  return result;
+}
+
+/* Loads a compiled style sheet from memory, e.g. from a #GResource, as
+ * long as it was compiled from @source */
+gboolean
+mx_style_sheet_add_from_compiled_data (MxStyleSheet *sheet,
+                                       const gchar  *id,
+                                       const gchar  *data,
+                                       gsize         length,
+                                       const gchar  *source,
+                                       gsize         source_length)
+{
+  g_return_val_if_fail (sheet != NULL, FALSE);
+  g_return_val_if_fail (id != NULL, FALSE);
+  g_return_val_if_fail (data != NULL, FALSE);
+  g_return_val_if_fail (source != NULL, FALSE);
+
+  return css_blob_load (sheet, id, data, length, source, source_length, 0);
+}
+
+/* Moves the selectors of @other, which is destroyed, to @sheet. The style
+ * sheets of @other are given priorities as if they had been loaded into
+ * @sheet directly, in the order they were loaded into @other. */
+void
+mx_style_sheet_merge (MxStyleSheet *sheet,
+                      MxStyleSheet *other)
+{
+  GList *f, *l;
+
+  g_return_if_fail (sheet != NULL);
+  g_return_if_fail (other != NULL);
+
+  /* the file names are prepended, so the first one loaded is last */
+  for (f = g_list_last (other->filenames); f; f = f->prev)
+    {
+      gint priority = g_list_length (sheet->filenames);
+
+      for (l = other->selectors; l; l = l->next)
+        {
+          MxSelector *selector = l->data;
+
+          if (selector->filename == f->data)
+            selector->priority = priority;
+        }
+
+      sheet->filenames = g_list_prepend (sheet->filenames, f->data);
+    }
+
+  sheet->selectors = g_list_concat (sheet->selectors, other->selectors);
+  sheet->index_valid = FALSE;
+
+  g_list_free (other->filenames);
+  css_sheet_clear_index (other);
+  g_free (other);
+}
+
 void
 mx_style_sheet_remove (MxStyleSheet *sheet,
                        const gchar  *id)
@@ -1032,4 +2130,6 @@ mx_style_sheet_remove (MxStyleSheet *sheet,
           mx_selector_free (selector);
         }
     }
+
+  sheet->index_valid = FALSE;
 }
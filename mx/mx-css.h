@@ -23,15 +23,40 @@
 #define MX_CSS_H
 
 #include <glib.h>
+#include <glib-object.h>
 #include "mx-stylable.h"
 
 typedef struct _MxStyleSheetValue MxStyleSheetValue;
+typedef struct _MxStyleSheetParsedValue MxStyleSheetParsedValue;
 typedef struct _MxStyleSheet MxStyleSheet;
 
 struct _MxStyleSheetValue
 {
   const gchar *string;
   const gchar *source;
+
+  /*< private >*/
+  gint                     ref_count;
+
+  /* The parsed forms of string, cached by MxStyle for each type of
+   * property it has been requested as.
+   *
+   * Values are shared between style sheets, which may be parsed on other
+   * threads, so string and source never change once the value is created,
+   * and parsed forms are immutable once they are added: each one is filled
+   * in before it is published by an atomic prepend to the list, and they
+   * are only freed with the last reference. Use
+   * mx_style_sheet_value_get_parsed() and mx_style_sheet_value_add_parsed()
+   * rather than the list itself.
+   */
+  MxStyleSheetParsedValue *parsed;
+};
+
+struct _MxStyleSheetParsedValue
+{
+  MxStyleSheetParsedValue *next;
+  GType                    type;
+  GValue                   value;
 };
 
 MxStyleSheet*  mx_style_sheet_new            ();
@@ -47,5 +72,37 @@ GHashTable*    mx_style_sheet_get_properties (MxStyleSheet *sheet,
                                               MxStylable   *node);
 void           mx_style_sheet_remove         (MxStyleSheet *sheet,
                                               const gchar  *id);
+void           mx_style_sheet_merge          (MxStyleSheet *sheet,
+                                              MxStyleSheet *other);
+
+gchar*         mx_style_sheet_compile        (MxStyleSheet *sheet,
+                                              const gchar  *id,
+                                              const gchar  *source,
+                                              gsize         source_length,
+                                              gint64        source_mtime,
+                                              gsize        *length);
+gboolean       mx_style_sheet_add_from_compiled_file (MxStyleSheet *sheet,
+                                                      const gchar  *filename);
+gboolean       mx_style_sheet_add_from_compiled_data (MxStyleSheet *sheet,
+                                                      const gchar  *id,
+                                                      const gchar  *data,
+                                                      gsize         length,
+                                                      const gchar  *source,
+                                                      gsize         source_length);
+
+gboolean       mx_style_sheet_descendants_depend_on (MxStyleSheet *sheet,
+                                                     MxStylable   *node,
+                                                     const gchar  *old_id,
+                                                     const gchar  *old_class,
+                                                     const gchar  *old_pseudo_class);
+
+MxStyleSheetValue *mx_style_sheet_value_ref   (MxStyleSheetValue *value);
+void               mx_style_sheet_value_unref (MxStyleSheetValue *value);
+
+const GValue *mx_style_sheet_value_get_parsed (MxStyleSheetValue *value,
+                                               GType              type);
+const GValue *mx_style_sheet_value_add_parsed (MxStyleSheetValue *value,
+                                               GType              type,
+                                               GValue            *parsed);
 
 #endif /* MX_CSS_H */
@@ -0,0 +1,422 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-image-thumbnail-cache.c: on-disk cache of scaled images
+ *
+ * Copyright 2026 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "mx-image-thumbnail-cache.h"
+#include "mx-private.h"
+
+/* Each thumbnail is a file named after a checksum of its key, holding this
+ * header followed by the rows of pixels, without padding. It's written by
+ * the machine that reads it, so it's in the native byte order. */
+
+#define THUMBNAIL_MAGIC     "MXTHUMB\0"
+#define THUMBNAIL_VERSION   1
+#define THUMBNAIL_SUFFIX    ".thumb"
+
+#define DEFAULT_MAX_BYTES   (64 * 1024 * 1024)
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 has_alpha;
+  guint32 reserved;
+} MxImageThumbnailHeader;
+
+typedef struct
+{
+  gchar  *path;
+  time_t  mtime;
+  goffset size;
+} MxImageThumbnailFile;
+
+/* All the state is protected by the lock, as thumbnails are stored from the
+ * image loading threads. The lock is never held while doing I/O. cache_bytes
+ * is -1 until the directory has been scanned. */
+static GMutex   thumbnail_lock;
+static gchar   *cache_directory = NULL;
+static guint64  cache_max_bytes = DEFAULT_MAX_BYTES;
+static gint64   cache_bytes = -1;
+static gboolean cache_trimming = FALSE;
+
+/* Gets a copy of the cache directory, or NULL if there's no cache */
+static gchar *
+mx_image_thumbnail_cache_dup_directory (void)
+{
+  gchar *directory;
+
+  g_mutex_lock (&thumbnail_lock);
+  directory = g_strdup (cache_directory);
+  g_mutex_unlock (&thumbnail_lock);
+
+  return directory;
+}
+
+void
+_mx_image_thumbnail_cache_set_directory (const gchar *directory)
+{
+  g_mutex_lock (&thumbnail_lock);
+
+  g_free (cache_directory);
+  cache_directory = g_strdup (directory);
+  cache_bytes = -1;
+
+  g_mutex_unlock (&thumbnail_lock);
+}
+
+gchar *
+_mx_image_thumbnail_cache_get_directory (void)
+{
+  return mx_image_thumbnail_cache_dup_directory ();
+}
+
+void
+_mx_image_thumbnail_cache_set_max_bytes (guint64 max_bytes)
+{
+  g_mutex_lock (&thumbnail_lock);
+  cache_max_bytes = max_bytes;
+  g_mutex_unlock (&thumbnail_lock);
+}
+
+guint64
+_mx_image_thumbnail_cache_get_max_bytes (void)
+{
+  guint64 max_bytes;
+
+  g_mutex_lock (&thumbnail_lock);
+  max_bytes = cache_max_bytes;
+  g_mutex_unlock (&thumbnail_lock);
+
+  return max_bytes;
+}
+
+/* Gets the path of the thumbnail of a file in the cache directory, or NULL
+ * if the file can't be read */
+static gchar *
+mx_image_thumbnail_path (const gchar *directory,
+                         const gchar *filename,
+                         const gchar *variant)
+{
+  GStatBuf stat_buf;
+  gchar *key, *checksum, *name, *path;
+
+  if (g_stat (filename, &stat_buf) != 0)
+    return NULL;
+
+  key = g_strdup_printf ("%s\n%" G_GINT64_FORMAT "\n%" G_GINT64_FORMAT "\n%s",
+                         filename, (gint64) stat_buf.st_mtime,
+                         (gint64) stat_buf.st_size, variant);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+  name = g_strconcat (checksum, THUMBNAIL_SUFFIX, NULL);
+  path = g_build_filename (directory, name, NULL);
+
+  g_free (name);
+  g_free (checksum);
+  g_free (key);
+
+  return path;
+}
+
+GMappedFile *
+_mx_image_thumbnail_cache_lookup (const gchar   *filename,
+                                  const gchar   *variant,
+                                  const guchar **pixels,
+                                  gint          *width,
+                                  gint          *height,
+                                  gint          *rowstride,
+                                  gboolean      *has_alpha)
+{
+  const MxImageThumbnailHeader *header;
+  GMappedFile *mapped_file;
+  gchar *directory, *path;
+  gsize length;
+
+  directory = mx_image_thumbnail_cache_dup_directory ();
+  if (!directory)
+    return NULL;
+
+  path = mx_image_thumbnail_path (directory, filename, variant);
+  g_free (directory);
+
+  if (!path)
+    return NULL;
+
+  mapped_file = g_mapped_file_new (path, FALSE, NULL);
+  if (!mapped_file)
+    {
+      g_free (path);
+      return NULL;
+    }
+
+  header = (const MxImageThumbnailHeader *)
+    g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+
+  if (length < sizeof (MxImageThumbnailHeader) ||
+      memcmp (header->magic, THUMBNAIL_MAGIC, sizeof (header->magic)) ||
+      header->version != THUMBNAIL_VERSION ||
+      header->width == 0 || header->height == 0 ||
+      header->rowstride < header->width * (header->has_alpha ? 4 : 3) ||
+      (length - sizeof (MxImageThumbnailHeader)) / header->rowstride <
+      header->height)
+    {
+      MX_NOTE (TEXTURE_CACHE, "Removing invalid thumbnail '%s'", path);
+
+      g_mapped_file_unref (mapped_file);
+      g_unlink (path);
+      g_free (path);
+
+      return NULL;
+    }
+
+  /* Mark the thumbnail as recently used, so it's the last to be evicted */
+  g_utime (path, NULL);
+  g_free (path);
+
+  *pixels = (const guchar *) (header + 1);
+  *width = header->width;
+  *height = header->height;
+  *rowstride = header->rowstride;
+  *has_alpha = header->has_alpha;
+
+  return mapped_file;
+}
+
+static gint
+mx_image_thumbnail_file_compare (gconstpointer a,
+                                 gconstpointer b)
+{
+  const MxImageThumbnailFile *file_a = a;
+  const MxImageThumbnailFile *file_b = b;
+
+  if (file_a->mtime != file_b->mtime)
+    return (file_a->mtime < file_b->mtime) ? -1 : 1;
+
+  return 0;
+}
+
+/* Counts the size of the cache and, if it's over its limit, removes the
+ * least recently used thumbnails until it's down to three quarters of the
+ * limit, so that it isn't trimmed again at every store */
+static void
+mx_image_thumbnail_cache_trim (const gchar *directory,
+                               guint64      max_bytes)
+{
+  GArray *files;
+  const gchar *name;
+  guint64 bytes;
+  guint i;
+  GDir *dir;
+
+  dir = g_dir_open (directory, 0, NULL);
+  if (!dir)
+    return;
+
+  files = g_array_new (FALSE, FALSE, sizeof (MxImageThumbnailFile));
+  bytes = 0;
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      MxImageThumbnailFile file;
+      GStatBuf stat_buf;
+
+      if (!g_str_has_suffix (name, THUMBNAIL_SUFFIX))
+        continue;
+
+      file.path = g_build_filename (directory, name, NULL);
+      if (g_stat (file.path, &stat_buf) != 0)
+        {
+          g_free (file.path);
+          continue;
+        }
+
+      file.mtime = stat_buf.st_mtime;
+      file.size = stat_buf.st_size;
+      bytes += file.size;
+
+      g_array_append_val (files, file);
+    }
+  g_dir_close (dir);
+
+  if (max_bytes && bytes > max_bytes)
+    {
+      guint64 limit = max_bytes / 4 * 3;
+
+      g_array_sort (files, mx_image_thumbnail_file_compare);
+
+      for (i = 0; i < files->len && bytes > limit; i++)
+        {
+          MxImageThumbnailFile *file =
+            &g_array_index (files, MxImageThumbnailFile, i);
+
+          MX_NOTE (TEXTURE_CACHE, "Evicting thumbnail '%s'", file->path);
+
+          if (g_unlink (file->path) == 0)
+            bytes -= file->size;
+        }
+    }
+
+  for (i = 0; i < files->len; i++)
+    g_free (g_array_index (files, MxImageThumbnailFile, i).path);
+  g_array_free (files, TRUE);
+
+  /* Only keep the count if the cache wasn't moved in the meantime */
+  g_mutex_lock (&thumbnail_lock);
+  if (!g_strcmp0 (directory, cache_directory))
+    cache_bytes = bytes;
+  g_mutex_unlock (&thumbnail_lock);
+}
+
+void
+_mx_image_thumbnail_cache_store (const gchar *filename,
+                                 const gchar *variant,
+                                 GdkPixbuf   *pixbuf)
+{
+  MxImageThumbnailHeader header;
+  gchar *directory, *path, *tmp_path;
+  const guchar *pixels;
+  gboolean success, trim;
+  GStatBuf old_stat;
+  gint64 old_size = 0;
+  guint64 max_bytes;
+  guint row_size, row;
+  FILE *file;
+  gint fd;
+
+  if (gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+      gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+      gdk_pixbuf_get_n_channels (pixbuf) !=
+      (gdk_pixbuf_get_has_alpha (pixbuf) ? 4 : 3))
+    return;
+
+  directory = mx_image_thumbnail_cache_dup_directory ();
+  if (!directory)
+    return;
+
+  path = mx_image_thumbnail_path (directory, filename, variant);
+  if (!path)
+    {
+      g_free (directory);
+      return;
+    }
+
+  if (g_mkdir_with_parents (directory, 0700) != 0)
+    {
+      g_warning ("Could not create thumbnail cache directory '%s': %s",
+                 directory, g_strerror (errno));
+      g_free (directory);
+      g_free (path);
+      return;
+    }
+
+  /* Write the thumbnail to a temporary file and move it into place, so that
+   * nothing ever maps a partly written one */
+  tmp_path = g_strconcat (path, ".XXXXXX", NULL);
+  fd = g_mkstemp (tmp_path);
+  file = (fd != -1) ? fdopen (fd, "wb") : NULL;
+  if (!file)
+    {
+      if (fd != -1)
+        {
+          close (fd);
+          g_unlink (tmp_path);
+        }
+      g_free (directory);
+      g_free (tmp_path);
+      g_free (path);
+      return;
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, THUMBNAIL_MAGIC, sizeof (header.magic));
+  header.version = THUMBNAIL_VERSION;
+  header.width = gdk_pixbuf_get_width (pixbuf);
+  header.height = gdk_pixbuf_get_height (pixbuf);
+  header.has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+  header.rowstride = row_size = header.width * (header.has_alpha ? 4 : 3);
+
+  success = (fwrite (&header, sizeof (header), 1, file) == 1);
+
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  for (row = 0; success && row < header.height; row++)
+    {
+      success = (fwrite (pixels, row_size, 1, file) == 1);
+      pixels += gdk_pixbuf_get_rowstride (pixbuf);
+    }
+
+  if (fclose (file) != 0)
+    success = FALSE;
+
+  /* Another thread or process may have stored the same thumbnail, which is
+   * replaced, so only the difference in size is added to the cache */
+  if (g_stat (path, &old_stat) == 0)
+    old_size = old_stat.st_size;
+
+  if (!success || g_rename (tmp_path, path) != 0)
+    {
+      g_unlink (tmp_path);
+      g_free (directory);
+      g_free (tmp_path);
+      g_free (path);
+      return;
+    }
+
+  MX_NOTE (TEXTURE_CACHE, "Stored thumbnail of '%s' (%s) in '%s'",
+           filename, variant, path);
+
+  /* Account for the new thumbnail, and trim the cache if it's too big or
+   * its size isn't known yet. Only one thread trims at a time. */
+  g_mutex_lock (&thumbnail_lock);
+
+  if (cache_bytes >= 0)
+    cache_bytes = MAX (0, cache_bytes - old_size + (gint64) sizeof (header) +
+                       (gint64) row_size * header.height);
+
+  max_bytes = cache_max_bytes;
+  trim = !cache_trimming &&
+    (cache_bytes < 0 || (max_bytes && (guint64) cache_bytes > max_bytes));
+  if (trim)
+    cache_trimming = TRUE;
+
+  g_mutex_unlock (&thumbnail_lock);
+
+  if (trim)
+    {
+      mx_image_thumbnail_cache_trim (directory, max_bytes);
+
+      g_mutex_lock (&thumbnail_lock);
+      cache_trimming = FALSE;
+      g_mutex_unlock (&thumbnail_lock);
+    }
+
+  g_free (directory);
+  g_free (tmp_path);
+  g_free (path);
+}
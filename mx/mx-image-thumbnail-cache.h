@@ -0,0 +1,55 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-image-thumbnail-cache.h: on-disk cache of scaled images
+ *
+ * Copyright 2026 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __MX_IMAGE_THUMBNAIL_CACHE_H__
+#define __MX_IMAGE_THUMBNAIL_CACHE_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* The thumbnail cache keeps the decoded pixels of images that MxImage loaded
+ * at a particular size, so that they can be loaded again without decoding
+ * the file. Thumbnails are keyed on the path, modification time and size of
+ * the file, and on a variant string describing how it was scaled. */
+
+void         _mx_image_thumbnail_cache_set_directory (const gchar *directory);
+gchar       *_mx_image_thumbnail_cache_get_directory (void);
+
+void         _mx_image_thumbnail_cache_set_max_bytes (guint64 max_bytes);
+guint64      _mx_image_thumbnail_cache_get_max_bytes (void);
+
+GMappedFile *_mx_image_thumbnail_cache_lookup (const gchar   *filename,
+                                               const gchar   *variant,
+                                               const guchar **pixels,
+                                               gint          *width,
+                                               gint          *height,
+                                               gint          *rowstride,
+                                               gboolean      *has_alpha);
+
+void         _mx_image_thumbnail_cache_store  (const gchar   *filename,
+                                               const gchar   *variant,
+                                               GdkPixbuf     *pixbuf);
+
+G_END_DECLS
+
+#endif /* __MX_IMAGE_THUMBNAIL_CACHE_H__ */
@@ -28,13 +28,13 @@
  * Since: 1.2
  */
 
-#include <unistd.h>
 #include <cogl/cogl.h>
 
 #include "mx-image.h"
 #include "mx-enum-types.h"
 #include "mx-marshal.h"
 #include "mx-texture-cache.h"
+#include "mx-image-thumbnail-cache.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
@@ -45,18 +45,31 @@ G_DEFINE_TYPE (MxImage, mx_image, MX_TYPE_WIDGET)
 
 #define DEFAULT_DURATION 250
 
+/* Progressive loads feed the decoder this many bytes at a time, and upload
+ * the rows decoded so far at most once a frame */
+#define PROGRESSIVE_CHUNK_SIZE (64 * 1024)
+#define PROGRESSIVE_INTERVAL   (1000 / 60)
+
 /* This stucture holds all that is necessary for cancellable async
  * image loading using thread pools.
  *
  * The idea is that you create this structure (with the pixbuf as NULL)
- * and add it to the thread-pool.
+ * and add it to the load queue. Each job on the thread-pool takes the most
+ * important load off the queue. A load that is cancelled before a thread
+ * takes it is dropped from the queue and freed straight away.
  *
  * The 'complete' member of the struct is protected by the mutex.
  * The thread handler uses this to indicate that the load was completed.
  *
- * The thread will take the mutex while it's loading data - if cancelled
- * is set when it takes the mutex, it will add the idle handler and let the
- * main thread free the data.
+ * The thread will take the mutex while it's loading data, and add the idle
+ * handler once it's done.
+ *
+ * Progressive loads also show the image while it's being decoded. As rows
+ * are decoded, the thread copies them into the partial pixbuf and records
+ * which rows changed, and a timeout on the main thread uploads them to the
+ * texture once a frame. The progress mutex is only held while the rows are
+ * copied or uploaded, never while decoding, so the main thread doesn't wait
+ * for the decoder.
  *
  * The idle handler will check that the cancelled member isn't set and if not,
  * will try to upload the image using mx_image_set_from_pixbuf(). It will free
@@ -73,6 +86,15 @@ typedef struct
   guint           upscale   : 1;
   guint           idle_handler;
 
+  /* The state of progressive loads, protected by progress_mutex */
+  GMutex          progress_mutex;
+  gboolean        progressive;
+  GdkPixbuf      *partial;
+  gint            dirty_y1;
+  gint            dirty_y2;
+  guint           progress_source;
+  CoglHandle      texture;
+
   gchar          *filename;
   guchar         *buffer;
   gsize           count;
@@ -85,6 +107,24 @@ typedef struct
 
   GdkPixbuf      *pixbuf;
   GError         *error;
+
+  /* What the decoded image is cached as in the texture cache, and the key
+   * of the load in mx_image_pending if other loads are waiting for it */
+  gpointer        cache_ident;
+  gchar          *pending_key;
+
+  /* Loads of the same file at the same size that are waiting for this
+   * one rather than decoding the file again. They aren't queued, and they
+   * are freed along with the load they wait for, their leader. */
+  GList          *waiters;
+  gpointer        leader;
+
+  /* The position of the load in mx_image_queue while it waits for a
+   * thread, and what it's sorted by. Protected by mx_image_queue_lock. */
+  GSequenceIter  *queue_iter;
+  gint            priority;
+  gboolean        mapped;
+  guint           serial;
 } MxImageAsyncData;
 
 struct _MxImagePrivate
@@ -93,6 +133,8 @@ struct _MxImagePrivate
   MxImageScaleMode previous_mode;
   guint            load_async : 1;
   guint            upscale    : 1;
+  guint            progressive : 1;
+  gint             load_priority;
   guint            width_threshold;
   guint            height_threshold;
 
@@ -121,6 +163,8 @@ enum
 
   PROP_SCALE_MODE,
   PROP_LOAD_ASYNC,
+  PROP_LOAD_PRIORITY,
+  PROP_PROGRESSIVE,
   PROP_ALLOW_UPSCALE,
   PROP_SCALE_WIDTH_THRESHOLD,
   PROP_SCALE_HEIGHT_THRESHOLD,
@@ -142,19 +186,35 @@ enum
 static guint signals[LAST_SIGNAL] = { 0, };
 
 static GThreadPool *mx_image_threads = NULL;
+static guint mx_image_max_threads = 0;
 static GQuark mx_image_cache_quark = 0;
 
+/* the asynchronous loads waiting for a thread, most important first, and
+ * statistics about them */
+static GMutex mx_image_queue_lock;
+static GSequence *mx_image_queue = NULL;
+static guint mx_image_queue_serial = 0;
+static guint mx_image_n_running = 0;
+static guint mx_image_max_queued = 0;
+static guint mx_image_n_dropped = 0;
+
+/* the asynchronous loads of files in progress, by file name and cache
+ * identifier */
+static GHashTable *mx_image_pending = NULL;
+
 static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
-                                 gboolean          use_cache,
+                                 gpointer          cache_ident,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
                                  gint              height,
                                  gint              rowstride,
                                  GError          **error);
 
+static void mx_image_cancel_in_progress (MxImage *image);
+
 GQuark
 mx_image_error_quark (void)
 {
@@ -168,10 +228,20 @@ mx_image_async_data_free (MxImageAsyncData *data)
     data->free_func (data->buffer);
 
   g_free (data->filename);
+  g_free (data->pending_key);
 
   if (data->idle_handler)
     g_source_remove (data->idle_handler);
 
+  if (data->progress_source)
+    g_source_remove (data->progress_source);
+
+  if (data->partial)
+    g_object_unref (data->partial);
+
+  if (data->texture)
+    cogl_object_unref (data->texture);
+
   if (data->pixbuf)
     g_object_unref (data->pixbuf);
 
@@ -188,6 +258,8 @@ mx_image_async_data_new (MxImage *parent)
 
   data->parent = parent;
   g_mutex_init (&data->mutex);
+  g_mutex_init (&data->progress_mutex);
+  data->progressive = parent->priv->progressive;
   data->width = -1;
   data->height = -1;
   data->upscale = parent->priv->upscale;
@@ -197,6 +269,174 @@ mx_image_async_data_new (MxImage *parent)
   return data;
 }
 
+/* Stops other loads waiting for @data */
+static void
+mx_image_async_data_unregister (MxImageAsyncData *data)
+{
+  if (data->pending_key &&
+      g_hash_table_lookup (mx_image_pending, data->pending_key) == data)
+    g_hash_table_remove (mx_image_pending, data->pending_key);
+}
+
+static gint
+mx_image_async_data_compare (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+  const MxImageAsyncData *data_a = a;
+  const MxImageAsyncData *data_b = b;
+
+  if (data_a->priority != data_b->priority)
+    return (data_a->priority < data_b->priority) ? -1 : 1;
+
+  /* Images that are on the stage come first */
+  if (data_a->mapped != data_b->mapped)
+    return data_a->mapped ? -1 : 1;
+
+  /* Then the most recent loads, which when scrolling quickly through a lot
+   * of images are the ones most likely to still be on screen */
+  if (data_a->serial != data_b->serial)
+    return (data_a->serial > data_b->serial) ? -1 : 1;
+
+  return 0;
+}
+
+/* Merges the priority of the image of @target into @priority and @mapped,
+ * unless @target was cancelled */
+static gboolean
+mx_image_async_data_get_priority (MxImageAsyncData *target,
+                                  gint             *priority,
+                                  gboolean         *mapped)
+{
+  if (target->cancelled)
+    return FALSE;
+
+  *priority = MIN (*priority, target->parent->priv->load_priority);
+  if (CLUTTER_ACTOR_IS_MAPPED (target->parent))
+    *mapped = TRUE;
+
+  return TRUE;
+}
+
+/*
+ * mx_image_async_data_update_priority:
+ * @data: A load that isn't waiting for another load
+ *
+ * Works out the priority of @data from the images waiting for it to
+ * complete. Must be called with mx_image_queue_lock held.
+ *
+ * Returns: %FALSE if no image wants the result of @data any more
+ */
+static gboolean
+mx_image_async_data_update_priority (MxImageAsyncData *data)
+{
+  gboolean wanted, mapped;
+  gint priority;
+  GList *w;
+
+  mapped = FALSE;
+  priority = G_MAXINT;
+
+  wanted = mx_image_async_data_get_priority (data, &priority, &mapped);
+  for (w = data->waiters; w; w = w->next)
+    wanted |= mx_image_async_data_get_priority (w->data, &priority, &mapped);
+
+  if (wanted &&
+      (data->priority != priority || data->mapped != mapped))
+    {
+      data->priority = priority;
+      data->mapped = mapped;
+
+      if (data->queue_iter)
+        g_sequence_sort_changed (data->queue_iter,
+                                 mx_image_async_data_compare, NULL);
+    }
+
+  return wanted;
+}
+
+/* Adds a load to the queue, and a job to the thread-pool to run it */
+static void
+mx_image_async_data_queue (MxImageAsyncData *data)
+{
+  g_mutex_lock (&mx_image_queue_lock);
+
+  if (!mx_image_queue)
+    mx_image_queue = g_sequence_new (NULL);
+
+  data->serial = mx_image_queue_serial++;
+  mx_image_async_data_update_priority (data);
+  data->queue_iter = g_sequence_insert_sorted (mx_image_queue, data,
+                                               mx_image_async_data_compare,
+                                               NULL);
+
+  mx_image_max_queued = MAX (mx_image_max_queued,
+                             g_sequence_get_length (mx_image_queue));
+
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  /* The job doesn't refer to the load, the thread takes whichever load is
+   * at the head of the queue when it runs */
+  g_thread_pool_push (mx_image_threads, GINT_TO_POINTER (1), NULL);
+}
+
+/* Re-sorts the queued load of @image after its priority changed */
+static void
+mx_image_update_load_priority (MxImage *image)
+{
+  MxImageAsyncData *data = image->priv->async_load_data;
+
+  if (!data)
+    return;
+
+  if (data->leader)
+    data = data->leader;
+
+  g_mutex_lock (&mx_image_queue_lock);
+  if (data->queue_iter)
+    mx_image_async_data_update_priority (data);
+  g_mutex_unlock (&mx_image_queue_lock);
+}
+
+/*
+ * mx_image_async_data_cancel:
+ * @data: A load
+ *
+ * Cancels @data. If it hasn't been started yet, and no other images are
+ * waiting for it, it's dropped from the queue and freed, rather than
+ * leaving a thread to throw it away.
+ */
+static void
+mx_image_async_data_cancel (MxImageAsyncData *data)
+{
+  MxImageAsyncData *leader;
+  GList *w;
+
+  data->cancelled = TRUE;
+  leader = data->leader ? data->leader : data;
+
+  g_mutex_lock (&mx_image_queue_lock);
+  if (!leader->queue_iter || mx_image_async_data_update_priority (leader))
+    {
+      g_mutex_unlock (&mx_image_queue_lock);
+      return;
+    }
+
+  g_sequence_remove (leader->queue_iter);
+  leader->queue_iter = NULL;
+  mx_image_n_dropped++;
+  g_mutex_unlock (&mx_image_queue_lock);
+
+  mx_image_async_data_unregister (leader);
+
+  for (w = leader->waiters; w; w = w->next)
+    mx_image_async_data_free (w->data);
+  g_list_free (leader->waiters);
+  leader->waiters = NULL;
+
+  mx_image_async_data_free (leader);
+}
+
 static void
 get_center_coords (CoglHandle  tex,
                    float       rotation,
@@ -416,6 +656,23 @@ mx_image_get_preferred_height (ClutterActor *actor,
     *pref_height = height + padding.top + padding.bottom;
 }
 
+static void
+mx_image_map (ClutterActor *actor)
+{
+  CLUTTER_ACTOR_CLASS (mx_image_parent_class)->map (actor);
+
+  /* Loads for images on the stage are started first */
+  mx_image_update_load_priority (MX_IMAGE (actor));
+}
+
+static void
+mx_image_unmap (ClutterActor *actor)
+{
+  CLUTTER_ACTOR_CLASS (mx_image_parent_class)->unmap (actor);
+
+  mx_image_update_load_priority (MX_IMAGE (actor));
+}
+
 static void
 mx_image_set_property (GObject      *object,
                        guint         prop_id,
@@ -434,6 +691,14 @@ mx_image_set_property (GObject      *object,
       mx_image_set_load_async (image, g_value_get_boolean (value));
       break;
 
+    case PROP_LOAD_PRIORITY:
+      mx_image_set_load_priority (image, g_value_get_int (value));
+      break;
+
+    case PROP_PROGRESSIVE:
+      mx_image_set_progressive (image, g_value_get_boolean (value));
+      break;
+
     case PROP_ALLOW_UPSCALE:
       mx_image_set_allow_upscale (image, g_value_get_boolean (value));
       break;
@@ -482,6 +747,14 @@ mx_image_get_property (GObject    *object,
       g_value_set_boolean (value, priv->load_async);
       break;
 
+    case PROP_LOAD_PRIORITY:
+      g_value_set_int (value, priv->load_priority);
+      break;
+
+    case PROP_PROGRESSIVE:
+      g_value_set_boolean (value, priv->progressive);
+      break;
+
     case PROP_ALLOW_UPSCALE:
       g_value_set_boolean (value, priv->upscale);
       break;
@@ -566,11 +839,7 @@ mx_image_dispose (GObject *object)
       priv->template_material = NULL;
     }
 
-  if (priv->async_load_data)
-    {
-      priv->async_load_data->cancelled = TRUE;
-      priv->async_load_data = NULL;
-    }
+  mx_image_cancel_in_progress (MX_IMAGE (object));
 
   G_OBJECT_CLASS (mx_image_parent_class)->dispose (object);
 }
@@ -592,6 +861,8 @@ mx_image_class_init (MxImageClass *klass)
   actor_class->paint = mx_image_paint;
   actor_class->get_preferred_width = mx_image_get_preferred_width;
   actor_class->get_preferred_height = mx_image_get_preferred_height;
+  actor_class->map = mx_image_map;
+  actor_class->unmap = mx_image_unmap;
 
   pspec = g_param_spec_enum ("scale-mode",
                              "Scale Mode",
@@ -610,6 +881,40 @@ mx_image_class_init (MxImageClass *klass)
 
   g_object_class_install_property (object_class, PROP_LOAD_ASYNC, pspec);
 
+  /**
+   * MxImage:load-priority:
+   *
+   * The priority of the image's asynchronous loads. Loads with a lower
+   * value are started before loads with a higher value. Among loads with
+   * the same priority, those of mapped images are started first, and then
+   * the most recent ones.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_int ("load-priority",
+                            "Load Priority",
+                            "The priority of asynchronous loads",
+                            G_MININT, G_MAXINT, G_PRIORITY_DEFAULT,
+                            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_property (object_class, PROP_LOAD_PRIORITY, pspec);
+
+  /**
+   * MxImage:progressive:
+   *
+   * Whether asynchronous loads show the image while it's being decoded,
+   * rather than only once it's complete.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("progressive",
+                                "Progressive",
+                                "Whether to show images while they load",
+                                FALSE,
+                                G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_property (object_class, PROP_PROGRESSIVE, pspec);
+
   pspec = g_param_spec_boolean ("allow-upscale",
                                 "Allow Upscale",
                                 "Allow images to be up-scaled",
@@ -783,6 +1088,7 @@ mx_image_init (MxImage *self)
   priv = self->priv = MX_IMAGE_GET_PRIVATE (self);
 
   priv->transition_duration = DEFAULT_DURATION;
+  priv->load_priority = G_PRIORITY_DEFAULT;
   priv->timeline = clutter_timeline_new (priv->transition_duration);
   priv->redraw_timeline = clutter_timeline_new (200);
   clutter_timeline_set_progress_mode (priv->redraw_timeline,
@@ -969,8 +1275,10 @@ mx_image_cancel_in_progress (MxImage *image)
   /* Cancel any asynchronous image load */
   if (priv->async_load_data)
     {
-      priv->async_load_data->cancelled = TRUE;
+      MxImageAsyncData *data = priv->async_load_data;
+
       priv->async_load_data = NULL;
+      mx_image_async_data_cancel (data);
     }
 }
 
@@ -1014,12 +1322,142 @@ mx_image_clear (MxImage *image)
   clutter_actor_queue_relayout (CLUTTER_ACTOR (image));
 }
 
+/*
+ * mx_image_cache_ident:
+ * @image: An #MxImage
+ * @width: The width the image is loaded at, or -1
+ * @height: The height the image is loaded at, or -1
+ *
+ * Gets the identifier that an image file loaded by @image at the given size
+ * is stored under in the texture cache. Everything that affects how the file
+ * is decoded is part of the identifier, so that images with the same settings
+ * can share the texture.
+ *
+ * Returns: an identifier for mx_texture_cache_insert_meta()
+ */
+static gpointer
+mx_image_cache_ident (MxImage *image,
+                      gint     width,
+                      gint     height)
+{
+  MxImagePrivate *priv = image->priv;
+  gchar *name;
+  GQuark quark;
+
+  if (width == -1 && height == -1)
+    return GINT_TO_POINTER (mx_image_cache_quark);
+
+  name = g_strdup_printf ("mx-image-cache-%dx%d-%d-%ux%u", width, height,
+                          priv->upscale ? 1 : 0,
+                          priv->width_threshold, priv->height_threshold);
+  quark = g_quark_from_string (name);
+  g_free (name);
+
+  return GINT_TO_POINTER (quark);
+}
+
+/* Inserts @texture into the texture cache, and returns the texture the
+ * cache hands out for it, which is what the image should use so that the
+ * cache knows the texture is in use and doesn't evict it. Takes over the
+ * reference on @texture. */
+static CoglHandle
+mx_image_cache_insert (MxTextureCache *cache,
+                       const gchar    *uri,
+                       gpointer        cache_ident,
+                       CoglHandle      texture)
+{
+  CoglHandle view;
+
+  mx_texture_cache_insert_meta (cache, uri, cache_ident, texture, NULL);
+
+  view = mx_texture_cache_get_meta_cogl_texture (cache, uri, cache_ident);
+  if (!view)
+    return texture;
+
+  cogl_object_unref (texture);
+
+  return view;
+}
+
+/* Creates a texture holding the image data, with a transparent 1-pixel
+ * border around it */
+static CoglHandle
+mx_image_create_texture (const guchar     *data,
+                         CoglPixelFormat   pixel_format,
+                         gint              width,
+                         gint              height,
+                         gint              rowstride,
+                         GError          **error)
+{
+  CoglHandle texture;
+  gint *blank_area;
+
+  texture = cogl_texture_new_with_size (width + 2, height + 2,
+                                        COGL_TEXTURE_NO_ATLAS,
+                                        COGL_PIXEL_FORMAT_ANY);
+
+  if (!texture)
+    {
+      g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
+                   "Failed to create Cogl texture");
+
+      return NULL;
+    }
+
+  /* Create the new texture */
+  cogl_texture_set_region (texture, 0, 0, 1, 1,
+                           width, height, width, height,
+                           pixel_format, rowstride, data);
+
+  /* Blit a transparent buffer around the texture */
+  blank_area = g_new0 (gint, MAX (width, height) + 2);
+  cogl_texture_set_region (texture, 0, 0, 0, 0,
+                           width, 1, width, 1,
+                           COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
+                           (const guint8 *)blank_area);
+  cogl_texture_set_region (texture, 0, 0, 0, height + 1,
+                           width + 2, 1, width + 2, 1,
+                           COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
+                           (const guint8 *)blank_area);
+  cogl_texture_set_region (texture, 0, 0, 0, 0,
+                           1, height + 2, 1, height + 2,
+                           COGL_PIXEL_FORMAT_RGBA_8888, 4,
+                           (const guint8 *)blank_area);
+  cogl_texture_set_region (texture, 0, 0, width + 1, 0,
+                           1, height + 2, 1, height + 2,
+                           COGL_PIXEL_FORMAT_RGBA_8888, 4,
+                           (const guint8 *)blank_area);
+  g_free (blank_area);
+
+  return texture;
+}
+
+/* Replaces the image with @texture, fading from the previous one */
+static void
+mx_image_set_texture (MxImage    *image,
+                      CoglHandle  texture)
+{
+  MxImagePrivate *priv = image->priv;
+
+  if (priv->old_texture)
+    cogl_object_unref (priv->old_texture);
+
+  priv->old_texture = priv->texture;
+  priv->old_rotation = priv->rotation;
+  priv->old_mode = priv->mode;
+
+  priv->texture = cogl_object_ref (texture);
+
+  mx_image_prepare_texture (image);
+}
+
 /*
  * mx_image_set_from_data_internal:
  * @image: An #MxImage
  * @data: Image data, or %NULL
  * @uri: A local file path / URI, or %NULL
- * @use_cache: Whether the texture cache should be used
+ * @cache_ident: The identifier of the image in the texture cache, or %NULL
+ *   if the texture cache shouldn't be used
  * @pixel_format: The #CoglPixelFormat of the buffer
  * @width: Width in pixels of image data.
  * @height: Height in pixels of image data
@@ -1036,16 +1474,15 @@ static gboolean
 mx_image_set_from_data_internal (MxImage          *image,
                                  const guchar     *data,
                                  const gchar      *uri,
-                                 gboolean          use_cache,
+                                 gpointer          cache_ident,
                                  CoglPixelFormat   pixel_format,
                                  gint              width,
                                  gint              height,
                                  gint              rowstride,
                                  GError          **error)
 {
-  MxImagePrivate *priv;
   MxTextureCache *cache;
-  CoglHandle old_texture;
+  CoglHandle texture;
 
   if (G_UNLIKELY (!MX_IS_IMAGE (image)))
     {
@@ -1055,25 +1492,18 @@ mx_image_set_from_data_internal (MxImage          *image,
       return FALSE;
     }
 
-  priv = image->priv;
-
   mx_image_cancel_in_progress (image);
 
-  /* Store a pointer to the old texture */
-  old_texture = priv->texture;
-
   /* See if the texture's cached, otherwise create it */
   cache = mx_texture_cache_get_default ();
 
-  if (use_cache && uri && !data)
+  if (cache_ident && uri && !data)
     {
-      priv->texture = mx_texture_cache_get_meta_cogl_texture (
-        cache, uri, GINT_TO_POINTER (mx_image_cache_quark));
+      texture = mx_texture_cache_get_meta_cogl_texture (cache, uri,
+                                                        cache_ident);
 
-      if (!priv->texture)
+      if (!texture)
         {
-          priv->texture = old_texture;
-
           g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_INTERNAL,
                        "Image '%s' not found in cache", uri);
           return FALSE;
@@ -1081,67 +1511,85 @@ mx_image_set_from_data_internal (MxImage          *image,
     }
   else
     {
-      gint *blank_area;
+      texture = mx_image_create_texture (data, pixel_format, width, height,
+                                         rowstride, error);
+      if (!texture)
+        return FALSE;
 
-      priv->texture = cogl_texture_new_with_size (width + 2, height + 2,
-                                                  COGL_TEXTURE_NO_ATLAS,
-                                                  COGL_PIXEL_FORMAT_ANY);
+      /* Insert the processed image into the cache, if we have a URI, so
+       * that other images loading the same file at the same size can
+       * share it */
+      if (cache_ident && uri)
+        texture = mx_image_cache_insert (cache, uri, cache_ident, texture);
+    }
 
-      if (!priv->texture)
-        {
-          priv->texture = old_texture;
+  /* Replace the old texture */
+  mx_image_set_texture (image, texture);
+  cogl_object_unref (texture);
 
-          g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
-                       "Failed to create Cogl texture");
+  return TRUE;
+}
 
-          return FALSE;
-        }
+/*
+ * mx_image_set_from_thumbnail:
+ * @image: An #MxImage
+ * @filename: A local file path
+ * @cache_ident: The identifier of the image in the texture cache
+ *
+ * Sets the image from the on-disk thumbnail of a previous load of @filename
+ * at the same size, without decoding the file.
+ *
+ * Returns: %TRUE if there was a thumbnail and the image was updated
+ */
+static gboolean
+mx_image_set_from_thumbnail (MxImage     *image,
+                             const gchar *filename,
+                             gpointer     cache_ident)
+{
+  gint width, height, rowstride;
+  GMappedFile *mapped_file;
+  const guchar *pixels;
+  gboolean has_alpha, retval;
 
-      /* Create the new texture */
-      cogl_texture_set_region (priv->texture, 0, 0, 1, 1,
-                               width, height, width, height,
-                               pixel_format, rowstride, data);
-
-      /* Blit a transparent buffer around the texture */
-      blank_area = g_new0 (gint, MAX (width, height) + 2);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
-                               width, 1, width, 1,
-                               COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, height + 1,
-                               width + 2, 1, width + 2, 1,
-                               COGL_PIXEL_FORMAT_RGBA_8888, (width + 2) * 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, 0, 0,
-                               1, height + 2, 1, height + 2,
-                               COGL_PIXEL_FORMAT_RGBA_8888, 4,
-                               (const guint8 *)blank_area);
-      cogl_texture_set_region (priv->texture, 0, 0, width + 1, 0,
-                               1, height + 2, 1, height + 2,
-                               COGL_PIXEL_FORMAT_RGBA_8888, 4,
-                               (const guint8 *)blank_area);
-      g_free (blank_area);
-
-      /* Insert the processed image into the cache, if we have a URI */
-      if (uri)
-        {
-          mx_texture_cache_insert_meta (cache, uri,
-                                        GINT_TO_POINTER (mx_image_cache_quark),
-                                        priv->texture, NULL);
-        }
-    }
+  /* Only scaled loads have thumbnails */
+  if (cache_ident == GINT_TO_POINTER (mx_image_cache_quark))
+    return FALSE;
 
-  /* Replace the old texture */
-  if (priv->old_texture)
-    cogl_object_unref (priv->old_texture);
+  mapped_file =
+    _mx_image_thumbnail_cache_lookup (filename,
+                                      g_quark_to_string (
+                                        GPOINTER_TO_INT (cache_ident)),
+                                      &pixels, &width, &height, &rowstride,
+                                      &has_alpha);
+  if (!mapped_file)
+    return FALSE;
 
-  priv->old_texture = old_texture;
-  priv->old_rotation = priv->rotation;
-  priv->old_mode = priv->mode;
+  retval =
+    mx_image_set_from_data_internal (image, pixels, filename, cache_ident,
+                                     has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 :
+                                                 COGL_PIXEL_FORMAT_RGB_888,
+                                     width, height, rowstride, NULL);
 
-  mx_image_prepare_texture (image);
+  g_mapped_file_unref (mapped_file);
 
-  return TRUE;
+  return retval;
+}
+
+/* Stores the result of a scaled load of @filename in the thumbnail cache.
+ * This is called from the loading threads. */
+static void
+mx_image_store_thumbnail (const gchar *filename,
+                          gpointer     cache_ident,
+                          GdkPixbuf   *pixbuf)
+{
+  if (!filename || !pixbuf ||
+      cache_ident == GINT_TO_POINTER (mx_image_cache_quark))
+    return;
+
+  _mx_image_thumbnail_cache_store (filename,
+                                   g_quark_to_string (
+                                     GPOINTER_TO_INT (cache_ident)),
+                                   pixbuf);
 }
 
 /**
@@ -1178,7 +1626,7 @@ mx_image_set_from_data (MxImage          *image,
       return FALSE;
     }
 
-  return mx_image_set_from_data_internal (image, data, NULL, FALSE,
+  return mx_image_set_from_data_internal (image, data, NULL, NULL,
                                           pixel_format, width, height,
                                           rowstride, error);
 }
@@ -1188,10 +1636,13 @@ mx_image_set_from_data (MxImage          *image,
  * @image: A #MxImage
  * @pixbuf: A #GdkPixbuf, or %NULL
  * @filename: A path or URI to an image file, or %NULL
+ * @cache_ident: The identifier of the image in the texture cache, or %NULL
  * @error: A pointer to a #GError, or %NULL
  *
  * Sets the MxImage from a #GdkPixbuf, or from the cache if a filename is
- * given, no pixbuf is given and the filename has been previously cached.
+ * given, no pixbuf is given and the filename has been previously cached
+ * under @cache_ident. If a pixbuf and a filename are given, the pixbuf is
+ * added to the cache under @cache_ident.
  *
  * Returns: %TRUE on success, %FALSE otherwise. @error is set on failure
  */
@@ -1199,6 +1650,7 @@ static gboolean
 mx_image_set_from_pixbuf (MxImage      *image,
                           GdkPixbuf    *pixbuf,
                           const gchar  *filename,
+                          gpointer      cache_ident,
                           GError      **error)
 {
   gboolean has_alpha;
@@ -1216,9 +1668,9 @@ mx_image_set_from_pixbuf (MxImage      *image,
   cache = mx_texture_cache_get_default ();
 
   /* Check if we have valid input arguments */
-  if ((!pixbuf && !filename) || (!pixbuf && filename &&
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark))))
+  if ((!pixbuf && (!filename || !cache_ident)) ||
+      (!pixbuf && !mx_texture_cache_contains_meta (cache, filename,
+                                                   cache_ident)))
     {
       if (filename)
         g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_INTERNAL,
@@ -1250,7 +1702,6 @@ mx_image_set_from_pixbuf (MxImage      *image,
         {
           g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_BAD_FORMAT,
                        "Unsupported image formatting");
-          g_object_unref (pixbuf);
           return FALSE;
         }
     }
@@ -1266,88 +1717,227 @@ mx_image_set_from_pixbuf (MxImage      *image,
   return
     mx_image_set_from_data_internal (image,
                                  pixbuf ? gdk_pixbuf_get_pixels (pixbuf) : NULL,
-                                 filename, TRUE,
+                                 filename, cache_ident,
                                  has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 :
                                              COGL_PIXEL_FORMAT_RGB_888,
                                  width, height, rowstride, error);
 }
 
-static gboolean
-mx_image_load_complete_cb (gpointer task_data)
+/*
+ * mx_image_async_data_upload:
+ * @data: A progressive load
+ *
+ * Uploads the rows of the partial image that were decoded since the last
+ * upload, creating the texture the first time. Must be called with the
+ * progress mutex held.
+ */
+static void
+mx_image_async_data_upload (MxImageAsyncData *data)
 {
-  MxImageAsyncData *data = task_data;
+  CoglPixelFormat format;
+  const guchar *pixels;
+  gint width, rowstride;
 
-  /* Lock/unlock mutex to make sure the thread is finished. This is necessary
-   * as it's possible that this idle handler will run before the thread unlocks
-   * the mutex, and freeing a locked mutex results in undefined behaviour
-   * (well, it crashes on Linux with an assert in pthreads...)
-   */
-  g_mutex_lock (&data->mutex);
-  g_mutex_unlock (&data->mutex);
+  if (!data->partial)
+    return;
 
-  /* Reset the idle handler id so we don't try to remove it when we free
-   * the data later on.
-   */
-  data->idle_handler = 0;
+  width = gdk_pixbuf_get_width (data->partial);
+  rowstride = gdk_pixbuf_get_rowstride (data->partial);
+  pixels = gdk_pixbuf_get_pixels (data->partial);
+  format = gdk_pixbuf_get_has_alpha (data->partial) ?
+    COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
 
-  /* Don't do anything with the image data if we've been cancelled already */
-  if (!data->cancelled && data->complete)
+  if (!data->texture)
     {
-      /* Reset the current async image load data pointer */
-      data->parent->priv->async_load_data = NULL;
-
-      /* If we managed to load the pixbuf, set it now, otherwise forward the
-       * error on to the user via a signal.
-       */
-      if (data->pixbuf)
-        {
-          GError *error = NULL;
-          gboolean resized = (data->width != -1 || data->height != -1);
-          gboolean success =
-            mx_image_set_from_pixbuf (data->parent, data->pixbuf,
-                                      resized ? data->filename : NULL, &error);
-
-          if (success)
-            g_signal_emit (data->parent, signals[IMAGE_LOADED], 0);
-          else
-            {
-              g_signal_emit (data->parent, signals[IMAGE_LOAD_ERROR], 0, error);
-              g_error_free (error);
-            }
-        }
-      else
-        g_signal_emit (data->parent, signals[IMAGE_LOAD_ERROR], 0, data->error);
+      data->texture =
+        mx_image_create_texture (pixels, format, width,
+                                 gdk_pixbuf_get_height (data->partial),
+                                 rowstride, NULL);
     }
+  else if (data->dirty_y2 > data->dirty_y1)
+    {
+      gint rows = data->dirty_y2 - data->dirty_y1;
 
-  /* Free the async loading struct */
-  mx_image_async_data_free (data);
+      cogl_texture_set_region (data->texture, 0, 0, 1, data->dirty_y1 + 1,
+                               width, rows, width, rows, format, rowstride,
+                               pixels + data->dirty_y1 * rowstride);
+    }
 
-  return FALSE;
+  data->dirty_y1 = data->dirty_y2 = 0;
 }
 
-typedef struct
+/* Shows the progress of a progressive load, called once a frame */
+static gboolean
+mx_image_progress_cb (gpointer user_data)
 {
-  gint     width;
-  gint     height;
-  guint    width_threshold;
-  guint    height_threshold;
-  gboolean upscale;
-  gboolean scaled;
-} MxImageSizeRequest;
+  MxImageAsyncData *data = user_data;
+  MxImagePrivate *priv;
 
-static void
-mx_image_size_prepared_cb (GdkPixbufLoader *loader,
-                           gint             width,
-                           gint             height,
-                           gpointer         user_data)
-{
-  gboolean fit_width;
-  MxImageSizeRequest *constraints = user_data;
+  g_mutex_lock (&data->progress_mutex);
 
-  if (constraints->width >= 0)
+  if (!data->cancelled && data->dirty_y2 > data->dirty_y1)
     {
-      if (constraints->height >= 0)
-        {
+      mx_image_async_data_upload (data);
+
+      priv = data->parent->priv;
+      if (data->texture && priv->texture != data->texture)
+        mx_image_set_texture (data->parent, data->texture);
+      else
+        clutter_actor_queue_redraw (CLUTTER_ACTOR (data->parent));
+    }
+
+  g_mutex_unlock (&data->progress_mutex);
+
+  return TRUE;
+}
+
+/*
+ * mx_image_async_data_apply:
+ * @data: A finished asynchronous load
+ * @target: @data, or one of the loads waiting for it
+ * @texture: The texture the image was uploaded to, or %NULL if it hasn't
+ *   been uploaded yet
+ *
+ * Sets the image of @target from the result of @data, unless @target has
+ * been cancelled. The image is only uploaded once, every image after the
+ * first is given the same texture.
+ */
+static void
+mx_image_async_data_apply (MxImageAsyncData *data,
+                           MxImageAsyncData *target,
+                           CoglHandle       *texture)
+{
+  MxImage *image = target->parent;
+  GError *error = NULL;
+
+  /* Don't do anything with the image data if we've been cancelled already */
+  if (target->cancelled || !data->complete)
+    return;
+
+  /* Reset the current async image load data pointer */
+  image->priv->async_load_data = NULL;
+
+  /* If we managed to load the pixbuf, set it now, otherwise forward the
+   * error on to the user via a signal.
+   */
+  if (!data->pixbuf)
+    {
+      g_signal_emit (image, signals[IMAGE_LOAD_ERROR], 0, data->error);
+      return;
+    }
+
+  if (*texture)
+    {
+      /* A progressive load may already be showing the texture, in which
+       * case the cache's texture for it replaces it without a transition */
+      if (data->texture && image->priv->texture == data->texture)
+        {
+          cogl_object_unref (image->priv->texture);
+          image->priv->texture = cogl_object_ref (*texture);
+
+          if (image->priv->material)
+            cogl_material_set_layer (image->priv->material, 0,
+                                     image->priv->texture);
+        }
+      else if (image->priv->texture != *texture)
+        mx_image_set_texture (image, *texture);
+    }
+  else if (mx_image_set_from_pixbuf (image, data->pixbuf, data->filename,
+                                     data->cache_ident, &error))
+    *texture = cogl_object_ref (image->priv->texture);
+  else
+    {
+      g_signal_emit (image, signals[IMAGE_LOAD_ERROR], 0, error);
+      g_error_free (error);
+      return;
+    }
+
+  g_signal_emit (image, signals[IMAGE_LOADED], 0);
+}
+
+static gboolean
+mx_image_load_complete_cb (gpointer task_data)
+{
+  MxImageAsyncData *data = task_data;
+  CoglHandle texture = NULL;
+  GList *waiters, *w;
+
+  /* Lock/unlock mutex to make sure the thread is finished. This is necessary
+   * as it's possible that this idle handler will run before the thread unlocks
+   * the mutex, and freeing a locked mutex results in undefined behaviour
+   * (well, it crashes on Linux with an assert in pthreads...)
+   */
+  g_mutex_lock (&data->mutex);
+  g_mutex_unlock (&data->mutex);
+
+  /* Reset the idle handler id so we don't try to remove it when we free
+   * the data later on.
+   */
+  data->idle_handler = 0;
+
+  /* Nothing else can wait for this load now */
+  mx_image_async_data_unregister (data);
+
+  /* A progressive load has already uploaded most of the image, so finish
+   * that off and use it rather than uploading the image again */
+  if (data->texture && data->pixbuf)
+    {
+      MxTextureCache *cache = mx_texture_cache_get_default ();
+
+      g_mutex_lock (&data->progress_mutex);
+      mx_image_async_data_upload (data);
+      g_mutex_unlock (&data->progress_mutex);
+
+      texture = cogl_object_ref (data->texture);
+
+      if (data->filename && data->cache_ident)
+        texture = mx_image_cache_insert (cache, data->filename,
+                                         data->cache_ident, texture);
+    }
+
+  /* Set the image, then the images waiting for it in the order they asked */
+  mx_image_async_data_apply (data, data, &texture);
+
+  waiters = g_list_reverse (data->waiters);
+  data->waiters = NULL;
+  for (w = waiters; w; w = w->next)
+    {
+      mx_image_async_data_apply (data, w->data, &texture);
+      mx_image_async_data_free (w->data);
+    }
+  g_list_free (waiters);
+
+  if (texture)
+    cogl_object_unref (texture);
+
+  /* Free the async loading struct */
+  mx_image_async_data_free (data);
+
+  return FALSE;
+}
+
+typedef struct
+{
+  gint     width;
+  gint     height;
+  guint    width_threshold;
+  guint    height_threshold;
+  gboolean upscale;
+} MxImageSizeRequest;
+
+static void
+mx_image_size_prepared_cb (GdkPixbufLoader *loader,
+                           gint             width,
+                           gint             height,
+                           gpointer         user_data)
+{
+  gboolean fit_width;
+  MxImageSizeRequest *constraints = user_data;
+
+  if (constraints->width >= 0)
+    {
+      if (constraints->height >= 0)
+        {
           gfloat aspect = constraints->width / (gfloat)constraints->height;
           gfloat aspect_orig = width / (gfloat)height;
 
@@ -1372,7 +1962,6 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
       gdk_pixbuf_loader_set_size (loader, constraints->width,
                                   (constraints->width / (gfloat)width) *
                                   (gfloat)height);
-      constraints->scaled = TRUE;
     }
   else
     {
@@ -1386,10 +1975,133 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
                                   (constraints->height / (gfloat)height) *
                                   (gfloat)width,
                                   constraints->height);
-      constraints->scaled = TRUE;
     }
 }
 
+/* Called from gdk_pixbuf_loader_write() once the size of the image is
+ * known */
+static void
+mx_image_area_prepared_cb (GdkPixbufLoader  *loader,
+                           MxImageAsyncData *data)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+  GdkPixbuf *partial;
+
+  /* The pixbuf isn't initialised, make the parts that haven't been decoded
+   * yet transparent */
+  gdk_pixbuf_fill (pixbuf, 0);
+
+  /* The decoder keeps writing to its pixbuf, so the main thread is shown a
+   * copy of the rows that are finished */
+  partial = gdk_pixbuf_copy (pixbuf);
+
+  g_mutex_lock (&data->progress_mutex);
+  data->partial = partial;
+  g_mutex_unlock (&data->progress_mutex);
+}
+
+/* Called from gdk_pixbuf_loader_write() as parts of the image are
+ * decoded */
+static void
+mx_image_area_updated_cb (GdkPixbufLoader  *loader,
+                          gint              x,
+                          gint              y,
+                          gint              width,
+                          gint              height,
+                          MxImageAsyncData *data)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+
+  g_mutex_lock (&data->progress_mutex);
+
+  /* whole rows are copied, as whole rows are uploaded */
+  gdk_pixbuf_copy_area (pixbuf, 0, y, gdk_pixbuf_get_width (pixbuf), height,
+                        data->partial, 0, y);
+
+  if (data->dirty_y2 > data->dirty_y1)
+    {
+      data->dirty_y1 = MIN (data->dirty_y1, y);
+      data->dirty_y2 = MAX (data->dirty_y2, y + height);
+    }
+  else
+    {
+      data->dirty_y1 = y;
+      data->dirty_y2 = y + height;
+    }
+
+  if (!data->progress_source)
+    data->progress_source =
+      clutter_threads_add_timeout (PROGRESSIVE_INTERVAL,
+                                   mx_image_progress_cb, data);
+
+  g_mutex_unlock (&data->progress_mutex);
+}
+
+/* Feeds data to the loader. For progressive loads it's fed a chunk at a time,
+ * so that rows are shown as they're decoded */
+static gboolean
+mx_image_loader_write (GdkPixbufLoader   *loader,
+                       const guchar      *buffer,
+                       gsize              count,
+                       MxImageAsyncData  *progress,
+                       GError           **error)
+{
+  gboolean success = TRUE;
+
+  if (!progress)
+    return gdk_pixbuf_loader_write (loader, buffer, count, error);
+
+  while (success && count)
+    {
+      gsize chunk = MIN (count, PROGRESSIVE_CHUNK_SIZE);
+
+      success = gdk_pixbuf_loader_write (loader, buffer, chunk, error);
+
+      buffer += chunk;
+      count -= chunk;
+    }
+
+  return success;
+}
+
+/* Feeds a file to the loader as it's read, rather than reading all of it
+ * first, so that progressive loads of slow files start showing sooner */
+static gboolean
+mx_image_loader_write_file (GdkPixbufLoader   *loader,
+                            const gchar       *filename,
+                            MxImageAsyncData  *progress,
+                            GError           **error)
+{
+  GFileInputStream *stream;
+  GFile *file;
+  guchar *chunk;
+  gssize count;
+
+  file = g_file_new_for_path (filename);
+  stream = g_file_read (file, NULL, error);
+  g_object_unref (file);
+
+  if (!stream)
+    return FALSE;
+
+  chunk = g_malloc (PROGRESSIVE_CHUNK_SIZE);
+  while ((count = g_input_stream_read (G_INPUT_STREAM (stream), chunk,
+                                       PROGRESSIVE_CHUNK_SIZE, NULL,
+                                       error)) > 0)
+    {
+      if (!mx_image_loader_write (loader, chunk, count, progress, error))
+        {
+          count = -1;
+          break;
+        }
+    }
+  g_free (chunk);
+
+  g_object_unref (stream);
+
+  return (count == 0);
+}
+
 /*
  * mx_image_pixbuf_new:
  * @filename: A local file path, or %NULL
@@ -1401,6 +2113,7 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
  * @height_threshold: The delta allowed before actually scaling the height
  * @upscale: %TRUE if the image should be allowed to scale upwards,
  *   %FALSE otherwise
+ * @progress: A progressive load to report the decoded rows to, or %NULL
  * @error: A pointer to a #GError
  *
  * Loads and scales a #GdkPixbuf using the given filename or data.
@@ -1408,20 +2121,21 @@ mx_image_size_prepared_cb (GdkPixbufLoader *loader,
  * Returns: A new #GdkPixbuf, or %NULL on failure (@error will be set)
  */
 static GdkPixbuf *
-mx_image_pixbuf_new (const gchar  *filename,
-                     guchar       *buffer,
-                     gsize         count,
-                     gint          width,
-                     gint          height,
-                     guint         width_threshold,
-                     guint         height_threshold,
-                     gboolean      upscale,
-                     gboolean     *scaled,
-                     GError      **error)
+mx_image_pixbuf_new (const gchar       *filename,
+                     guchar            *buffer,
+                     gsize              count,
+                     gint               width,
+                     gint               height,
+                     guint              width_threshold,
+                     guint              height_threshold,
+                     gboolean           upscale,
+                     MxImageAsyncData  *progress,
+                     GError           **error)
 {
   GdkPixbuf *pixbuf;
   GdkPixbufLoader *loader;
   MxImageSizeRequest constraints;
+  gboolean success;
 
   GError *err = NULL;
 
@@ -1437,31 +2151,49 @@ mx_image_pixbuf_new (const gchar  *filename,
                     G_CALLBACK (mx_image_size_prepared_cb),
                     &constraints);
 
-  if (filename)
+  if (progress)
+    {
+      g_signal_connect (loader, "area-prepared",
+                        G_CALLBACK (mx_image_area_prepared_cb), progress);
+      g_signal_connect (loader, "area-updated",
+                        G_CALLBACK (mx_image_area_updated_cb), progress);
+    }
+
+  if (filename && progress)
+    success = mx_image_loader_write_file (loader, filename, progress, &err);
+  else
     {
-      if (!g_file_get_contents (filename, (gchar **)&buffer, &count, &err))
+      if (filename)
+        {
+          if (!g_file_get_contents (filename, (gchar **)&buffer, &count,
+                                    &err))
+            {
+              if (error)
+                g_propagate_error (error, err);
+              gdk_pixbuf_loader_close (loader, NULL);
+              g_object_unref (loader);
+              return NULL;
+            }
+
+          g_object_weak_ref (G_OBJECT (loader), (GWeakNotify)g_free, buffer);
+        }
+
+      if (!buffer)
         {
-          if (error)
-            g_propagate_error (error, err);
           gdk_pixbuf_loader_close (loader, NULL);
           g_object_unref (loader);
           return NULL;
         }
 
-      g_object_weak_ref (G_OBJECT (loader), (GWeakNotify)g_free, buffer);
+      success = mx_image_loader_write (loader, buffer, count, progress, &err);
     }
 
-  if (!buffer)
-    {
-      gdk_pixbuf_loader_close (loader, NULL);
-      g_object_unref (loader);
-      return NULL;
-    }
-
-  if (!gdk_pixbuf_loader_write (loader, buffer, count, &err))
+  if (!success)
     {
       if (error)
         g_propagate_error (error, err);
+      else
+        g_clear_error (&err);
       gdk_pixbuf_loader_close (loader, NULL);
       g_object_unref (loader);
       return NULL;
@@ -1482,9 +2214,6 @@ mx_image_pixbuf_new (const gchar  *filename,
 
   g_object_unref (loader);
 
-  if (scaled)
-    *scaled = constraints.scaled;
-
   return pixbuf;
 }
 
@@ -1492,38 +2221,40 @@ static void
 mx_image_async_cb (gpointer task_data,
                    gpointer user_data)
 {
-  gboolean scaled;
-  MxImageAsyncData *data = task_data;
-
-  g_mutex_lock (&data->mutex);
+  MxImageAsyncData *data;
+  GSequenceIter *iter;
 
-  /* Check if the task has been cancelled and bail out - leave to the main
-   * thread to free the data.
+  /* Take the most important load off the queue. There may not be one, if
+   * loads were dropped from the queue after they were added.
    */
-  if (data->cancelled)
-    {
-      data->idle_handler =
-        clutter_threads_add_idle_full (G_PRIORITY_HIGH_IDLE,
-                                       mx_image_load_complete_cb, data, NULL);
-      g_mutex_unlock (&data->mutex);
+  g_mutex_lock (&mx_image_queue_lock);
 
+  iter = g_sequence_get_begin_iter (mx_image_queue);
+  if (g_sequence_iter_is_end (iter))
+    {
+      g_mutex_unlock (&mx_image_queue_lock);
       return;
     }
 
+  data = g_sequence_get (iter);
+  g_sequence_remove (iter);
+  data->queue_iter = NULL;
+  mx_image_n_running++;
+
+  /* Take the load's mutex before letting go of the queue, so that the main
+   * thread can't free it in the meantime */
+  g_mutex_lock (&data->mutex);
+  g_mutex_unlock (&mx_image_queue_lock);
+
   /* Try to load the pixbuf */
   data->pixbuf = mx_image_pixbuf_new (data->filename, data->buffer,
                                       data->count, data->width, data->height,
                                       data->width_threshold,
                                       data->height_threshold, data->upscale,
-                                      &scaled,
+                                      data->progressive ? data : NULL,
                                       &data->error);
 
-  /* If scaling was unnecessary, we can cache the result */
-  if (!scaled)
-    {
-      data->width = -1;
-      data->height = -1;
-    }
+  mx_image_store_thumbnail (data->filename, data->cache_ident, data->pixbuf);
 
   data->complete = TRUE;
   data->idle_handler =
@@ -1531,6 +2262,16 @@ mx_image_async_cb (gpointer task_data,
                                    mx_image_load_complete_cb, data, NULL);
 
   g_mutex_unlock (&data->mutex);
+
+  g_mutex_lock (&mx_image_queue_lock);
+  mx_image_n_running--;
+  g_mutex_unlock (&mx_image_queue_lock);
+}
+
+static guint
+mx_image_get_n_threads (void)
+{
+  return mx_image_max_threads ? mx_image_max_threads : g_get_num_processors ();
 }
 
 static gboolean
@@ -1545,7 +2286,9 @@ mx_image_set_async (MxImage         *image,
 {
   GError *err;
   MxImagePrivate *priv;
-  MxImageAsyncData *data;
+  MxImageAsyncData *data, *leader;
+  gpointer cache_ident;
+  gchar *pending_key;
 
   if (G_UNLIKELY (!MX_IS_IMAGE (image)))
     {
@@ -1566,18 +2309,12 @@ mx_image_set_async (MxImage         *image,
     }
 
   err = NULL;
-  data = NULL;
 
   /* Load the pixbuf in a thread, then later on upload it to the GPU */
   if (!mx_image_threads)
     {
       mx_image_threads = g_thread_pool_new (mx_image_async_cb, NULL,
-#ifdef _SC_NPROCESSORS_ONLN
-                                            sysconf (_SC_NPROCESSORS_ONLN),
-#else
-                                            /* FIXME: add more OSs */
-                                            1,
-#endif
+                                            mx_image_get_n_threads (),
                                             FALSE, &err);
       if (!mx_image_threads)
         {
@@ -1586,55 +2323,71 @@ mx_image_set_async (MxImage         *image,
         }
     }
 
-  /* Cancel/free any in-progress load */
-  if (priv->async_load_data)
+  if (!mx_image_pending)
+    mx_image_pending = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Look for a load of the same file at the same size that's already in
+   * progress, so the file doesn't get decoded more than once.
+   */
+  leader = NULL;
+  pending_key = NULL;
+  cache_ident = NULL;
+  if (filename)
     {
-      MxImageAsyncData *old_data = priv->async_load_data;
+      cache_ident = mx_image_cache_ident (image, width, height);
+      pending_key = g_strdup_printf ("%p:%s", cache_ident, filename);
+      leader = g_hash_table_lookup (mx_image_pending, pending_key);
+    }
 
-      if (!g_mutex_trylock (&old_data->mutex))
-        {
-          /* The thread is busy, cancel it and start a new one */
-          old_data->cancelled = TRUE;
-        }
-      else
-        {
-          if (old_data->complete)
-            {
-              /* The load finished, cancel the upload */
-              old_data->cancelled = TRUE;
-              g_mutex_unlock (&old_data->mutex);
-            }
-          else
-            {
-              /* The load hasn't begun, we'll hijack it */
-              g_free (old_data->filename);
-              old_data->filename = g_strdup (filename);
-              old_data->buffer = buffer;
-              old_data->count = count;
-              old_data->free_func = free_func;
-              old_data->width = width;
-              old_data->height = height;
-              old_data->cancelled = FALSE;
-              g_mutex_unlock (&old_data->mutex);
-
-              data = old_data;
-            }
-        }
+  if (leader && priv->async_load_data &&
+      (leader == priv->async_load_data ||
+       leader == priv->async_load_data->leader))
+    {
+      /* This image is already loading this file */
+      g_free (pending_key);
+      return TRUE;
     }
 
-  if (!data)
+  /* Cancel any in-progress load. If it hasn't started yet, it's dropped */
+  mx_image_cancel_in_progress (image);
+
+  priv->async_load_data = data = mx_image_async_data_new (image);
+  data->filename = g_strdup (filename);
+  data->width = width;
+  data->height = height;
+  data->cache_ident = cache_ident;
+
+  if (leader)
     {
-      /* Create the async load data and add it to the thread-pool */
-      priv->async_load_data = data = mx_image_async_data_new (image);
-      data->filename = g_strdup (filename);
-      data->buffer = buffer;
-      data->count = count;
-      data->free_func = free_func;
-      data->width = width;
-      data->height = height;
-      g_thread_pool_push (mx_image_threads, data, NULL);
+      /* Wait for the load in progress rather than loading the file again.
+       * Waiting loads are never run, the load they wait for sets their
+       * image and frees them when it completes. */
+      data->leader = leader;
+      leader->waiters = g_list_prepend (leader->waiters, data);
+
+      g_mutex_lock (&mx_image_queue_lock);
+      if (leader->queue_iter)
+        mx_image_async_data_update_priority (leader);
+      g_mutex_unlock (&mx_image_queue_lock);
+
+      g_free (pending_key);
+
+      return TRUE;
     }
 
+  data->buffer = buffer;
+  data->count = count;
+  data->free_func = free_func;
+
+  /* Let other images loading this file at this size wait for this load */
+  if (pending_key)
+    {
+      data->pending_key = pending_key;
+      g_hash_table_replace (mx_image_pending, pending_key, data);
+    }
+
+  mx_image_async_data_queue (data);
+
   return TRUE;
 }
 
@@ -1671,6 +2424,10 @@ mx_image_set_from_file (MxImage      *image,
  * In case of failure, #FALSE is returned and @error is set. The aspect ratio
  * will always be maintained.
  *
+ * The file is only decoded once for all the #MxImage<!-- -->s that load it at
+ * the same size with the same scaling settings, and they share the resulting
+ * texture while it remains in the #MxTextureCache.
+ *
  * Returns: #TRUE if the image was successfully updated
  *
  * Since: 1.2
@@ -1685,7 +2442,9 @@ mx_image_set_from_file_at_size (MxImage      *image,
   GdkPixbuf *pixbuf;
   MxImagePrivate *priv;
   MxTextureCache *cache;
-  gboolean retval, use_cache;
+  CoglHandle texture;
+  gpointer cache_ident;
+  gboolean retval;
 
   if (G_UNLIKELY (!MX_IS_IMAGE (image)))
     {
@@ -1696,61 +2455,69 @@ mx_image_set_from_file_at_size (MxImage      *image,
     }
 
   priv = image->priv;
-  pixbuf = NULL;
 
-  /* Check if the processed image is in the cache - we don't use the cache
-   * if we're loading at a particular size.
+  /* Check if the processed image is in the cache. Images loaded at a
+   * particular size are cached by that size, so that images showing the
+   * same file at the same size share a single texture.
    */
   cache = mx_texture_cache_get_default ();
-  use_cache = TRUE;
+  cache_ident = mx_image_cache_ident (image, width, height);
+
+  if (mx_texture_cache_contains_meta (cache, filename, cache_ident))
+    return mx_image_set_from_pixbuf (image, NULL, filename, cache_ident,
+                                     error);
+
+  /* Then check if it was stored on disk by a previous load */
+  if (mx_image_set_from_thumbnail (image, filename, cache_ident))
+    return TRUE;
 
-  if ((width != -1) || (height != -1) ||
-      !mx_texture_cache_contains_meta (cache, filename,
-                                       GINT_TO_POINTER (mx_image_cache_quark)))
+  /* Check if the unprocessed image is in the cache, and if so, skip
+   * loading it and set it from the Cogl texture handle.
+   */
+  if ((width == -1) && (height == -1) &&
+      mx_texture_cache_contains (cache, filename))
     {
-      /* Check if the unprocessed image is in the cache, and if so, skip
-       * loading it and set it from the Cogl texture handle.
-       */
-      if ((width == -1) && (height == -1) &&
-          mx_texture_cache_contains (cache, filename))
+      /* the cache hands out a view of its texture, which has to be
+       * released for the texture to become unused again */
+      texture = mx_texture_cache_get_cogl_texture (cache, filename);
+      retval = mx_image_set_from_cogl_texture (image, texture);
+      cogl_handle_unref (texture);
+
+      if (retval)
         {
-          if (mx_image_set_from_cogl_texture (image,
-              mx_texture_cache_get_cogl_texture (cache, filename)))
-            {
-              /* Add the processed image to the cache */
-              mx_texture_cache_insert_meta (cache, filename,
-                                        GINT_TO_POINTER (mx_image_cache_quark),
+          /* Add the processed image to the cache */
+          mx_texture_cache_insert_meta (cache, filename, cache_ident,
                                         priv->texture, NULL);
-              return TRUE;
-            }
-          else
-            {
-              g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_INTERNAL,
-                           "Setting image '%s' from CoglTexture failed",
-                           filename);
-              return FALSE;
-            }
+          return TRUE;
+        }
+      else
+        {
+          g_set_error (error, MX_IMAGE_ERROR, MX_IMAGE_ERROR_INTERNAL,
+                       "Setting image '%s' from CoglTexture failed",
+                       filename);
+          return FALSE;
         }
-
-      /* Load the pixbuf in a thread, then later on upload it to the GPU */
-      if (priv->load_async)
-        return mx_image_set_async (image, filename, NULL, 0, NULL,
-                                   width, height, error);
-
-      /* Synchronously load the pixbuf and set it */
-      pixbuf = mx_image_pixbuf_new (filename, NULL, 0, width, height,
-                                    priv->width_threshold,
-                                    priv->height_threshold,
-                                    priv->upscale, &use_cache, error);
-      if (!pixbuf)
-        return FALSE;
     }
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf,
-                                     use_cache ? filename : NULL, error);
+  /* Load the pixbuf in a thread, then later on upload it to the GPU */
+  if (priv->load_async)
+    return mx_image_set_async (image, filename, NULL, 0, NULL,
+                               width, height, error);
 
-  if (pixbuf)
-    g_object_unref (pixbuf);
+  /* Synchronously load the pixbuf at the requested size and set it */
+  pixbuf = mx_image_pixbuf_new (filename, NULL, 0, width, height,
+                                priv->width_threshold,
+                                priv->height_threshold,
+                                priv->upscale, NULL, error);
+  if (!pixbuf)
+    return FALSE;
+
+  mx_image_store_thumbnail (filename, cache_ident, pixbuf);
+
+  retval = mx_image_set_from_pixbuf (image, pixbuf, filename, cache_ident,
+                                     error);
+
+  g_object_unref (pixbuf);
 
   return retval;
 }
@@ -1944,7 +2711,7 @@ mx_image_set_from_buffer_at_size (MxImage         *image,
   if (!pixbuf)
     return FALSE;
 
-  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, error);
+  retval = mx_image_set_from_pixbuf (image, pixbuf, NULL, NULL, error);
 
   g_object_unref (pixbuf);
 
@@ -1984,11 +2751,8 @@ mx_image_set_load_async (MxImage  *image,
       g_object_notify (G_OBJECT (image), "load-async");
 
       /* Cancel the old transfer if we're turning async off */
-      if (!load_async && priv->async_load_data)
-        {
-          priv->async_load_data->cancelled = TRUE;
-          priv->async_load_data = NULL;
-        }
+      if (!load_async)
+        mx_image_cancel_in_progress (image);
     }
 }
 
@@ -2009,6 +2773,238 @@ mx_image_get_load_async (MxImage *image)
   return image->priv->load_async;
 }
 
+/**
+ * mx_image_set_progressive:
+ * @image: A #MxImage
+ * @progressive: %TRUE to show images while they load
+ *
+ * Sets whether asynchronous loads show the image while it's being decoded.
+ * The part of the image that has been decoded so far is shown, and updated
+ * at most once a frame, which makes large or slow images appear sooner.
+ * This only applies to loads started after it is set.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_progressive (MxImage  *image,
+                          gboolean  progressive)
+{
+  MxImagePrivate *priv;
+
+  g_return_if_fail (MX_IS_IMAGE (image));
+
+  priv = image->priv;
+  if (priv->progressive != progressive)
+    {
+      priv->progressive = progressive;
+      g_object_notify (G_OBJECT (image), "progressive");
+    }
+}
+
+/**
+ * mx_image_get_progressive:
+ * @image: A #MxImage
+ *
+ * Determines whether asynchronous loads show the image while it's being
+ * decoded.
+ *
+ * Returns: %TRUE if images are shown while they load, %FALSE otherwise
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_image_get_progressive (MxImage *image)
+{
+  g_return_val_if_fail (MX_IS_IMAGE (image), FALSE);
+  return image->priv->progressive;
+}
+
+/**
+ * mx_image_set_load_priority:
+ * @image: A #MxImage
+ * @priority: The priority of asynchronous loads
+ *
+ * Sets the priority of the asynchronous loads of @image, including a load
+ * that is already waiting to start. Loads with a lower value are started
+ * before loads with a higher value, so %G_PRIORITY_HIGH can be used for
+ * images that should appear first. Among loads with the same priority,
+ * those of mapped images are started first.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_load_priority (MxImage *image,
+                            gint     priority)
+{
+  MxImagePrivate *priv;
+
+  g_return_if_fail (MX_IS_IMAGE (image));
+
+  priv = image->priv;
+  if (priv->load_priority != priority)
+    {
+      priv->load_priority = priority;
+      mx_image_update_load_priority (image);
+      g_object_notify (G_OBJECT (image), "load-priority");
+    }
+}
+
+/**
+ * mx_image_get_load_priority:
+ * @image: A #MxImage
+ *
+ * Retrieves the priority of the asynchronous loads of @image.
+ *
+ * Returns: The load priority
+ *
+ * Since: 2.0
+ */
+gint
+mx_image_get_load_priority (MxImage *image)
+{
+  g_return_val_if_fail (MX_IS_IMAGE (image), G_PRIORITY_DEFAULT);
+  return image->priv->load_priority;
+}
+
+/**
+ * mx_image_set_max_load_threads:
+ * @n_threads: The maximum number of threads, or 0
+ *
+ * Sets the maximum number of images that are decoded at the same time by
+ * asynchronous loads, across all #MxImage<!-- -->s. 0 means one per
+ * processor, which is the default.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_max_load_threads (guint n_threads)
+{
+  mx_image_max_threads = n_threads;
+
+  if (mx_image_threads)
+    g_thread_pool_set_max_threads (mx_image_threads,
+                                   mx_image_get_n_threads (), NULL);
+}
+
+/**
+ * mx_image_get_max_load_threads:
+ *
+ * Retrieves the value set with mx_image_set_max_load_threads().
+ *
+ * Returns: The maximum number of threads, or 0 for one per processor
+ *
+ * Since: 2.0
+ */
+guint
+mx_image_get_max_load_threads (void)
+{
+  return mx_image_max_threads;
+}
+
+/**
+ * mx_image_get_load_statistics:
+ * @n_queued: (out) (allow-none): Return location for the number of loads
+ *   waiting to start, or %NULL
+ * @n_running: (out) (allow-none): Return location for the number of loads
+ *   being decoded, or %NULL
+ * @max_queued: (out) (allow-none): Return location for the largest number
+ *   of loads that have been waiting at the same time, or %NULL
+ * @n_dropped: (out) (allow-none): Return location for the number of loads
+ *   that were cancelled before they started, or %NULL
+ *
+ * Retrieves statistics about the asynchronous loads of all
+ * #MxImage<!-- -->s. This can be used to tune the load priorities and
+ * mx_image_set_max_load_threads().
+ *
+ * Since: 2.0
+ */
+void
+mx_image_get_load_statistics (guint *n_queued,
+                              guint *n_running,
+                              guint *max_queued,
+                              guint *n_dropped)
+{
+  g_mutex_lock (&mx_image_queue_lock);
+
+  if (n_queued)
+    *n_queued = mx_image_queue ? g_sequence_get_length (mx_image_queue) : 0;
+  if (n_running)
+    *n_running = mx_image_n_running;
+  if (max_queued)
+    *max_queued = mx_image_max_queued;
+  if (n_dropped)
+    *n_dropped = mx_image_n_dropped;
+
+  g_mutex_unlock (&mx_image_queue_lock);
+}
+
+/**
+ * mx_image_set_thumbnail_cache_dir:
+ * @directory: (allow-none): The directory to keep thumbnails in, or %NULL
+ *
+ * Sets the directory of the thumbnail cache. When it is set, the pixels of
+ * images loaded at a particular size with mx_image_set_from_file_at_size()
+ * are stored there, and loading the same file at the same size again, even
+ * in another process, maps them rather than decoding the file. Thumbnails
+ * are only used while the file's modification time and size are unchanged.
+ *
+ * The thumbnail cache is disabled by default.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_thumbnail_cache_dir (const gchar *directory)
+{
+  _mx_image_thumbnail_cache_set_directory (directory);
+}
+
+/**
+ * mx_image_get_thumbnail_cache_dir:
+ *
+ * Retrieves the directory set with mx_image_set_thumbnail_cache_dir().
+ *
+ * Returns: (transfer full): A copy of the directory of the thumbnail cache,
+ *   to be freed with g_free(), or %NULL if it's disabled
+ *
+ * Since: 2.0
+ */
+gchar *
+mx_image_get_thumbnail_cache_dir (void)
+{
+  return _mx_image_thumbnail_cache_get_directory ();
+}
+
+/**
+ * mx_image_set_thumbnail_cache_size:
+ * @max_bytes: The maximum size of the thumbnail cache, in bytes, or 0
+ *
+ * Sets the maximum size of the thumbnail cache. When it grows larger, the
+ * least recently used thumbnails are removed. 0 means there is no limit.
+ * The default is 64MiB.
+ *
+ * Since: 2.0
+ */
+void
+mx_image_set_thumbnail_cache_size (guint64 max_bytes)
+{
+  _mx_image_thumbnail_cache_set_max_bytes (max_bytes);
+}
+
+/**
+ * mx_image_get_thumbnail_cache_size:
+ *
+ * Retrieves the maximum size of the thumbnail cache.
+ *
+ * Returns: The maximum size in bytes, or 0 if there is no limit
+ *
+ * Since: 2.0
+ */
+guint64
+mx_image_get_thumbnail_cache_size (void)
+{
+  return _mx_image_thumbnail_cache_get_max_bytes ();
+}
+
 /**
  * mx_image_set_allow_upscale:
  * @image: A #MxImage
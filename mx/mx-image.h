@@ -134,6 +134,27 @@ void     mx_image_set_load_async (MxImage  *image,
                                   gboolean  load_async);
 gboolean mx_image_get_load_async (MxImage  *image);
 
+void     mx_image_set_progressive (MxImage  *image,
+                                   gboolean  progressive);
+gboolean mx_image_get_progressive (MxImage  *image);
+
+void     mx_image_set_load_priority (MxImage *image,
+                                     gint     priority);
+gint     mx_image_get_load_priority (MxImage *image);
+
+void     mx_image_set_max_load_threads (guint n_threads);
+guint    mx_image_get_max_load_threads (void);
+
+void     mx_image_get_load_statistics (guint *n_queued,
+                                       guint *n_running,
+                                       guint *max_queued,
+                                       guint *n_dropped);
+
+void         mx_image_set_thumbnail_cache_dir  (const gchar *directory);
+gchar       *mx_image_get_thumbnail_cache_dir  (void);
+void         mx_image_set_thumbnail_cache_size (guint64      max_bytes);
+guint64      mx_image_get_thumbnail_cache_size (void);
+
 void     mx_image_set_allow_upscale (MxImage *image,
                                      gboolean allow);
 gboolean mx_image_get_allow_upscale (MxImage *image);
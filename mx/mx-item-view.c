@@ -32,48 +32,57 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxItemView:virtualized can be set so that children are
+ * only created for the items in the rows that are visible through the
+ * vertical #MxAdjustment, plus a few rows either side of them. As the view
+ * scrolls, the children of items that go out of view are recycled for the
+ * items that come into view.
  */
 
+#include <math.h>
+
 #include "mx-item-view.h"
 #include "mx-private.h"
+#include "mx-scrollable.h"
+#include "mx-utils.h"
 
 G_DEFINE_TYPE (MxItemView, mx_item_view, MX_TYPE_GRID)
 
 #define ITEM_VIEW_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), MX_TYPE_ITEM_VIEW, MxItemViewPrivate))
 
-typedef struct
-{
-  gchar *name;
-  gint   col;
-} AttributeData;
-
 enum
 {
   PROP_0,
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUALIZED,
+  PROP_ITEM_WIDTH,
+  PROP_ITEM_HEIGHT,
+  PROP_OVERSCAN
 };
 
 struct _MxItemViewPrivate
 {
-  ClutterModel  *model;
-  GSList        *attributes;
-  GType          item_type;
-
-  MxItemFactory *factory;
-
-  gulong         filter_changed;
-  gulong         row_added;
-  gulong         row_changed;
-  gulong         row_removed;
-  gulong         sort_changed;
-
-  guint          is_frozen : 1;
+  MxModelBinding binding;
+
+  /* virtualized mode: the estimated item size */
+  MxAdjustment  *vadjustment;
+  gfloat         item_width;
+  gfloat         item_height;
+  gfloat         estimated_width;
+  gfloat         estimated_height;
+  guint          overscan;
+  guint          update_items_id;
 };
 
+static void mx_item_view_update_items       (MxItemView *item_view,
+                                             gboolean    rebind);
+static void mx_item_view_queue_update_items (MxItemView *item_view);
+
 /* gobject implementations */
 
 static void
@@ -86,13 +95,25 @@ mx_item_view_get_property (GObject    *object,
   switch (property_id)
     {
     case PROP_MODEL:
-      g_value_set_object (value, priv->model);
+      g_value_set_object (value, priv->binding.model);
       break;
     case PROP_ITEM_TYPE:
-      g_value_set_gtype (value, priv->item_type);
+      g_value_set_gtype (value, priv->binding.item_type);
       break;
     case PROP_FACTORY:
-      g_value_set_object (value, priv->factory);
+      g_value_set_object (value, priv->binding.factory);
+      break;
+    case PROP_VIRTUALIZED:
+      g_value_set_boolean (value, priv->binding.virtualized);
+      break;
+    case PROP_ITEM_WIDTH:
+      g_value_set_float (value, priv->item_width);
+      break;
+    case PROP_ITEM_HEIGHT:
+      g_value_set_float (value, priv->item_height);
+      break;
+    case PROP_OVERSCAN:
+      g_value_set_uint (value, priv->overscan);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -119,6 +140,24 @@ mx_item_view_set_property (GObject      *object,
       mx_item_view_set_factory ((MxItemView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUALIZED:
+      mx_item_view_set_virtualized ((MxItemView*) object,
+                                    g_value_get_boolean (value));
+      break;
+    case PROP_ITEM_WIDTH:
+      mx_item_view_set_item_size ((MxItemView*) object,
+                                  g_value_get_float (value),
+                                  ((MxItemView*) object)->priv->item_height);
+      break;
+    case PROP_ITEM_HEIGHT:
+      mx_item_view_set_item_size ((MxItemView*) object,
+                                  ((MxItemView*) object)->priv->item_width,
+                                  g_value_get_float (value));
+      break;
+    case PROP_OVERSCAN:
+      mx_item_view_set_overscan ((MxItemView*) object,
+                                 g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -127,8 +166,24 @@ mx_item_view_set_property (GObject      *object,
 static void
 mx_item_view_dispose (GObject *object)
 {
-  /* This will cause the unref of the model and also disconnect the signals */
-  mx_item_view_set_model (MX_ITEM_VIEW (object), NULL);
+  MxItemViewPrivate *priv = MX_ITEM_VIEW (object)->priv;
+
+  _mx_model_binding_dispose (&priv->binding);
+
+  if (priv->update_items_id)
+    {
+      clutter_threads_remove_repaint_func (priv->update_items_id);
+      priv->update_items_id = 0;
+    }
+
+  if (priv->vadjustment)
+    {
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            mx_item_view_queue_update_items,
+                                            object);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
+    }
 
   G_OBJECT_CLASS (mx_item_view_parent_class)->dispose (object);
 }
@@ -138,20 +193,290 @@ mx_item_view_finalize (GObject *object)
 {
   MxItemViewPrivate *priv = MX_ITEM_VIEW (object)->priv;
 
-  if (priv->attributes)
+  _mx_model_binding_finalize (&priv->binding);
+
+  G_OBJECT_CLASS (mx_item_view_parent_class)->finalize (object);
+}
+
+/* virtualized layout */
+
+static void
+mx_item_view_measure_item_size (MxItemView *item_view,
+                                gfloat     *width_p,
+                                gfloat     *height_p)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  GPtrArray *children = priv->binding.children;
+
+  /* estimate the size of every item from the first item with a child, and
+   * keep the estimate for when there are no children */
+  if ((priv->item_width <= 0 || priv->item_height <= 0) && children->len > 0)
+    clutter_actor_get_preferred_size (g_ptr_array_index (children, 0),
+                                      NULL, NULL,
+                                      &priv->estimated_width,
+                                      &priv->estimated_height);
+
+  *width_p = (priv->item_width > 0) ?
+    priv->item_width : priv->estimated_width;
+  *height_p = (priv->item_height > 0) ?
+    priv->item_height : priv->estimated_height;
+}
+
+static gint
+mx_item_view_get_n_items (MxItemView *item_view)
+{
+  ClutterModel *model = item_view->priv->binding.model;
+
+  return model ? clutter_model_get_n_rows (model) : 0;
+}
+
+/* Gets the number of items in each row when they are laid out in @width,
+ * or when @width is negative, as many as #MxGrid:max-stride allows */
+static gint
+mx_item_view_get_n_columns (MxItemView *item_view,
+                            gfloat      width,
+                            gfloat      item_width)
+{
+  gfloat col_spacing;
+  gint n_columns, max_stride;
+
+  col_spacing = mx_grid_get_column_spacing (MX_GRID (item_view));
+
+  if (width < 0 || item_width + col_spacing <= 0)
+    n_columns = mx_item_view_get_n_items (item_view);
+  else
+    n_columns = (gint) ((width + col_spacing) / (item_width + col_spacing));
+
+  max_stride = mx_grid_get_max_stride (MX_GRID (item_view));
+  if (max_stride > 0)
+    n_columns = MIN (n_columns, max_stride);
+
+  return MAX (n_columns, 1);
+}
+
+/* Gets the range of items that are in view when @item_view is allocated
+ * @box, from @first_p up to but not including @last_p, and the number of
+ * items in each row */
+static void
+mx_item_view_get_visible_items (MxItemView            *item_view,
+                                const ClutterActorBox *box,
+                                gint                  *first_p,
+                                gint                  *last_p,
+                                gint                  *n_columns_p)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat item_width, item_height, stride;
+  MxPadding padding;
+  gdouble value;
+  gint n_items, first_row, last_row;
+
+  n_items = mx_item_view_get_n_items (item_view);
+  mx_widget_get_padding (MX_WIDGET (item_view), &padding);
+  mx_item_view_measure_item_size (item_view, &item_width, &item_height);
+
+  /* until there is an item to estimate the size from, only the first item
+   * is visible */
+  if (item_width <= 0 || item_height <= 0)
     {
-      g_slist_foreach (priv->attributes, (GFunc) g_free, NULL);
-      g_slist_free (priv->attributes);
-      priv->attributes = NULL;
+      *first_p = 0;
+      *last_p = MIN (n_items, 1);
+      *n_columns_p = 1;
+      return;
     }
 
-  G_OBJECT_CLASS (mx_item_view_parent_class)->finalize (object);
+  *n_columns_p = mx_item_view_get_n_columns (item_view,
+                                             box->x2 - box->x1 -
+                                             padding.left - padding.right,
+                                             item_width);
+
+  stride = item_height + mx_grid_get_row_spacing (MX_GRID (item_view));
+  value = priv->vadjustment ? mx_adjustment_get_value (priv->vadjustment) : 0;
+
+  first_row = (gint) ((value - padding.top) / stride);
+  last_row = (gint) ceil ((value + box->y2 - box->y1 - padding.top) / stride);
+
+  *first_p = CLAMP (first_row * *n_columns_p, 0, n_items);
+  *last_p = CLAMP (last_row * *n_columns_p, *first_p, n_items);
+}
+
+static void
+mx_item_view_get_preferred_width (ClutterActor *actor,
+                                  gfloat        for_height,
+                                  gfloat       *min_width_p,
+                                  gfloat       *natural_width_p)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  gfloat item_width, item_height;
+  MxPadding padding;
+  gint n_columns;
+
+  if (!item_view->priv->binding.virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->
+        get_preferred_width (actor, for_height, min_width_p, natural_width_p);
+      return;
+    }
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+  mx_item_view_measure_item_size (item_view, &item_width, &item_height);
+
+  if (min_width_p)
+    *min_width_p = padding.left + padding.right + item_width;
+
+  /* like MxGrid, prefer to put as many items as possible in each row */
+  if (natural_width_p)
+    {
+      n_columns = mx_item_view_get_n_columns (item_view, -1, item_width);
+
+      *natural_width_p = padding.left + padding.right +
+        n_columns * item_width +
+        (n_columns - 1) * mx_grid_get_column_spacing (MX_GRID (actor));
+    }
+}
+
+static void
+mx_item_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  gfloat item_width, item_height;
+  MxPadding padding;
+  gint n_items, n_columns, n_rows;
+
+  if (!item_view->priv->binding.virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->
+        get_preferred_height (actor, for_width, min_height_p,
+                              natural_height_p);
+      return;
+    }
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  if (for_width > 0)
+    for_width = MAX (0, for_width - padding.left - padding.right);
+
+  /* a virtualized view is expected to scroll, so it can be as small as its
+   * padding */
+  if (min_height_p)
+    *min_height_p = padding.top + padding.bottom;
+
+  if (natural_height_p)
+    {
+      mx_item_view_measure_item_size (item_view, &item_width, &item_height);
+
+      n_items = mx_item_view_get_n_items (item_view);
+      n_columns = mx_item_view_get_n_columns (item_view, for_width,
+                                              item_width);
+      n_rows = (n_items + n_columns - 1) / n_columns;
+
+      *natural_height_p = padding.top + padding.bottom;
+      if (n_rows > 0)
+        *natural_height_p += n_rows * item_height + (n_rows - 1) *
+          mx_grid_get_row_spacing (MX_GRID (actor));
+    }
+}
+
+static void
+mx_item_view_allocate (ClutterActor           *actor,
+                       const ClutterActorBox  *box,
+                       ClutterAllocationFlags  flags)
+{
+  MxItemView *item_view = MX_ITEM_VIEW (actor);
+  MxItemViewPrivate *priv = item_view->priv;
+  gfloat avail_width, avail_height, item_width, item_height;
+  gfloat col_spacing, row_spacing;
+  ClutterActorClass *widget_class;
+  MxAlign x_align, y_align;
+  MxPadding padding;
+  gint n_items, n_columns, n_rows, first, last;
+  guint i;
+
+  if (!priv->binding.virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_item_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
+    }
+
+  /* MxGrid flows every child after the one before it, but here only some
+   * of the items have children, so skip straight to MxWidget */
+  widget_class = g_type_class_peek_parent (mx_item_view_parent_class);
+  widget_class->allocate (actor, box, flags);
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  avail_width = box->x2 - box->x1 - padding.left - padding.right;
+  avail_height = box->y2 - box->y1 - padding.top - padding.bottom;
+
+  mx_item_view_measure_item_size (item_view, &item_width, &item_height);
+  col_spacing = mx_grid_get_column_spacing (MX_GRID (actor));
+  row_spacing = mx_grid_get_row_spacing (MX_GRID (actor));
+
+  n_items = mx_item_view_get_n_items (item_view);
+  n_columns = mx_item_view_get_n_columns (item_view, avail_width, item_width);
+  n_rows = (n_items + n_columns - 1) / n_columns;
+
+  /* only update vadjustment - we don't really want horizontal scrolling */
+  if (priv->vadjustment)
+    {
+      gdouble upper, page_inc, stride;
+
+      stride = item_height + row_spacing;
+      upper = (n_rows > 0) ? n_rows * stride - row_spacing : 0;
+
+      if (stride > 0)
+        page_inc = ((gint)(avail_height / stride)) * stride;
+      else
+        page_inc = avail_height;
+
+      g_object_set (G_OBJECT (priv->vadjustment),
+                    "lower", 0.0,
+                    "upper", upper,
+                    "page-size", (gdouble) avail_height,
+                    "step-increment", stride,
+                    "page-increment", page_inc,
+                    NULL);
+    }
+
+  x_align = mx_grid_get_child_x_align (MX_GRID (actor));
+  y_align = mx_grid_get_child_y_align (MX_GRID (actor));
+
+  for (i = 0; i < priv->binding.children->len; i++)
+    {
+      ClutterActor *child = g_ptr_array_index (priv->binding.children, i);
+      ClutterActorBox child_box;
+      gint item = priv->binding.first_row + i;
+
+      child_box.x1 = (gint) (padding.left +
+                             (item % n_columns) * (item_width + col_spacing));
+      child_box.x2 = child_box.x1 + item_width;
+      child_box.y1 = (gint) (padding.top +
+                             (item / n_columns) * (item_height + row_spacing));
+      child_box.y2 = child_box.y1 + item_height;
+
+      mx_allocate_align_fill (child, &child_box, x_align, y_align,
+                              FALSE, FALSE);
+
+      clutter_actor_allocate (child, &child_box, flags);
+    }
+
+  /* children can't be added during allocation, so if the new size has
+   * brought items into view that don't have children, add them before the
+   * next frame */
+  mx_item_view_get_visible_items (item_view, box, &first, &last, &n_columns);
+  if (first < priv->binding.first_row ||
+      last > priv->binding.first_row + (gint) priv->binding.children->len)
+    mx_item_view_queue_update_items (item_view);
 }
 
 static void
 mx_item_view_class_init (MxItemViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxItemViewPrivate));
@@ -161,6 +486,10 @@ mx_item_view_class_init (MxItemViewClass *klass)
   object_class->dispose = mx_item_view_dispose;
   object_class->finalize = mx_item_view_finalize;
 
+  actor_class->get_preferred_width = mx_item_view_get_preferred_width;
+  actor_class->get_preferred_height = mx_item_view_get_preferred_height;
+  actor_class->allocate = mx_item_view_allocate;
+
   pspec = g_param_spec_object ("model",
                                "model",
                                "The model for the item view",
@@ -186,146 +515,200 @@ mx_item_view_class_init (MxItemViewClass *klass)
                                G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
                                MX_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_FACTORY, pspec);
-}
 
-static void
-mx_item_view_init (MxItemView *item_view)
-{
-  item_view->priv = ITEM_VIEW_PRIVATE (item_view);
+  /**
+   * MxItemView:virtualized:
+   *
+   * Whether children are only created for the items that are in view. The
+   * items of a virtualized view all have the same size, see
+   * #MxItemView:item-width and #MxItemView:item-height, and are laid out in
+   * rows that scroll vertically.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("virtualized",
+                                "Virtualized",
+                                "Only create children for the items that "
+                                "are in view.",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUALIZED, pspec);
+
+  /**
+   * MxItemView:item-width:
+   *
+   * The width of every item when the view is virtualized. If this is -1,
+   * the width is estimated from the preferred width of the first child.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_float ("item-width",
+                              "Item width",
+                              "The width of each item of a virtualized "
+                              "view, or -1 to estimate it.",
+                              -1, G_MAXFLOAT, -1,
+                              MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_ITEM_WIDTH, pspec);
+
+  /**
+   * MxItemView:item-height:
+   *
+   * The height of every item when the view is virtualized. If this is -1,
+   * the height is estimated from the preferred height of the first child.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_float ("item-height",
+                              "Item height",
+                              "The height of each item of a virtualized "
+                              "view, or -1 to estimate it.",
+                              -1, G_MAXFLOAT, -1,
+                              MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_ITEM_HEIGHT, pspec);
+
+  /**
+   * MxItemView:overscan:
+   *
+   * The number of rows either side of the visible rows whose items have
+   * children when the view is virtualized.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint ("overscan",
+                             "Overscan",
+                             "The number of rows outside the visible area "
+                             "of a virtualized view that have children.",
+                             0, G_MAXUINT, 2,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OVERSCAN, pspec);
 }
 
-
-/* model monitors */
 static void
-model_changed_cb (ClutterModel *model,
-                  MxItemView   *item_view)
+mx_item_view_vadjustment_notify_cb (MxItemView *item_view)
 {
-  GSList *p;
-  GList *l, *children;
   MxItemViewPrivate *priv = item_view->priv;
-  ClutterModelIter *iter = NULL;
-  gint model_n = 0, child_n = 0;
+  MxAdjustment *vadjustment = NULL;
 
+  /* the adjustment is only followed in virtualized mode, so that asking
+   * for it doesn't create one for a view that doesn't scroll */
+  if (priv->binding.virtualized)
+    mx_scrollable_get_adjustments (MX_SCROLLABLE (item_view),
+                                   NULL, &vadjustment);
 
-  /* bail out if we don't yet have an item type */
-  if (!priv->item_type && !priv->factory)
+  if (vadjustment == priv->vadjustment)
     return;
 
-  if (priv->is_frozen)
-    return;
-
-  if (priv->item_type)
+  if (priv->vadjustment)
     {
-      /* check the item-type is an descendant of ClutterActor */
-      if (!g_type_is_a (priv->item_type, CLUTTER_TYPE_ACTOR))
-        {
-          g_warning ("%s is not a subclass of ClutterActor and therefore"
-                     " cannot be used as items in an MxItemView",
-                     g_type_name (priv->item_type));
-          return;
-        }
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            mx_item_view_queue_update_items,
+                                            item_view);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
     }
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
-  child_n = g_list_length (children);
-
-  if (model)
-    model_n = clutter_model_get_n_rows (priv->model);
-  else
-    model_n = 0;
-
-  /* add children as needed */
-  while (model_n > child_n)
+  if (vadjustment)
     {
-      ClutterActor *new_child;
-
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
-
-      clutter_actor_add_child (CLUTTER_ACTOR (item_view), new_child);
-      child_n++;
+      priv->vadjustment = g_object_ref (vadjustment);
+      g_signal_connect_swapped (vadjustment, "notify::value",
+                                G_CALLBACK (mx_item_view_queue_update_items),
+                                item_view);
+      mx_item_view_queue_update_items (item_view);
     }
+}
 
-  /* remove children as needed */
-  l = g_list_last (children);
-  while (child_n > model_n)
-    {
-      clutter_actor_remove_child (CLUTTER_ACTOR (item_view), l->data);
-      l = g_list_previous (l);
-      child_n--;
-    }
+static void
+mx_item_view_init (MxItemView *item_view)
+{
+  MxItemViewPrivate *priv;
 
-  g_list_free (children);
+  priv = item_view->priv = ITEM_VIEW_PRIVATE (item_view);
 
-  if (!priv->model)
-    return;
+  _mx_model_binding_init (&priv->binding, CLUTTER_ACTOR (item_view),
+                          (MxModelBindingUpdateFunc) mx_item_view_update_items);
+  priv->item_width = -1;
+  priv->item_height = -1;
+  priv->overscan = 2;
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
+  g_signal_connect (item_view, "notify::vertical-adjustment",
+                    G_CALLBACK (mx_item_view_vadjustment_notify_cb), NULL);
+}
 
-  /* set the properties on the children */
-  iter = clutter_model_get_first_iter (priv->model);
-  l = children;
-  while (iter && !clutter_model_iter_is_last (iter))
-    {
-      GObject *child;
+static void
+mx_item_view_update_items (MxItemView *item_view,
+                           gboolean    rebind)
+{
+  MxItemViewPrivate *priv = item_view->priv;
+  gint first, last, n_columns, overscan;
+  ClutterActorBox box;
+  gboolean estimated;
 
-      child = G_OBJECT (l->data);
+  if (!priv->binding.virtualized || priv->binding.is_frozen)
+    return;
 
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
+  /* bail out if we don't yet have an item type or a factory */
+  if (!priv->binding.item_type && !priv->binding.factory)
+    return;
 
-          clutter_model_iter_get_value (iter, attr->col, &value);
+  clutter_actor_get_allocation_box (CLUTTER_ACTOR (item_view), &box);
 
-          g_object_set_property (child, attr->name, &value);
+  estimated = ((priv->item_width <= 0 || priv->item_height <= 0) &&
+               priv->binding.children->len == 0);
+  mx_item_view_get_visible_items (item_view, &box, &first, &last, &n_columns);
 
-          g_value_unset (&value);
-        }
-      g_object_thaw_notify (child);
+  /* scrolling within the overscan rows doesn't need any new children */
+  if (!rebind && first >= priv->binding.first_row &&
+      last <= priv->binding.first_row + (gint) priv->binding.children->len)
+    return;
 
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
-    }
+  overscan = priv->overscan * n_columns;
+  _mx_model_binding_set_rows (&priv->binding,
+                              MAX (0, first - overscan),
+                              MIN (mx_item_view_get_n_items (item_view),
+                                   last + overscan),
+                              rebind);
+
+  /* the first item that was given a child may have provided an estimate of
+   * the item size, in which case there may be more items in view */
+  if (estimated && priv->binding.children->len > 0)
+    mx_item_view_update_items (item_view, FALSE);
+}
 
-  g_list_free (children);
+static gboolean
+mx_item_view_update_items_cb (MxItemView *item_view)
+{
+  item_view->priv->update_items_id = 0;
+  mx_item_view_update_items (item_view, FALSE);
 
-  if (iter)
-    g_object_unref (iter);
+  return FALSE;
 }
 
 static void
-row_changed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxItemView       *item_view)
+mx_item_view_queue_update_items (MxItemView *item_view)
 {
-  model_changed_cb (model, item_view);
+  MxItemViewPrivate *priv = item_view->priv;
+
+  if (!priv->binding.virtualized || priv->update_items_id)
+    return;
+
+  /* update the items before the stage is next laid out, so that scrolling
+   * several times in a frame only rebinds the children once */
+  priv->update_items_id =
+    clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT |
+                                           CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD,
+                                           (GSourceFunc) mx_item_view_update_items_cb,
+                                           item_view, NULL);
 }
 
 static void
-row_removed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxItemView       *item_view)
+mx_item_view_clear_items (MxItemView *item_view)
 {
-  GList *children;
-  GList *l;
-  ClutterActor *child;
+  MxItemViewPrivate *priv = item_view->priv;
 
-  if (item_view->priv->is_frozen)
-    return;
+  _mx_model_binding_clear (&priv->binding);
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (item_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_actor_remove_child (CLUTTER_ACTOR (item_view), child);
-  g_list_free (children);
+  priv->estimated_width = 0;
+  priv->estimated_height = 0;
 }
 
 /* public api */
@@ -356,7 +739,7 @@ mx_item_view_get_item_type (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), G_TYPE_INVALID);
 
-  return item_view->priv->item_type;
+  return item_view->priv->binding.item_type;
 }
 
 
@@ -375,10 +758,14 @@ mx_item_view_set_item_type (MxItemView *item_view,
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (g_type_is_a (item_type, CLUTTER_TYPE_ACTOR));
 
-  item_view->priv->item_type = item_type;
+  item_view->priv->binding.item_type = item_type;
+
+  /* recycled children must all be of the new type */
+  if (item_view->priv->binding.virtualized)
+    mx_item_view_clear_items (item_view);
 
   /* update the view */
-  model_changed_cb (item_view->priv->model, item_view);
+  _mx_model_binding_repopulate (&item_view->priv->binding);
 }
 
 /**
@@ -394,7 +781,7 @@ mx_item_view_get_model (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), NULL);
 
-  return item_view->priv->model;
+  return item_view->priv->binding.model;
 }
 
 /**
@@ -408,70 +795,10 @@ void
 mx_item_view_set_model (MxItemView   *item_view,
                         ClutterModel *model)
 {
-  MxItemViewPrivate *priv;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (model == NULL || CLUTTER_IS_MODEL (model));
 
-  priv = item_view->priv;
-
-  if (priv->model)
-    {
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) model_changed_cb,
-                                            item_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_changed_cb,
-                                            item_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_removed_cb,
-                                            item_view);
-      g_object_unref (priv->model);
-
-      priv->model = NULL;
-    }
-
-  if (model)
-    {
-      g_return_if_fail (CLUTTER_IS_MODEL (model));
-
-      priv->model = g_object_ref (model);
-
-      priv->filter_changed = g_signal_connect (priv->model,
-                                               "filter-changed",
-                                               G_CALLBACK (model_changed_cb),
-                                               item_view);
-
-      priv->row_added = g_signal_connect (priv->model,
-                                          "row-added",
-                                          G_CALLBACK (row_changed_cb),
-                                          item_view);
-
-      priv->row_changed = g_signal_connect (priv->model,
-                                            "row-changed",
-                                            G_CALLBACK (row_changed_cb),
-                                            item_view);
-
-      /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
-       */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  item_view);
-
-      priv->sort_changed = g_signal_connect (priv->model,
-                                             "sort-changed",
-                                             G_CALLBACK (model_changed_cb),
-                                             item_view);
-
-      /*
-       * Only do this inside this block, setting the model to NULL should have
-       * the effect of preserving the view; just disconnect the handlers
-       */
-      model_changed_cb (priv->model, item_view);
-    }
+  _mx_model_binding_set_model (&item_view->priv->binding, model);
 }
 
 /**
@@ -489,21 +816,12 @@ mx_item_view_add_attribute (MxItemView  *item_view,
                             const gchar *_attribute,
                             gint         column)
 {
-  MxItemViewPrivate *priv;
-  AttributeData *prop;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
   g_return_if_fail (_attribute != NULL);
   g_return_if_fail (column >= 0);
 
-  priv = item_view->priv;
-
-  prop = g_new (AttributeData, 1);
-  prop->name = g_strdup (_attribute);
-  prop->col = column;
-
-  priv->attributes = g_slist_prepend (priv->attributes, prop);
-  model_changed_cb (priv->model, item_view);
+  _mx_model_binding_add_attribute (&item_view->priv->binding, _attribute,
+                                   column);
 }
 
 /**
@@ -511,14 +829,18 @@ mx_item_view_add_attribute (MxItemView  *item_view,
  * @item_view: An #MxItemView
  *
  * Freeze the view. This means that the view will not act on changes to the
- * model until it is thawed. Call #mx_item_view_thaw to thaw the view
+ * model until it is thawed. Call #mx_item_view_thaw to thaw the view.
+ *
+ * Freezing the view while making many changes to the model is cheaper than
+ * letting the view act on each of them, as the changes are applied together
+ * when the view is thawed.
  */
 void
 mx_item_view_freeze (MxItemView *item_view)
 {
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
 
-  item_view->priv->is_frozen = TRUE;
+  item_view->priv->binding.is_frozen = TRUE;
 }
 
 /**
@@ -526,21 +848,16 @@ mx_item_view_freeze (MxItemView *item_view)
  * @item_view: An #MxItemView
  *
  * Thaw the view. This means that the view will now act on changes to the
- * model.
+ * model. Changes made while the view was frozen are applied, only binding
+ * the rows that were added or changed. The view is repopulated instead if
+ * the model was sorted or filtered, or the view's attributes changed.
  */
 void
 mx_item_view_thaw (MxItemView *item_view)
 {
-  MxItemViewPrivate *priv;
-
   g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
 
-  priv = item_view->priv;
-
-  priv->is_frozen = FALSE;
-
-  /* Repopulate */
-  model_changed_cb (priv->model, item_view);
+  _mx_model_binding_thaw (&item_view->priv->binding);
 }
 
 /**
@@ -561,18 +878,15 @@ mx_item_view_set_factory (MxItemView    *item_view,
 
   priv = item_view->priv;
 
-  if (priv->factory == factory)
+  if (!_mx_model_binding_set_factory (&priv->binding, factory))
     return;
 
-  if (priv->factory)
+  if (priv->binding.virtualized)
     {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
+      mx_item_view_clear_items (item_view);
+      _mx_model_binding_repopulate (&priv->binding);
     }
 
-  if (factory)
-    priv->factory = g_object_ref (factory);
-
   g_object_notify (G_OBJECT (item_view), "factory");
 }
 
@@ -588,5 +902,184 @@ MxItemFactory *
 mx_item_view_get_factory (MxItemView *item_view)
 {
   g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), NULL);
-  return item_view->priv->factory;
+  return item_view->priv->binding.factory;
+}
+
+/**
+ * mx_item_view_set_virtualized:
+ * @item_view: A #MxItemView
+ * @virtualized: %TRUE to only create children for the items in view
+ *
+ * Sets whether @item_view only creates children for the items in the rows
+ * that are visible through its vertical #MxAdjustment, plus
+ * #MxItemView:overscan rows either side of them. As the view scrolls, the
+ * children of the items that go out of view are given the values of the
+ * items that come into view.
+ *
+ * The position of each item is computed from its index, the item size and
+ * the number of items that fit in a row, which is limited by
+ * #MxGrid:max-stride, so all the items must be the same size, see
+ * mx_item_view_set_item_size().
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_set_virtualized (MxItemView *item_view,
+                              gboolean    virtualized)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  priv = item_view->priv;
+
+  if (priv->binding.virtualized == virtualized)
+    return;
+
+  /* the two modes keep different children, so start again */
+  mx_item_view_clear_items (item_view);
+
+  priv->binding.virtualized = virtualized;
+
+  mx_item_view_vadjustment_notify_cb (item_view);
+  _mx_model_binding_repopulate (&priv->binding);
+
+  g_object_notify (G_OBJECT (item_view), "virtualized");
+}
+
+/**
+ * mx_item_view_get_virtualized:
+ * @item_view: A #MxItemView
+ *
+ * Gets whether @item_view only creates children for the items in view.
+ *
+ * Returns: %TRUE if @item_view is virtualized
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_item_view_get_virtualized (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), FALSE);
+
+  return item_view->priv->binding.virtualized;
+}
+
+/**
+ * mx_item_view_set_item_size:
+ * @item_view: A #MxItemView
+ * @width: the width of each item, or -1
+ * @height: the height of each item, or -1
+ *
+ * Sets the size of every item when @item_view is virtualized. If @width or
+ * @height is -1, it is estimated from the preferred size of the first
+ * child, which is only accurate when every child has the same preferred
+ * size.
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_set_item_size (MxItemView *item_view,
+                            gfloat      width,
+                            gfloat      height)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+  g_return_if_fail (width >= -1 && height >= -1);
+
+  priv = item_view->priv;
+
+  g_object_freeze_notify (G_OBJECT (item_view));
+
+  if (priv->item_width != width)
+    {
+      priv->item_width = width;
+      g_object_notify (G_OBJECT (item_view), "item-width");
+    }
+
+  if (priv->item_height != height)
+    {
+      priv->item_height = height;
+      g_object_notify (G_OBJECT (item_view), "item-height");
+    }
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (item_view));
+  mx_item_view_queue_update_items (item_view);
+
+  g_object_thaw_notify (G_OBJECT (item_view));
+}
+
+/**
+ * mx_item_view_get_item_size:
+ * @item_view: A #MxItemView
+ * @width: (out) (allow-none): return location for the width, or %NULL
+ * @height: (out) (allow-none): return location for the height, or %NULL
+ *
+ * Gets the size of the items of @item_view when it is virtualized. Either
+ * dimension is -1 if it is estimated.
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_get_item_size (MxItemView *item_view,
+                            gfloat     *width,
+                            gfloat     *height)
+{
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  if (width)
+    *width = item_view->priv->item_width;
+
+  if (height)
+    *height = item_view->priv->item_height;
+}
+
+/**
+ * mx_item_view_set_overscan:
+ * @item_view: A #MxItemView
+ * @overscan: the number of rows
+ *
+ * Sets the number of rows either side of the visible rows whose items
+ * have children when @item_view is virtualized.
+ *
+ * Since: 2.0
+ */
+void
+mx_item_view_set_overscan (MxItemView *item_view,
+                           guint       overscan)
+{
+  MxItemViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_ITEM_VIEW (item_view));
+
+  priv = item_view->priv;
+
+  if (priv->overscan == overscan)
+    return;
+
+  priv->overscan = overscan;
+
+  mx_item_view_update_items (item_view, TRUE);
+
+  g_object_notify (G_OBJECT (item_view), "overscan");
+}
+
+/**
+ * mx_item_view_get_overscan:
+ * @item_view: A #MxItemView
+ *
+ * Gets the number of rows either side of the visible rows whose items
+ * have children when @item_view is virtualized.
+ *
+ * Returns: the number of rows
+ *
+ * Since: 2.0
+ */
+guint
+mx_item_view_get_overscan (MxItemView *item_view)
+{
+  g_return_val_if_fail (MX_IS_ITEM_VIEW (item_view), 0);
+
+  return item_view->priv->overscan;
 }
@@ -32,50 +32,57 @@
  *
  * Data is set on the children by mapping columns in the model to object
  * properties on the children.
+ *
+ * For large models, #MxListView:virtualized can be set so that children are
+ * only created for the rows that are visible through the vertical
+ * #MxAdjustment, plus a few rows either side of them. As the view scrolls,
+ * the children of rows that go out of view are recycled for the rows that
+ * come into view.
  */
 
+#include <math.h>
+
 #include "mx-list-view.h"
 #include "mx-box-layout.h"
+#include "mx-box-layout-child.h"
 #include "mx-private.h"
 #include "mx-item-factory.h"
+#include "mx-scrollable.h"
+#include "mx-utils.h"
 
 G_DEFINE_TYPE (MxListView, mx_list_view, MX_TYPE_BOX_LAYOUT)
 
 #define LIST_VIEW_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), MX_TYPE_LIST_VIEW, MxListViewPrivate))
 
-typedef struct
-{
-  gchar *name;
-  gint   col;
-} AttributeData;
-
 enum
 {
   PROP_0,
 
   PROP_MODEL,
   PROP_ITEM_TYPE,
-  PROP_FACTORY
+  PROP_FACTORY,
+  PROP_VIRTUALIZED,
+  PROP_ROW_HEIGHT,
+  PROP_OVERSCAN
 };
 
 struct _MxListViewPrivate
 {
-  ClutterModel  *model;
-  GSList        *attributes;
-  GType          item_type;
-
-  MxItemFactory *factory;
-
-  gulong         filter_changed;
-  gulong         row_added;
-  gulong         row_changed;
-  gulong         row_removed;
-  gulong         sort_changed;
-
-  guint          is_frozen : 1;
+  MxModelBinding binding;
+
+  /* virtualized mode: the estimated height of a row */
+  MxAdjustment  *vadjustment;
+  gfloat         row_height;
+  gfloat         estimated_height;
+  guint          overscan;
+  guint          update_rows_id;
 };
 
+static void mx_list_view_update_rows       (MxListView *list_view,
+                                            gboolean    rebind);
+static void mx_list_view_queue_update_rows (MxListView *list_view);
+
 /* gobject implementations */
 
 static void
@@ -88,13 +95,22 @@ mx_list_view_get_property (GObject    *object,
   switch (property_id)
     {
     case PROP_MODEL:
-      g_value_set_object (value, priv->model);
+      g_value_set_object (value, priv->binding.model);
       break;
     case PROP_ITEM_TYPE:
-      g_value_set_gtype (value, priv->item_type);
+      g_value_set_gtype (value, priv->binding.item_type);
       break;
     case PROP_FACTORY:
-      g_value_set_object (value, priv->factory);
+      g_value_set_object (value, priv->binding.factory);
+      break;
+    case PROP_VIRTUALIZED:
+      g_value_set_boolean (value, priv->binding.virtualized);
+      break;
+    case PROP_ROW_HEIGHT:
+      g_value_set_float (value, priv->row_height);
+      break;
+    case PROP_OVERSCAN:
+      g_value_set_uint (value, priv->overscan);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -121,6 +137,18 @@ mx_list_view_set_property (GObject      *object,
       mx_list_view_set_factory ((MxListView*) object,
                                 (MxItemFactory*) g_value_get_object (value));
       break;
+    case PROP_VIRTUALIZED:
+      mx_list_view_set_virtualized ((MxListView*) object,
+                                    g_value_get_boolean (value));
+      break;
+    case PROP_ROW_HEIGHT:
+      mx_list_view_set_row_height ((MxListView*) object,
+                                   g_value_get_float (value));
+      break;
+    case PROP_OVERSCAN:
+      mx_list_view_set_overscan ((MxListView*) object,
+                                 g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -131,44 +159,237 @@ mx_list_view_dispose (GObject *object)
 {
   MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
 
-  /* This will cause the unref of the model and also disconnect the signals */
-  mx_list_view_set_model (MX_LIST_VIEW (object), NULL);
+  _mx_model_binding_dispose (&priv->binding);
+
+  if (priv->update_rows_id)
+    {
+      clutter_threads_remove_repaint_func (priv->update_rows_id);
+      priv->update_rows_id = 0;
+    }
 
-  if (priv->factory)
+  if (priv->vadjustment)
     {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            mx_list_view_queue_update_rows,
+                                            object);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
     }
 
   G_OBJECT_CLASS (mx_list_view_parent_class)->dispose (object);
 }
 
 static void
-free_attribute (AttributeData *data)
+mx_list_view_finalize (GObject *object)
+{
+  MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
+
+  _mx_model_binding_finalize (&priv->binding);
+
+  G_OBJECT_CLASS (mx_list_view_parent_class)->finalize (object);
+}
+
+/* virtualized layout */
+
+static gfloat
+mx_list_view_measure_row_height (MxListView *list_view,
+                                 gfloat      for_width)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  GPtrArray *children = priv->binding.children;
+
+  if (priv->row_height > 0)
+    return priv->row_height;
+
+  /* estimate the height of every row from the first row with a child, and
+   * keep the estimate for when there are no children */
+  if (children->len > 0)
+    clutter_actor_get_preferred_height (g_ptr_array_index (children, 0),
+                                        for_width, NULL,
+                                        &priv->estimated_height);
+
+  return priv->estimated_height;
+}
+
+static gint
+mx_list_view_get_n_rows (MxListView *list_view)
+{
+  ClutterModel *model = list_view->priv->binding.model;
+
+  return model ? clutter_model_get_n_rows (model) : 0;
+}
+
+/* Gets the range of rows that are in view when @list_view is allocated
+ * @box, from @first_p up to but not including @last_p */
+static void
+mx_list_view_get_visible_rows (MxListView            *list_view,
+                               const ClutterActorBox *box,
+                               gint                  *first_p,
+                               gint                  *last_p)
 {
-  g_free (data->name);
-  g_free (data);
+  MxListViewPrivate *priv = list_view->priv;
+  MxPadding padding;
+  gfloat row_height, stride;
+  gdouble value;
+  gint n_rows, first, last;
+
+  n_rows = mx_list_view_get_n_rows (list_view);
+  mx_widget_get_padding (MX_WIDGET (list_view), &padding);
+
+  row_height = mx_list_view_measure_row_height (list_view,
+                                                box->x2 - box->x1 -
+                                                padding.left - padding.right);
+
+  /* until there is a row to estimate the height from, only the first row
+   * is visible */
+  if (row_height <= 0)
+    {
+      *first_p = 0;
+      *last_p = MIN (n_rows, 1);
+      return;
+    }
+
+  stride = row_height + mx_box_layout_get_spacing (MX_BOX_LAYOUT (list_view));
+  value = priv->vadjustment ? mx_adjustment_get_value (priv->vadjustment) : 0;
+
+  first = (gint) ((value - padding.top) / stride);
+  last = (gint) ceil ((value + box->y2 - box->y1 - padding.top) / stride);
+
+  *first_p = CLAMP (first, 0, n_rows);
+  *last_p = CLAMP (last, *first_p, n_rows);
 }
 
 static void
-mx_list_view_finalize (GObject *object)
+mx_list_view_get_preferred_height (ClutterActor *actor,
+                                   gfloat        for_width,
+                                   gfloat       *min_height_p,
+                                   gfloat       *natural_height_p)
 {
-  MxListViewPrivate *priv = MX_LIST_VIEW (object)->priv;
+  MxListView *list_view = MX_LIST_VIEW (actor);
+  MxPadding padding;
+  gfloat row_height;
+  gint n_rows;
 
-  if (priv->attributes)
+  if (!list_view->priv->binding.virtualized)
     {
-      g_slist_foreach (priv->attributes, (GFunc) free_attribute, NULL);
-      g_slist_free (priv->attributes);
-      priv->attributes = NULL;
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->
+        get_preferred_height (actor, for_width, min_height_p,
+                              natural_height_p);
+      return;
     }
 
-  G_OBJECT_CLASS (mx_list_view_parent_class)->finalize (object);
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  if (for_width > 0)
+    for_width = MAX (0, for_width - padding.left - padding.right);
+
+  /* a virtualized view is expected to scroll, so it can be as small as its
+   * padding */
+  if (min_height_p)
+    *min_height_p = padding.top + padding.bottom;
+
+  if (natural_height_p)
+    {
+      n_rows = mx_list_view_get_n_rows (list_view);
+      row_height = mx_list_view_measure_row_height (list_view, for_width);
+
+      *natural_height_p = padding.top + padding.bottom;
+      if (n_rows > 0)
+        *natural_height_p += n_rows * row_height + (n_rows - 1) *
+          mx_box_layout_get_spacing (MX_BOX_LAYOUT (actor));
+    }
+}
+
+static void
+mx_list_view_allocate (ClutterActor           *actor,
+                       const ClutterActorBox  *box,
+                       ClutterAllocationFlags  flags)
+{
+  MxListView *list_view = MX_LIST_VIEW (actor);
+  MxListViewPrivate *priv = list_view->priv;
+  ClutterActorClass *widget_class;
+  gfloat avail_width, avail_height, row_height, stride;
+  MxPadding padding;
+  guint i, spacing;
+  gint n_rows, first, last;
+
+  if (!priv->binding.virtualized)
+    {
+      CLUTTER_ACTOR_CLASS (mx_list_view_parent_class)->allocate (actor, box,
+                                                                 flags);
+      return;
+    }
+
+  /* MxBoxLayout places every child after the one before it, but here only
+   * some of the rows have children, so skip straight to MxWidget */
+  widget_class = g_type_class_peek_parent (mx_list_view_parent_class);
+  widget_class->allocate (actor, box, flags);
+
+  mx_widget_get_padding (MX_WIDGET (actor), &padding);
+
+  avail_width = box->x2 - box->x1 - padding.left - padding.right;
+  avail_height = box->y2 - box->y1 - padding.top - padding.bottom;
+
+  n_rows = mx_list_view_get_n_rows (list_view);
+  row_height = mx_list_view_measure_row_height (list_view, avail_width);
+  spacing = mx_box_layout_get_spacing (MX_BOX_LAYOUT (actor));
+  stride = row_height + spacing;
+
+  if (priv->vadjustment)
+    {
+      gdouble upper, page_inc;
+
+      upper = (n_rows > 0) ? n_rows * stride - spacing : 0;
+
+      if (stride > 0)
+        page_inc = ((gint)(avail_height / stride)) * stride;
+      else
+        page_inc = avail_height;
+
+      g_object_set (G_OBJECT (priv->vadjustment),
+                    "lower", 0.0,
+                    "upper", upper,
+                    "page-size", (gdouble) avail_height,
+                    "step-increment", (gdouble) stride,
+                    "page-increment", page_inc,
+                    NULL);
+    }
+
+  for (i = 0; i < priv->binding.children->len; i++)
+    {
+      ClutterActor *child = g_ptr_array_index (priv->binding.children, i);
+      MxBoxLayoutChild *meta;
+      ClutterActorBox child_box;
+
+      meta = (MxBoxLayoutChild *)
+        clutter_container_get_child_meta (CLUTTER_CONTAINER (actor), child);
+
+      child_box.x1 = padding.left;
+      child_box.x2 = padding.left + avail_width;
+      child_box.y1 = (gint) (padding.top +
+                             (priv->binding.first_row + i) * stride);
+      child_box.y2 = child_box.y1 + row_height;
+
+      mx_allocate_align_fill (child, &child_box, meta->x_align, meta->y_align,
+                              meta->x_fill, meta->y_fill);
+
+      clutter_actor_allocate (child, &child_box, flags);
+    }
+
+  /* children can't be added during allocation, so if the new size has
+   * brought rows into view that don't have children, add them before the
+   * next frame */
+  mx_list_view_get_visible_rows (list_view, box, &first, &last);
+  if (first < priv->binding.first_row ||
+      last > priv->binding.first_row + (gint) priv->binding.children->len)
+    mx_list_view_queue_update_rows (list_view);
 }
 
 static void
 mx_list_view_class_init (MxListViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
   GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxListViewPrivate));
@@ -178,6 +399,9 @@ mx_list_view_class_init (MxListViewClass *klass)
   object_class->dispose = mx_list_view_dispose;
   object_class->finalize = mx_list_view_finalize;
 
+  actor_class->get_preferred_height = mx_list_view_get_preferred_height;
+  actor_class->allocate = mx_list_view_allocate;
+
   pspec = g_param_spec_object ("model",
                                "model",
                                "The model for the item view",
@@ -203,148 +427,182 @@ mx_list_view_class_init (MxListViewClass *klass)
                                G_TYPE_OBJECT /*MX_TYPE_ITEM_FACTORY*/,
                                MX_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_FACTORY, pspec);
-}
-
-static void
-mx_list_view_init (MxListView *list_view)
-{
-  list_view->priv = LIST_VIEW_PRIVATE (list_view);
 
-  mx_box_layout_set_orientation (MX_BOX_LAYOUT (list_view), MX_ORIENTATION_VERTICAL);
+  /**
+   * MxListView:virtualized:
+   *
+   * Whether children are only created for the rows that are in view. All
+   * the rows of a virtualized view are laid out vertically with the same
+   * height, see #MxListView:row-height.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_boolean ("virtualized",
+                                "Virtualized",
+                                "Only create children for the rows that "
+                                "are in view.",
+                                FALSE,
+                                MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_VIRTUALIZED, pspec);
+
+  /**
+   * MxListView:row-height:
+   *
+   * The height of every row when the view is virtualized. If this is -1,
+   * the height is estimated from the preferred height of the first child.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_float ("row-height",
+                              "Row height",
+                              "The height of each row of a virtualized "
+                              "view, or -1 to estimate it.",
+                              -1, G_MAXFLOAT, -1,
+                              MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_ROW_HEIGHT, pspec);
+
+  /**
+   * MxListView:overscan:
+   *
+   * The number of rows either side of the visible rows that have children
+   * when the view is virtualized, so that scrolling a short distance
+   * doesn't need to rebind any children.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint ("overscan",
+                             "Overscan",
+                             "The number of rows outside the visible area "
+                             "of a virtualized view that have children.",
+                             0, G_MAXUINT, 4,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OVERSCAN, pspec);
 }
 
-
-/* model monitors */
 static void
-model_changed_cb (ClutterModel *model,
-                  MxListView   *list_view)
+mx_list_view_vadjustment_notify_cb (MxListView *list_view)
 {
-  GSList *p;
-  GList *l, *children;
   MxListViewPrivate *priv = list_view->priv;
-  ClutterModelIter *iter = NULL;
-  gint model_n = 0, child_n = 0;
+  MxAdjustment *vadjustment = NULL;
 
+  /* the adjustment is only followed in virtualized mode, so that asking
+   * for it doesn't create one for a view that doesn't scroll */
+  if (priv->binding.virtualized)
+    mx_scrollable_get_adjustments (MX_SCROLLABLE (list_view),
+                                   NULL, &vadjustment);
 
-  /* bail out if we don't yet have an item type or a factory */
-  if (!priv->item_type && !priv->factory)
-    return;
-
-  if (priv->is_frozen)
+  if (vadjustment == priv->vadjustment)
     return;
 
-  if (priv->item_type)
+  if (priv->vadjustment)
     {
-      /* check the item-type is an descendant of ClutterActor */
-      if (!g_type_is_a (priv->item_type, CLUTTER_TYPE_ACTOR))
-        {
-          g_warning ("%s is not a subclass of ClutterActor and therefore"
-                     " cannot be used as items in an MxListView",
-                     g_type_name (priv->item_type));
-          return;
-        }
+      g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                            mx_list_view_queue_update_rows,
+                                            list_view);
+      g_object_unref (priv->vadjustment);
+      priv->vadjustment = NULL;
     }
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
-  child_n = g_list_length (children);
-
-  if (model)
-    model_n = clutter_model_get_n_rows (priv->model);
-  else
-    model_n = 0;
-
-  /* add children as needed */
-  while (model_n > child_n)
+  if (vadjustment)
     {
-      ClutterActor *new_child;
+      priv->vadjustment = g_object_ref (vadjustment);
+      g_signal_connect_swapped (vadjustment, "notify::value",
+                                G_CALLBACK (mx_list_view_queue_update_rows),
+                                list_view);
+      mx_list_view_queue_update_rows (list_view);
+    }
+}
 
-      if (priv->item_type)
-        {
-          new_child = g_object_new (priv->item_type, NULL);
-        }
-      else
-        {
-          new_child = mx_item_factory_create (priv->factory);
-        }
+static void
+mx_list_view_init (MxListView *list_view)
+{
+  MxListViewPrivate *priv;
 
-      clutter_actor_add_child (CLUTTER_ACTOR (list_view), new_child);
-      child_n++;
-    }
+  priv = list_view->priv = LIST_VIEW_PRIVATE (list_view);
 
-  /* remove children as needed */
-  l = g_list_last (children);
-  while (child_n > model_n)
-    {
-      clutter_actor_remove_child (CLUTTER_ACTOR (list_view), l->data);
-      l = g_list_previous (l);
-      child_n--;
-    }
+  _mx_model_binding_init (&priv->binding, CLUTTER_ACTOR (list_view),
+                          (MxModelBindingUpdateFunc) mx_list_view_update_rows);
+  priv->row_height = -1;
+  priv->overscan = 4;
 
-  g_list_free (children);
+  mx_box_layout_set_orientation (MX_BOX_LAYOUT (list_view), MX_ORIENTATION_VERTICAL);
 
-  if (!priv->model)
-    return;
+  g_signal_connect (list_view, "notify::vertical-adjustment",
+                    G_CALLBACK (mx_list_view_vadjustment_notify_cb), NULL);
+}
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
+static void
+mx_list_view_update_rows (MxListView *list_view,
+                          gboolean    rebind)
+{
+  MxListViewPrivate *priv = list_view->priv;
+  ClutterActorBox box;
+  gint first, last;
+  gboolean estimated;
 
-  /* set the properties on the children */
-  iter = clutter_model_get_first_iter (priv->model);
-  l = children;
-  while (iter && !clutter_model_iter_is_last (iter))
-    {
-      GObject *child;
+  if (!priv->binding.virtualized || priv->binding.is_frozen)
+    return;
 
-      child = G_OBJECT (l->data);
+  /* bail out if we don't yet have an item type or a factory */
+  if (!priv->binding.item_type && !priv->binding.factory)
+    return;
 
-      g_object_freeze_notify (child);
-      for (p = priv->attributes; p; p = p->next)
-        {
-          GValue value = { 0, };
-          AttributeData *attr = p->data;
+  clutter_actor_get_allocation_box (CLUTTER_ACTOR (list_view), &box);
 
-          clutter_model_iter_get_value (iter, attr->col, &value);
+  estimated = (priv->row_height <= 0 && priv->binding.children->len == 0);
+  mx_list_view_get_visible_rows (list_view, &box, &first, &last);
 
-          g_object_set_property (child, attr->name, &value);
+  /* scrolling within the overscan rows doesn't need any new children */
+  if (!rebind && first >= priv->binding.first_row &&
+      last <= priv->binding.first_row + (gint) priv->binding.children->len)
+    return;
 
-          g_value_unset (&value);
-        }
-      g_object_thaw_notify (child);
+  _mx_model_binding_set_rows (&priv->binding,
+                              MAX (0, first - (gint) priv->overscan),
+                              MIN (mx_list_view_get_n_rows (list_view),
+                                   last + (gint) priv->overscan),
+                              rebind);
 
-      l = g_list_next (l);
-      clutter_model_iter_next (iter);
-    }
+  /* the first row that was given a child may have provided an estimate of
+   * the row height, in which case there may be more rows in view */
+  if (estimated && priv->binding.children->len > 0)
+    mx_list_view_update_rows (list_view, FALSE);
+}
 
-  g_list_free (children);
+static gboolean
+mx_list_view_update_rows_cb (MxListView *list_view)
+{
+  list_view->priv->update_rows_id = 0;
+  mx_list_view_update_rows (list_view, FALSE);
 
-  if (iter)
-    g_object_unref (iter);
+  return FALSE;
 }
 
 static void
-row_changed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxListView       *list_view)
+mx_list_view_queue_update_rows (MxListView *list_view)
 {
-  model_changed_cb (model, list_view);
+  MxListViewPrivate *priv = list_view->priv;
+
+  if (!priv->binding.virtualized || priv->update_rows_id)
+    return;
+
+  /* update the rows before the stage is next laid out, so that scrolling
+   * several times in a frame only rebinds the children once */
+  priv->update_rows_id =
+    clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT |
+                                           CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD,
+                                           (GSourceFunc) mx_list_view_update_rows_cb,
+                                           list_view, NULL);
 }
 
 static void
-row_removed_cb (ClutterModel     *model,
-                ClutterModelIter *iter,
-                MxListView       *list_view)
+mx_list_view_clear_rows (MxListView *list_view)
 {
-  GList *children;
-  GList *l;
-  ClutterActor *child;
+  MxListViewPrivate *priv = list_view->priv;
 
-  if (list_view->priv->is_frozen)
-    return;
+  _mx_model_binding_clear (&priv->binding);
 
-  children = clutter_actor_get_children (CLUTTER_ACTOR (list_view));
-  l = g_list_nth (children, clutter_model_iter_get_row (iter));
-  child = (ClutterActor *) l->data;
-  clutter_actor_remove_child (CLUTTER_ACTOR (list_view), child);
-  g_list_free (children);
+  priv->estimated_height = 0;
 }
 
 /* public api */
@@ -375,7 +633,7 @@ mx_list_view_get_item_type (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), G_TYPE_INVALID);
 
-  return list_view->priv->item_type;
+  return list_view->priv->binding.item_type;
 }
 
 
@@ -394,10 +652,14 @@ mx_list_view_set_item_type (MxListView *list_view,
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (g_type_is_a (item_type, CLUTTER_TYPE_ACTOR));
 
-  list_view->priv->item_type = item_type;
+  list_view->priv->binding.item_type = item_type;
+
+  /* recycled children must all be of the new type */
+  if (list_view->priv->binding.virtualized)
+    mx_list_view_clear_rows (list_view);
 
   /* update the view */
-  model_changed_cb (list_view->priv->model, list_view);
+  _mx_model_binding_repopulate (&list_view->priv->binding);
 }
 
 /**
@@ -413,7 +675,7 @@ mx_list_view_get_model (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), NULL);
 
-  return list_view->priv->model;
+  return list_view->priv->binding.model;
 }
 
 /**
@@ -427,70 +689,10 @@ void
 mx_list_view_set_model (MxListView   *list_view,
                         ClutterModel *model)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (model == NULL || CLUTTER_IS_MODEL (model));
 
-  priv = list_view->priv;
-
-  if (priv->model)
-    {
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) model_changed_cb,
-                                            list_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_changed_cb,
-                                            list_view);
-      g_signal_handlers_disconnect_by_func (priv->model,
-                                            (GCallback) row_removed_cb,
-                                            list_view);
-      g_object_unref (priv->model);
-
-      priv->model = NULL;
-    }
-
-  if (model)
-    {
-      g_return_if_fail (CLUTTER_IS_MODEL (model));
-
-      priv->model = g_object_ref (model);
-
-      priv->filter_changed = g_signal_connect (priv->model,
-                                               "filter-changed",
-                                               G_CALLBACK (model_changed_cb),
-                                               list_view);
-
-      priv->row_added = g_signal_connect (priv->model,
-                                          "row-added",
-                                          G_CALLBACK (row_changed_cb),
-                                          list_view);
-
-      priv->row_changed = g_signal_connect (priv->model,
-                                            "row-changed",
-                                            G_CALLBACK (row_changed_cb),
-                                            list_view);
-
-      /*
-       * model_changed_cb (called from row_changed_cb) expect the row to already
-       * have been removed, thus we need to use _after
-       */
-      priv->row_removed = g_signal_connect_after (priv->model,
-                                                  "row-removed",
-                                                  G_CALLBACK (row_removed_cb),
-                                                  list_view);
-
-      priv->sort_changed = g_signal_connect (priv->model,
-                                             "sort-changed",
-                                             G_CALLBACK (model_changed_cb),
-                                             list_view);
-
-      /*
-       * Only do this inside this block, setting the model to NULL should have
-       * the effect of preserving the view; just disconnect the handlers
-       */
-      model_changed_cb (priv->model, list_view);
-    }
+  _mx_model_binding_set_model (&list_view->priv->binding, model);
 }
 
 /**
@@ -508,21 +710,12 @@ mx_list_view_add_attribute (MxListView  *list_view,
                             const gchar *_attribute,
                             gint         column)
 {
-  MxListViewPrivate *priv;
-  AttributeData *prop;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
   g_return_if_fail (_attribute != NULL);
   g_return_if_fail (column >= 0);
 
-  priv = list_view->priv;
-
-  prop = g_new (AttributeData, 1);
-  prop->name = g_strdup (_attribute);
-  prop->col = column;
-
-  priv->attributes = g_slist_prepend (priv->attributes, prop);
-  model_changed_cb (priv->model, list_view);
+  _mx_model_binding_add_attribute (&list_view->priv->binding, _attribute,
+                                   column);
 }
 
 /**
@@ -531,17 +724,17 @@ mx_list_view_add_attribute (MxListView  *list_view,
  *
  * Freeze the view. This means that the view will not act on changes to the
  * model until it is thawed. Call #mx_list_view_thaw to thaw the view.
+ *
+ * Freezing the view while making many changes to the model is cheaper than
+ * letting the view act on each of them, as the changes are applied together
+ * when the view is thawed.
  */
 void
 mx_list_view_freeze (MxListView *list_view)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
 
-  priv = list_view->priv;
-
-  priv->is_frozen = TRUE;
+  list_view->priv->binding.is_frozen = TRUE;
 }
 
 /**
@@ -549,21 +742,16 @@ mx_list_view_freeze (MxListView *list_view)
  * @list_view: An #MxListView
  *
  * Thaw the view. This means that the view will now act on changes to the
- * model.
+ * model. Changes made while the view was frozen are applied, only binding
+ * the rows that were added or changed. The view is repopulated instead if
+ * the model was sorted or filtered, or the view's attributes changed.
  */
 void
 mx_list_view_thaw (MxListView *list_view)
 {
-  MxListViewPrivate *priv;
-
   g_return_if_fail (MX_IS_LIST_VIEW (list_view));
 
-  priv = list_view->priv;
-
-  priv->is_frozen = FALSE;
-
-  /* Repopulate */
-  model_changed_cb (priv->model, list_view);
+  _mx_model_binding_thaw (&list_view->priv->binding);
 }
 
 /**
@@ -584,18 +772,15 @@ mx_list_view_set_factory (MxListView    *list_view,
 
   priv = list_view->priv;
 
-  if (priv->factory == factory)
+  if (!_mx_model_binding_set_factory (&priv->binding, factory))
     return;
 
-  if (priv->factory)
+  if (priv->binding.virtualized)
     {
-      g_object_unref (priv->factory);
-      priv->factory = NULL;
+      mx_list_view_clear_rows (list_view);
+      _mx_model_binding_repopulate (&priv->binding);
     }
 
-  if (factory)
-    priv->factory = g_object_ref (factory);
-
   g_object_notify (G_OBJECT (list_view), "factory");
 }
 
@@ -611,5 +796,166 @@ MxItemFactory *
 mx_list_view_get_factory (MxListView *list_view)
 {
   g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), NULL);
-  return list_view->priv->factory;
+  return list_view->priv->binding.factory;
+}
+
+/**
+ * mx_list_view_set_virtualized:
+ * @list_view: A #MxListView
+ * @virtualized: %TRUE to only create children for the rows in view
+ *
+ * Sets whether @list_view only creates children for the rows that are
+ * visible through its vertical #MxAdjustment, plus #MxListView:overscan rows
+ * either side of them. As the view scrolls, the children of the rows that
+ * go out of view are given the values of the rows that come into view.
+ *
+ * This makes the cost of the view proportional to the number of rows that
+ * fit on screen, rather than to the number of rows in the model, but all
+ * the rows must be the same height, see mx_list_view_set_row_height().
+ *
+ * Since: 2.0
+ */
+void
+mx_list_view_set_virtualized (MxListView *list_view,
+                              gboolean    virtualized)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  priv = list_view->priv;
+
+  if (priv->binding.virtualized == virtualized)
+    return;
+
+  /* the two modes keep different children, so start again */
+  mx_list_view_clear_rows (list_view);
+
+  priv->binding.virtualized = virtualized;
+
+  mx_list_view_vadjustment_notify_cb (list_view);
+  _mx_model_binding_repopulate (&priv->binding);
+
+  g_object_notify (G_OBJECT (list_view), "virtualized");
+}
+
+/**
+ * mx_list_view_get_virtualized:
+ * @list_view: A #MxListView
+ *
+ * Gets whether @list_view only creates children for the rows in view.
+ *
+ * Returns: %TRUE if @list_view is virtualized
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_list_view_get_virtualized (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), FALSE);
+
+  return list_view->priv->binding.virtualized;
+}
+
+/**
+ * mx_list_view_set_row_height:
+ * @list_view: A #MxListView
+ * @row_height: the height of each row, or -1
+ *
+ * Sets the height of every row when @list_view is virtualized. If
+ * @row_height is -1, the height is estimated from the preferred height of
+ * the first child, which is only accurate when every child has the same
+ * preferred height.
+ *
+ * Since: 2.0
+ */
+void
+mx_list_view_set_row_height (MxListView *list_view,
+                             gfloat      row_height)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+  g_return_if_fail (row_height >= -1);
+
+  priv = list_view->priv;
+
+  if (priv->row_height == row_height)
+    return;
+
+  priv->row_height = row_height;
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (list_view));
+  mx_list_view_queue_update_rows (list_view);
+
+  g_object_notify (G_OBJECT (list_view), "row-height");
+}
+
+/**
+ * mx_list_view_get_row_height:
+ * @list_view: A #MxListView
+ *
+ * Gets the height of the rows of @list_view when it is virtualized.
+ *
+ * Returns: the height of each row, or -1 if it is estimated
+ *
+ * Since: 2.0
+ */
+gfloat
+mx_list_view_get_row_height (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), -1);
+
+  return list_view->priv->row_height;
+}
+
+/**
+ * mx_list_view_set_overscan:
+ * @list_view: A #MxListView
+ * @overscan: the number of rows
+ *
+ * Sets the number of rows either side of the visible rows that have
+ * children when @list_view is virtualized. A larger overscan means fewer
+ * children need to be given new values as the view scrolls, at the cost of
+ * more children.
+ *
+ * Since: 2.0
+ */
+void
+mx_list_view_set_overscan (MxListView *list_view,
+                           guint       overscan)
+{
+  MxListViewPrivate *priv;
+
+  g_return_if_fail (MX_IS_LIST_VIEW (list_view));
+
+  priv = list_view->priv;
+
+  if (priv->overscan == overscan)
+    return;
+
+  priv->overscan = overscan;
+
+  mx_list_view_update_rows (list_view, TRUE);
+
+  g_object_notify (G_OBJECT (list_view), "overscan");
+}
+
+/**
+ * mx_list_view_get_overscan:
+ * @list_view: A #MxListView
+ *
+ * Gets the number of rows either side of the visible rows that have
+ * children when @list_view is virtualized.
+ *
+ * Returns: the number of rows
+ *
+ * Since: 2.0
+ */
+guint
+mx_list_view_get_overscan (MxListView *list_view)
+{
+  g_return_val_if_fail (MX_IS_LIST_VIEW (list_view), 0);
+
+  return list_view->priv->overscan;
 }
@@ -0,0 +1,969 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-model-binding.c: Children of a view bound to the rows of a model
+ *
+ * Copyright 2008, 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* The parts of MxListView and MxItemView that keep a child for each row of
+ * a #ClutterModel, with the model columns mapped to properties of the
+ * children. The views only lay the children out, and in virtualized mode
+ * decide which rows are in view.
+ */
+
+#include <string.h>
+
+#include "mx-private.h"
+#include "mx-item-factory.h"
+
+typedef struct
+{
+  gchar      *name;
+  gint        col;
+
+  /* the property, as looked up on items of type pspec_type */
+  GType       pspec_type;
+  GParamSpec *pspec;
+} AttributeData;
+
+/* the values last set on an item for each of the attributes */
+typedef struct
+{
+  guint  serial;
+  guint  n_values;
+  GValue values[1];
+} BoundValues;
+
+typedef enum
+{
+  ROWS_ADDED,
+  ROWS_REMOVED,
+  ROWS_CHANGED
+} RowsChangeType;
+
+/* a change to the model while the view is frozen */
+typedef struct
+{
+  RowsChangeType type;
+  gint           row;
+  gint           n_rows;
+} RowsChange;
+
+typedef struct
+{
+  ClutterActor *child;
+  guint         dirty : 1;
+  guint         is_new : 1;
+} RowSlot;
+
+/* past this many recorded changes, repopulating the view is cheaper */
+#define MAX_RECORDED_CHANGES 128
+
+static GQuark quark_bound_values = 0;
+static GQuark quark_model_binding = 0;
+
+/* Only connected to the notify signals of bound properties */
+static void
+mx_model_binding_item_notify_cb (GObject      *child,
+                                 GParamSpec   *pspec,
+                                 ClutterActor *view)
+{
+  MxModelBinding *binding;
+  BoundValues *bound;
+  GSList *p;
+  guint i;
+
+  binding = g_object_get_qdata (G_OBJECT (view), quark_model_binding);
+
+  if (binding->is_binding)
+    return;
+
+  bound = g_object_get_qdata (child, quark_bound_values);
+  if (!bound || bound->serial != binding->attributes_serial)
+    return;
+
+  /* the item changed a bound property itself, so what it shows no longer
+   * matches the value last set on it */
+  for (p = binding->attributes, i = 0; p; p = p->next, i++)
+    {
+      AttributeData *attr = p->data;
+
+      if (attr->pspec == pspec && G_IS_VALUE (&bound->values[i]))
+        g_value_unset (&bound->values[i]);
+    }
+}
+
+static ClutterActor *
+mx_model_binding_create_item (MxModelBinding *binding)
+{
+  ClutterActor *child;
+
+  if (binding->item_type)
+    child = g_object_new (binding->item_type, NULL);
+  else
+    child = mx_item_factory_create (binding->factory);
+
+  return child;
+}
+
+static void
+mx_model_binding_bound_values_free (BoundValues *bound)
+{
+  guint i;
+
+  for (i = 0; i < bound->n_values; i++)
+    if (G_IS_VALUE (&bound->values[i]))
+      g_value_unset (&bound->values[i]);
+
+  g_free (bound);
+}
+
+static void
+mx_model_binding_bind_item (MxModelBinding   *binding,
+                            ClutterActor     *item,
+                            ClutterModelIter *iter)
+{
+  GObject *child = G_OBJECT (item);
+  gboolean connect = FALSE;
+  BoundValues *bound;
+  GSList *p;
+  guint i;
+
+  bound = g_object_get_qdata (child, quark_bound_values);
+  if (!bound || bound->serial != binding->attributes_serial)
+    {
+      guint n_values = g_slist_length (binding->attributes);
+
+      /* follow the bound properties, rather than every property */
+      g_signal_handlers_disconnect_by_func (child,
+                                            mx_model_binding_item_notify_cb,
+                                            binding->view);
+      connect = TRUE;
+
+      bound = g_malloc0 (G_STRUCT_OFFSET (BoundValues, values) +
+                         n_values * sizeof (GValue));
+      bound->serial = binding->attributes_serial;
+      bound->n_values = n_values;
+      g_object_set_qdata_full (child, quark_bound_values, bound,
+                               (GDestroyNotify) mx_model_binding_bound_values_free);
+    }
+
+  binding->is_binding = TRUE;
+  g_object_freeze_notify (child);
+  for (p = binding->attributes, i = 0; p; p = p->next, i++)
+    {
+      GValue value = { 0, };
+      AttributeData *attr = p->data;
+      GValue *old_value = &bound->values[i];
+
+      /* look the property up once for each type of item */
+      if (attr->pspec_type != G_OBJECT_TYPE (child))
+        {
+          attr->pspec_type = G_OBJECT_TYPE (child);
+          attr->pspec =
+            g_object_class_find_property (G_OBJECT_GET_CLASS (child),
+                                          attr->name);
+          if (!attr->pspec)
+            g_warning ("%s: %s has no property named '%s'",
+                       G_STRLOC, G_OBJECT_TYPE_NAME (child), attr->name);
+        }
+
+      if (!attr->pspec)
+        continue;
+
+      if (connect)
+        {
+          gchar *signal = g_strconcat ("notify::", attr->pspec->name, NULL);
+
+          g_signal_connect_object (child, signal,
+                                   G_CALLBACK (mx_model_binding_item_notify_cb),
+                                   binding->view, 0);
+          g_free (signal);
+        }
+
+      clutter_model_iter_get_value (iter, attr->col, &value);
+
+      /* skip values that are the same as the ones last set */
+      if (G_IS_VALUE (old_value) &&
+          G_VALUE_TYPE (old_value) == G_VALUE_TYPE (&value) &&
+          G_VALUE_HOLDS (&value, G_PARAM_SPEC_VALUE_TYPE (attr->pspec)) &&
+          g_param_values_cmp (attr->pspec, &value, old_value) == 0)
+        {
+          g_value_unset (&value);
+          continue;
+        }
+
+      g_object_set_property (child, attr->pspec->name, &value);
+
+      /* keep the value for the next time the item is bound */
+      if (G_IS_VALUE (old_value))
+        g_value_unset (old_value);
+      *old_value = value;
+    }
+  g_object_thaw_notify (child);
+  binding->is_binding = FALSE;
+}
+
+/* Gets a child for a row, either one that was recycled or a new one */
+static ClutterActor *
+mx_model_binding_reuse_item (MxModelBinding *binding)
+{
+  ClutterActor *child;
+
+  if (binding->spare)
+    {
+      child = binding->spare->data;
+      binding->spare = g_slist_delete_link (binding->spare, binding->spare);
+      clutter_actor_show (child);
+    }
+  else
+    {
+      child = mx_model_binding_create_item (binding);
+      clutter_actor_add_child (binding->view, child);
+    }
+
+  return child;
+}
+
+static void
+mx_model_binding_recycle_item (MxModelBinding *binding,
+                               ClutterActor   *child)
+{
+  clutter_actor_hide (child);
+  binding->spare = g_slist_prepend (binding->spare, child);
+}
+
+static void
+mx_model_binding_insert_item (MxModelBinding *binding,
+                              guint           index_,
+                              ClutterActor   *child)
+{
+  GPtrArray *children = binding->children;
+
+  g_ptr_array_add (children, NULL);
+  memmove (children->pdata + index_ + 1, children->pdata + index_,
+           (children->len - index_ - 1) * sizeof (gpointer));
+  g_ptr_array_index (children, index_) = child;
+}
+
+/* Gives the rows from @first up to but not including @last a child each,
+ * reusing the children of the rows that are no longer in that range */
+void
+_mx_model_binding_set_rows (MxModelBinding *binding,
+                            gint            first,
+                            gint            last,
+                            gboolean        rebind)
+{
+  ClutterModelIter *iter = NULL;
+  GPtrArray *children;
+  gint row, iter_row = 0;
+  guint i;
+
+  children = g_ptr_array_sized_new (last - first);
+  g_ptr_array_set_size (children, last - first);
+
+  for (i = 0; i < binding->children->len; i++)
+    {
+      ClutterActor *child = g_ptr_array_index (binding->children, i);
+
+      row = binding->first_row + i;
+
+      if (row >= first && row < last)
+        g_ptr_array_index (children, row - first) = child;
+      else
+        mx_model_binding_recycle_item (binding, child);
+    }
+
+  for (row = first; row < last; row++)
+    {
+      ClutterActor *child = g_ptr_array_index (children, row - first);
+
+      if (child && !rebind)
+        continue;
+
+      if (!child)
+        {
+          child = mx_model_binding_reuse_item (binding);
+          g_ptr_array_index (children, row - first) = child;
+        }
+
+      if (!iter)
+        {
+          iter = clutter_model_get_iter_at_row (binding->model, row);
+          iter_row = row;
+        }
+
+      for (; iter_row < row; iter_row++)
+        clutter_model_iter_next (iter);
+
+      mx_model_binding_bind_item (binding, child, iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+
+  g_ptr_array_free (binding->children, TRUE);
+  binding->children = children;
+  binding->first_row = first;
+
+  clutter_actor_queue_relayout (binding->view);
+}
+
+/* Removes all the children of the view, including the spare ones */
+void
+_mx_model_binding_clear (MxModelBinding *binding)
+{
+  clutter_actor_remove_all_children (binding->view);
+
+  g_ptr_array_set_size (binding->children, 0);
+  binding->first_row = 0;
+
+  g_slist_free (binding->spare);
+  binding->spare = NULL;
+}
+
+/* Gives every row of the model a child with the values of the row, or in
+ * virtualized mode asks the view to bind the rows in view again */
+void
+_mx_model_binding_repopulate (MxModelBinding *binding)
+{
+  ClutterModelIter *iter = NULL;
+  guint i, model_n = 0;
+
+  /* bail out if we don't yet have an item type or a factory */
+  if (!binding->item_type && !binding->factory)
+    return;
+
+  if (binding->is_frozen)
+    {
+      binding->repopulate = TRUE;
+      return;
+    }
+
+  if (binding->item_type)
+    {
+      /* check the item-type is an descendant of ClutterActor */
+      if (!g_type_is_a (binding->item_type, CLUTTER_TYPE_ACTOR))
+        {
+          g_warning ("%s is not a subclass of ClutterActor and therefore"
+                     " cannot be used as items in an %s",
+                     g_type_name (binding->item_type),
+                     G_OBJECT_TYPE_NAME (binding->view));
+          return;
+        }
+    }
+
+  if (binding->virtualized)
+    {
+      if (binding->model)
+        binding->update_func (binding->view, TRUE);
+      return;
+    }
+
+  if (binding->model)
+    model_n = clutter_model_get_n_rows (binding->model);
+  else
+    model_n = 0;
+
+  /* remove children as needed */
+  while (binding->children->len > model_n)
+    {
+      ClutterActor *child;
+
+      child = g_ptr_array_index (binding->children,
+                                 binding->children->len - 1);
+      g_ptr_array_remove_index (binding->children,
+                                binding->children->len - 1);
+
+      clutter_actor_remove_child (binding->view, child);
+    }
+
+  /* add children as needed */
+  while (binding->children->len < model_n)
+    {
+      ClutterActor *new_child;
+
+      new_child = mx_model_binding_create_item (binding);
+
+      clutter_actor_add_child (binding->view, new_child);
+      g_ptr_array_add (binding->children, new_child);
+    }
+
+  if (!binding->model)
+    return;
+
+  /* set the properties on the children */
+  iter = clutter_model_get_first_iter (binding->model);
+  i = 0;
+  while (iter && !clutter_model_iter_is_last (iter))
+    {
+      mx_model_binding_bind_item (binding,
+                                  g_ptr_array_index (binding->children, i++),
+                                  iter);
+
+      clutter_model_iter_next (iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+}
+
+static void
+model_changed_cb (ClutterModel   *model,
+                  MxModelBinding *binding)
+{
+  _mx_model_binding_repopulate (binding);
+}
+
+/* Records a change to the model while the view is frozen, merging it with
+ * the previous change when they are to adjacent rows */
+static void
+mx_model_binding_record_change (MxModelBinding *binding,
+                                RowsChangeType  type,
+                                gint            row)
+{
+  RowsChange change, *last;
+
+  /* a virtualized view only has a few children to rebind anyway */
+  if (binding->repopulate || binding->virtualized)
+    {
+      binding->repopulate = TRUE;
+      return;
+    }
+
+  if (binding->changes->len > 0)
+    {
+      last = &g_array_index (binding->changes, RowsChange,
+                             binding->changes->len - 1);
+
+      if (last->type == type)
+        switch (type)
+          {
+          case ROWS_ADDED:
+            /* a row added inside the added rows or at either end */
+            if (row >= last->row && row <= last->row + last->n_rows)
+              {
+                last->n_rows++;
+                return;
+              }
+            break;
+
+          case ROWS_REMOVED:
+            /* the row after or before the removed rows */
+            if (row == last->row || row + 1 == last->row)
+              {
+                last->row = row;
+                last->n_rows++;
+                return;
+              }
+            break;
+
+          case ROWS_CHANGED:
+            if (row >= last->row && row < last->row + last->n_rows)
+              return;
+
+            if (row == last->row + last->n_rows || row + 1 == last->row)
+              {
+                last->row = MIN (last->row, row);
+                last->n_rows++;
+                return;
+              }
+            break;
+          }
+    }
+
+  if (binding->changes->len >= MAX_RECORDED_CHANGES)
+    {
+      binding->repopulate = TRUE;
+      g_array_set_size (binding->changes, 0);
+      return;
+    }
+
+  change.type = type;
+  change.row = row;
+  change.n_rows = 1;
+  g_array_append_val (binding->changes, change);
+}
+
+/* Applies the changes recorded while the view was frozen. The children of
+ * rows that are still in the model are kept as they are, the children of
+ * removed rows are reused for added rows, and only the added rows and the
+ * changed rows are bound again. Returns %FALSE if the changes don't match
+ * the model, in which case the view needs repopulating */
+static gboolean
+mx_model_binding_apply_changes (MxModelBinding *binding)
+{
+  ClutterActor *self = binding->view;
+  ClutterModelIter *iter = NULL;
+  GPtrArray *recycled;
+  GArray *slots;
+  gint i, tail, iter_row = 0;
+  guint c;
+
+  slots = g_array_sized_new (FALSE, TRUE, sizeof (RowSlot),
+                             binding->children->len);
+  g_array_set_size (slots, binding->children->len);
+  for (i = 0; i < (gint) binding->children->len; i++)
+    g_array_index (slots, RowSlot, i).child =
+      g_ptr_array_index (binding->children, i);
+
+  recycled = g_ptr_array_new ();
+
+  for (c = 0; c < binding->changes->len; c++)
+    {
+      RowsChange *change = &g_array_index (binding->changes, RowsChange, c);
+      gint first, last;
+
+      first = CLAMP (change->row, 0, (gint) slots->len);
+      last = CLAMP (change->row + change->n_rows, first, (gint) slots->len);
+
+      switch (change->type)
+        {
+        case ROWS_ADDED:
+          g_array_set_size (slots, slots->len + change->n_rows);
+          memmove (&g_array_index (slots, RowSlot, first + change->n_rows),
+                   &g_array_index (slots, RowSlot, first),
+                   (slots->len - change->n_rows - first) * sizeof (RowSlot));
+          memset (&g_array_index (slots, RowSlot, first), 0,
+                  change->n_rows * sizeof (RowSlot));
+          break;
+
+        case ROWS_REMOVED:
+          for (i = first; i < last; i++)
+            if (g_array_index (slots, RowSlot, i).child)
+              g_ptr_array_add (recycled,
+                               g_array_index (slots, RowSlot, i).child);
+          g_array_remove_range (slots, first, last - first);
+          break;
+
+        case ROWS_CHANGED:
+          for (i = first; i < last; i++)
+            g_array_index (slots, RowSlot, i).dirty = TRUE;
+          break;
+        }
+    }
+
+  if (slots->len != clutter_model_get_n_rows (binding->model))
+    {
+      g_array_free (slots, TRUE);
+      g_ptr_array_free (recycled, TRUE);
+      return FALSE;
+    }
+
+  /* give the added rows children, moving them after all the others */
+  for (i = 0; i < (gint) slots->len; i++)
+    {
+      RowSlot *slot = &g_array_index (slots, RowSlot, i);
+
+      if (slot->child)
+        continue;
+
+      if (recycled->len > 0)
+        {
+          slot->child = g_ptr_array_index (recycled, recycled->len - 1);
+          g_ptr_array_remove_index (recycled, recycled->len - 1);
+          clutter_actor_set_child_above_sibling (self, slot->child, NULL);
+        }
+      else
+        {
+          slot->child = mx_model_binding_create_item (binding);
+          clutter_actor_add_child (self, slot->child);
+        }
+
+      slot->dirty = slot->is_new = TRUE;
+    }
+
+  for (c = 0; c < recycled->len; c++)
+    clutter_actor_remove_child (self, g_ptr_array_index (recycled, c));
+
+  /* the children of added rows are now in order after the others, so only
+   * those before the last kept child need moving into place */
+  for (tail = slots->len;
+       tail > 0 && g_array_index (slots, RowSlot, tail - 1).is_new;
+       tail--);
+
+  for (i = 0; i < tail; i++)
+    {
+      RowSlot *slot = &g_array_index (slots, RowSlot, i);
+
+      if (slot->is_new)
+        clutter_actor_set_child_at_index (self, slot->child, i);
+    }
+
+  g_ptr_array_set_size (binding->children, slots->len);
+
+  for (i = 0; i < (gint) slots->len; i++)
+    {
+      RowSlot *slot = &g_array_index (slots, RowSlot, i);
+
+      g_ptr_array_index (binding->children, i) = slot->child;
+
+      if (!slot->dirty)
+        continue;
+
+      if (!iter)
+        {
+          iter = clutter_model_get_iter_at_row (binding->model, i);
+          iter_row = i;
+        }
+
+      for (; iter_row < i; iter_row++)
+        clutter_model_iter_next (iter);
+
+      mx_model_binding_bind_item (binding, slot->child, iter);
+    }
+
+  if (iter)
+    g_object_unref (iter);
+
+  g_array_free (slots, TRUE);
+  g_ptr_array_free (recycled, TRUE);
+
+  return TRUE;
+}
+
+static void
+row_added_cb (ClutterModel     *model,
+              ClutterModelIter *iter,
+              MxModelBinding   *binding)
+{
+  ClutterActor *child;
+  gint row;
+
+  if (!binding->item_type && !binding->factory)
+    return;
+
+  /* the rows of a filtered model don't map straight to children */
+  if (clutter_model_get_filter_set (model))
+    {
+      _mx_model_binding_repopulate (binding);
+      return;
+    }
+
+  if (binding->is_frozen)
+    {
+      mx_model_binding_record_change (binding, ROWS_ADDED,
+                                      clutter_model_iter_get_row (iter));
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter) - binding->first_row;
+
+  if (!binding->virtualized)
+    {
+      if (row > (gint) binding->children->len)
+        {
+          _mx_model_binding_repopulate (binding);
+          return;
+        }
+
+      child = mx_model_binding_create_item (binding);
+      clutter_actor_insert_child_at_index (binding->view, child, row);
+      mx_model_binding_insert_item (binding, row, child);
+      mx_model_binding_bind_item (binding, child, iter);
+      return;
+    }
+
+  if (row < 0)
+    {
+      /* the rows with children have all moved down */
+      binding->first_row++;
+    }
+  else if (row < (gint) binding->children->len)
+    {
+      /* the child of the last row makes way for the new row */
+      child = g_ptr_array_index (binding->children,
+                                 binding->children->len - 1);
+      g_ptr_array_remove_index (binding->children,
+                                binding->children->len - 1);
+      mx_model_binding_recycle_item (binding, child);
+
+      child = mx_model_binding_reuse_item (binding);
+      mx_model_binding_insert_item (binding, row, child);
+      mx_model_binding_bind_item (binding, child, iter);
+    }
+
+  clutter_actor_queue_relayout (binding->view);
+  binding->update_func (binding->view, FALSE);
+}
+
+static void
+row_changed_cb (ClutterModel     *model,
+                ClutterModelIter *iter,
+                MxModelBinding   *binding)
+{
+  gint row;
+
+  if (!binding->item_type && !binding->factory)
+    return;
+
+  /* the rows of a filtered model don't map straight to children */
+  if (clutter_model_get_filter_set (model))
+    {
+      _mx_model_binding_repopulate (binding);
+      return;
+    }
+
+  if (binding->is_frozen)
+    {
+      mx_model_binding_record_change (binding, ROWS_CHANGED,
+                                      clutter_model_iter_get_row (iter));
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter) - binding->first_row;
+
+  /* only the child of the row needs its properties setting again */
+  if (row >= 0 && row < (gint) binding->children->len)
+    mx_model_binding_bind_item (binding,
+                                g_ptr_array_index (binding->children, row),
+                                iter);
+}
+
+static void
+row_removed_cb (ClutterModel     *model,
+                ClutterModelIter *iter,
+                MxModelBinding   *binding)
+{
+  ClutterActor *child;
+  gint row;
+
+  if (!binding->item_type && !binding->factory)
+    return;
+
+  /* the rows of a filtered model don't map straight to children */
+  if (clutter_model_get_filter_set (model))
+    {
+      _mx_model_binding_repopulate (binding);
+      return;
+    }
+
+  if (binding->is_frozen)
+    {
+      mx_model_binding_record_change (binding, ROWS_REMOVED,
+                                      clutter_model_iter_get_row (iter));
+      return;
+    }
+
+  row = clutter_model_iter_get_row (iter) - binding->first_row;
+
+  if (row < 0)
+    {
+      /* the rows with children have all moved up */
+      binding->first_row--;
+    }
+  else if (row < (gint) binding->children->len)
+    {
+      child = g_ptr_array_index (binding->children, row);
+      g_ptr_array_remove_index (binding->children, row);
+
+      if (binding->virtualized)
+        mx_model_binding_recycle_item (binding, child);
+      else
+        clutter_actor_remove_child (binding->view, child);
+    }
+  else if (!binding->virtualized)
+    {
+      _mx_model_binding_repopulate (binding);
+      return;
+    }
+
+  if (binding->virtualized)
+    {
+      clutter_actor_queue_relayout (binding->view);
+      binding->update_func (binding->view, FALSE);
+    }
+}
+
+/* Sets up @binding for the children of @view. @update_func is called to
+ * give the rows in view children when @view is virtualized */
+void
+_mx_model_binding_init (MxModelBinding           *binding,
+                        ClutterActor             *view,
+                        MxModelBindingUpdateFunc  update_func)
+{
+  if (G_UNLIKELY (!quark_model_binding))
+    {
+      quark_bound_values =
+        g_quark_from_static_string ("mx-model-binding-bound-values");
+      quark_model_binding =
+        g_quark_from_static_string ("mx-model-binding");
+    }
+
+  binding->view = view;
+  binding->update_func = update_func;
+  binding->children = g_ptr_array_new ();
+  binding->changes = g_array_new (FALSE, FALSE, sizeof (RowsChange));
+
+  g_object_set_qdata (G_OBJECT (view), quark_model_binding, binding);
+}
+
+/* Drops the model and the factory, keeping the children */
+void
+_mx_model_binding_dispose (MxModelBinding *binding)
+{
+  /* This will cause the unref of the model and also disconnect the signals */
+  _mx_model_binding_set_model (binding, NULL);
+
+  if (binding->factory)
+    {
+      g_object_unref (binding->factory);
+      binding->factory = NULL;
+    }
+}
+
+static void
+free_attribute (AttributeData *data)
+{
+  g_free (data->name);
+  g_free (data);
+}
+
+void
+_mx_model_binding_finalize (MxModelBinding *binding)
+{
+  if (binding->attributes)
+    {
+      g_slist_foreach (binding->attributes, (GFunc) free_attribute, NULL);
+      g_slist_free (binding->attributes);
+      binding->attributes = NULL;
+    }
+
+  g_ptr_array_free (binding->children, TRUE);
+  g_slist_free (binding->spare);
+  g_array_free (binding->changes, TRUE);
+}
+
+void
+_mx_model_binding_set_model (MxModelBinding *binding,
+                             ClutterModel   *model)
+{
+  if (binding->model)
+    {
+      g_signal_handlers_disconnect_by_func (binding->model,
+                                            (GCallback) model_changed_cb,
+                                            binding);
+      g_signal_handlers_disconnect_by_func (binding->model,
+                                            (GCallback) row_added_cb,
+                                            binding);
+      g_signal_handlers_disconnect_by_func (binding->model,
+                                            (GCallback) row_changed_cb,
+                                            binding);
+      g_signal_handlers_disconnect_by_func (binding->model,
+                                            (GCallback) row_removed_cb,
+                                            binding);
+      g_object_unref (binding->model);
+
+      binding->model = NULL;
+    }
+
+  if (model)
+    {
+      binding->model = g_object_ref (model);
+
+      binding->filter_changed = g_signal_connect (binding->model,
+                                                  "filter-changed",
+                                                  G_CALLBACK (model_changed_cb),
+                                                  binding);
+
+      binding->row_added = g_signal_connect (binding->model,
+                                             "row-added",
+                                             G_CALLBACK (row_added_cb),
+                                             binding);
+
+      binding->row_changed = g_signal_connect (binding->model,
+                                               "row-changed",
+                                               G_CALLBACK (row_changed_cb),
+                                               binding);
+
+      /*
+       * row_removed_cb (and _mx_model_binding_repopulate, called from it)
+       * expect the row to already have been removed, thus we need to use
+       * _after
+       */
+      binding->row_removed = g_signal_connect_after (binding->model,
+                                                     "row-removed",
+                                                     G_CALLBACK (row_removed_cb),
+                                                     binding);
+
+      binding->sort_changed = g_signal_connect (binding->model,
+                                                "sort-changed",
+                                                G_CALLBACK (model_changed_cb),
+                                                binding);
+
+      /*
+       * Only do this inside this block, setting the model to NULL should have
+       * the effect of preserving the view; just disconnect the handlers
+       */
+      _mx_model_binding_repopulate (binding);
+    }
+}
+
+/* Returns %TRUE if the factory changed */
+gboolean
+_mx_model_binding_set_factory (MxModelBinding *binding,
+                               MxItemFactory  *factory)
+{
+  if (binding->factory == factory)
+    return FALSE;
+
+  if (binding->factory)
+    {
+      g_object_unref (binding->factory);
+      binding->factory = NULL;
+    }
+
+  if (factory)
+    binding->factory = g_object_ref (factory);
+
+  return TRUE;
+}
+
+void
+_mx_model_binding_add_attribute (MxModelBinding *binding,
+                                 const gchar    *name,
+                                 gint            column)
+{
+  AttributeData *prop;
+
+  prop = g_new0 (AttributeData, 1);
+  prop->name = g_strdup (name);
+  prop->col = column;
+
+  binding->attributes = g_slist_prepend (binding->attributes, prop);
+  binding->attributes_serial++;
+  _mx_model_binding_repopulate (binding);
+}
+
+/* Applies the changes made to the model while @binding was frozen, or
+ * repopulates the view if they can't be applied */
+void
+_mx_model_binding_thaw (MxModelBinding *binding)
+{
+  binding->is_frozen = FALSE;
+
+  if (binding->repopulate || binding->virtualized || !binding->model ||
+      !mx_model_binding_apply_changes (binding))
+    {
+      /* Repopulate */
+      _mx_model_binding_repopulate (binding);
+    }
+
+  g_array_set_size (binding->changes, 0);
+  binding->repopulate = FALSE;
+}
@@ -28,7 +28,10 @@ static GDebugKey debug_keys[] =
     {"layout", MX_DEBUG_LAYOUT},
     {"inspector", MX_DEBUG_INSPECTOR},
     {"focus", MX_DEBUG_FOCUS},
-    {"css", MX_DEBUG_CSS}
+    {"css", MX_DEBUG_CSS},
+    {"style-cache", MX_DEBUG_STYLE_CACHE},
+    {"texture-cache", MX_DEBUG_TEXTURE_CACHE},
+    {"no-css-index", MX_DEBUG_NO_CSS_INDEX}
 };
 
 
@@ -83,9 +83,38 @@ CoglHandle _mx_window_get_icon_cogl_texture (MxWindow *window);
 
 ClutterActor * _mx_window_get_resize_grip (MxWindow *window);
 
-void _mx_style_invalidate_cache (MxStylable *stylable);
+void     _mx_style_invalidate_cache         (MxStylable *stylable);
+void     _mx_style_mark_descendants_styled  (MxStylable *stylable);
+gboolean _mx_style_descendants_need_restyle (MxStyle    *style,
+                                             MxStylable *stylable);
 
-gchar * _mx_stylable_get_style_string (MxStylable *stylable);
+GPtrArray * _mx_stylable_get_inherited_properties (void);
+
+/* A style node describes everything about a stylable that can be matched
+ * against in CSS: its type, name, style class and pseudo-class, and the node
+ * of its closest stylable ancestor. Nodes are interned, so stylables that
+ * would match the same selectors share the same node.
+ */
+typedef struct _MxStyleNode MxStyleNode;
+struct _MxStyleNode
+{
+  MxStyleNode *parent;
+  GType        type;
+  gchar       *id;
+  gchar       *class;
+  gchar       *pseudo_class;
+
+  guint        hash;
+  gint         ref_count;
+};
+
+MxStyleNode * _mx_style_node_get     (MxStyleNode *parent,
+                                      MxStylable  *stylable);
+gboolean      _mx_style_node_matches (MxStyleNode *node,
+                                      MxStyleNode *parent,
+                                      MxStylable  *stylable);
+MxStyleNode * _mx_style_node_ref     (MxStyleNode *node);
+void          _mx_style_node_unref   (MxStyleNode *node);
 
 const gchar * _mx_enum_to_string (GType type,
                                   gint  value);
@@ -108,6 +137,68 @@ void _mx_paint_texture_with_opacity (CoglHandle texture,
 
 gboolean _mx_settings_get_touch_mode (MxSettings *settings);
 
+/* The children of MxListView and MxItemView, one for each row of the model
+ * or in virtualized mode for the rows from first_row, with the model
+ * columns bound to their properties. The views embed this in their private
+ * structure and only lay the children out.
+ */
+typedef void (* MxModelBindingUpdateFunc) (ClutterActor *view,
+                                           gboolean      rebind);
+
+typedef struct _MxModelBinding MxModelBinding;
+struct _MxModelBinding
+{
+  ClutterActor             *view;
+  MxModelBindingUpdateFunc  update_func;
+
+  ClutterModel             *model;
+  GSList                   *attributes;
+  guint                     attributes_serial;
+  GType                     item_type;
+  MxItemFactory            *factory;
+
+  gulong                    filter_changed;
+  gulong                    row_added;
+  gulong                    row_changed;
+  gulong                    row_removed;
+  gulong                    sort_changed;
+
+  guint                     is_frozen : 1;
+  guint                     is_binding : 1;
+  guint                     repopulate : 1;
+  guint                     virtualized : 1;
+
+  /* the changes to the model while frozen, if the view can apply them
+   * rather than repopulating */
+  GArray                   *changes;
+
+  /* the children of the rows from first_row, and in virtualized mode the
+   * hidden children waiting to be reused */
+  GPtrArray                *children;
+  gint                      first_row;
+  GSList                   *spare;
+};
+
+void     _mx_model_binding_init          (MxModelBinding           *binding,
+                                          ClutterActor             *view,
+                                          MxModelBindingUpdateFunc  update_func);
+void     _mx_model_binding_dispose       (MxModelBinding           *binding);
+void     _mx_model_binding_finalize      (MxModelBinding           *binding);
+void     _mx_model_binding_set_model     (MxModelBinding           *binding,
+                                          ClutterModel             *model);
+gboolean _mx_model_binding_set_factory   (MxModelBinding           *binding,
+                                          MxItemFactory            *factory);
+void     _mx_model_binding_add_attribute (MxModelBinding           *binding,
+                                          const gchar              *name,
+                                          gint                      column);
+void     _mx_model_binding_thaw          (MxModelBinding           *binding);
+void     _mx_model_binding_repopulate    (MxModelBinding           *binding);
+void     _mx_model_binding_clear         (MxModelBinding           *binding);
+void     _mx_model_binding_set_rows      (MxModelBinding           *binding,
+                                          gint                      first,
+                                          gint                      last,
+                                          gboolean                  rebind);
+
 
 typedef enum
 {
@@ -115,7 +206,9 @@ typedef enum
   MX_DEBUG_INSPECTOR   = 1 << 1,
   MX_DEBUG_FOCUS       = 1 << 2,
   MX_DEBUG_CSS         = 1 << 3,
-  MX_DEBUG_STYLE_CACHE = 1 << 4
+  MX_DEBUG_STYLE_CACHE = 1 << 4,
+  MX_DEBUG_TEXTURE_CACHE = 1 << 5,
+  MX_DEBUG_NO_CSS_INDEX  = 1 << 6
 } MxDebugTopic;
 
 gboolean _mx_debug (gint debug);
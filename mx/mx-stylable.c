@@ -65,8 +65,32 @@ static GObjectNotifyContext property_notify_context = { 0, };
 
 static GParamSpecPool *style_property_spec_pool = NULL;
 
+/* names of the style properties installed with MX_PARAM_STYLE_INHERIT */
+static GPtrArray *inherited_style_properties = NULL;
+
 static GQuark quark_real_owner         = 0;
 static GQuark quark_style              = 0;
+static GQuark quark_style_queue        = 0;
+
+/* Set on queued style changes that must be propagated to the children of
+ * the stylable, as opposed to a change of its name, class or pseudo-class
+ * that may only affect the stylable itself. */
+#define MX_STYLE_CHANGED_QUEUED_SUBTREE (1 << 16)
+
+/* The style changes queued on a stage, resolved before its next frame */
+typedef struct
+{
+  GHashTable *pending;
+  guint       repaint_id;
+} MxStyleQueue;
+
+/* A queued style change, and the depth of its stylable in the stage */
+typedef struct
+{
+  MxStylable *stylable;
+  guint       queued;
+  guint       depth;
+} MxQueuedStyleChange;
 
 static guint stylable_signals[LAST_SIGNAL] = { 0, };
 
@@ -122,6 +146,8 @@ mx_stylable_base_init (gpointer g_iface)
   quark_real_owner =
     g_quark_from_static_string ("mx-stylable-real-owner-quark");
   quark_style = g_quark_from_static_string ("mx-stylable-style-quark");
+  quark_style_queue =
+    g_quark_from_static_string ("mx-stylable-style-queue-quark");
 
   style_property_spec_pool = g_param_spec_pool_new (FALSE);
 
@@ -203,80 +229,126 @@ mx_stylable_get_type (void)
   return our_type;
 }
 
-static void
-_mx_stylable_prepend_style_string (GString    *string,
-                                   MxStylable *stylable)
+/* Style nodes are interned, so that two stylables with the same matchable
+ * properties and equivalent ancestors share the same node. The table does
+ * not hold a reference, nodes remove themselves when they are freed.
+ */
+static GHashTable *style_nodes = NULL;
+
+static guint
+mx_style_node_hash (gconstpointer key)
 {
-  GType type_id;
-  gchar *style_string;
-  const gchar *type, *id, *class, *pseudo_class;
+  const MxStyleNode *node = key;
 
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+  return node->hash;
+}
 
-  id = clutter_actor_get_name ((ClutterActor*) stylable);
+static gboolean
+mx_style_node_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  const MxStyleNode *node_a = a;
+  const MxStyleNode *node_b = b;
+
+  return (node_a->hash == node_b->hash &&
+          node_a->parent == node_b->parent &&
+          node_a->type == node_b->type &&
+          !g_strcmp0 (node_a->id, node_b->id) &&
+          !g_strcmp0 (node_a->class, node_b->class) &&
+          !g_strcmp0 (node_a->pseudo_class, node_b->pseudo_class));
+}
 
-  class = mx_stylable_get_style_class (stylable);
+static void
+mx_style_node_init_key (MxStyleNode *key,
+                        MxStyleNode *parent,
+                        MxStylable  *stylable)
+{
+  guint hash;
+
+  key->parent = parent;
+  key->type = G_OBJECT_TYPE (stylable);
+  key->id = (gchar *) clutter_actor_get_name ((ClutterActor *) stylable);
+  key->class = (gchar *) mx_stylable_get_style_class (stylable);
+  key->pseudo_class = (gchar *) mx_stylable_get_style_pseudo_class (stylable);
+
+  /* the parent is interned, so its address identifies the whole chain of
+   * ancestors */
+  hash = g_direct_hash (parent);
+  hash = hash * 31 + (guint) key->type;
+  hash = hash * 31 + (key->id ? g_str_hash (key->id) : 0);
+  hash = hash * 31 + (key->class ? g_str_hash (key->class) : 0);
+  hash = hash * 31 + (key->pseudo_class ? g_str_hash (key->pseudo_class) : 0);
+  key->hash = hash;
+}
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+/* Returns whether @node still describes @stylable, with @parent as the
+ * node of its closest stylable ancestor */
+gboolean
+_mx_style_node_matches (MxStyleNode *node,
+                        MxStyleNode *parent,
+                        MxStylable  *stylable)
+{
+  MxStyleNode key;
+
+  mx_style_node_init_key (&key, parent, stylable);
 
-  style_string = g_strconcat (type,
-                              "#", id ? id : "",
-                              ".", class ? class : "",
-                              ":", pseudo_class ? pseudo_class : "",
-                              ">",
-                              NULL);
-  g_string_prepend (string, style_string);
-  g_free (style_string);
+  return mx_style_node_equal (node, &key);
 }
 
-gchar *
-_mx_stylable_get_style_string (MxStylable *stylable)
+/* Returns a new reference to the node describing @stylable, with @parent as
+ * the node of its closest stylable ancestor */
+MxStyleNode *
+_mx_style_node_get (MxStyleNode *parent,
+                    MxStylable  *stylable)
 {
-  GType type_id;
-  gchar *cstring;
-  GString *string;
-  const gchar *type, *id, *class, *pseudo_class;
-  ClutterActor *actor;
-  ClutterActor *parent;
+  MxStyleNode key, *node;
 
-  /* Create a string that contains all the properties of a
-   * Stylable that can be matched against in the CSS.
-   */
-  type_id = G_OBJECT_CLASS_TYPE (G_OBJECT_GET_CLASS (stylable));
-  type = g_type_name (type_id);
+  if (G_UNLIKELY (!style_nodes))
+    style_nodes = g_hash_table_new (mx_style_node_hash, mx_style_node_equal);
 
-  actor = CLUTTER_ACTOR (stylable);
+  mx_style_node_init_key (&key, parent, stylable);
 
-  id = clutter_actor_get_name (actor);
+  node = g_hash_table_lookup (style_nodes, &key);
+  if (node)
+    return _mx_style_node_ref (node);
 
-  class = mx_stylable_get_style_class (stylable);
+  node = g_slice_new (MxStyleNode);
+  node->ref_count = 1;
+  node->hash = key.hash;
+  node->parent = parent ? _mx_style_node_ref (parent) : NULL;
+  node->type = key.type;
+  node->id = g_strdup (key.id);
+  node->class = g_strdup (key.class);
+  node->pseudo_class = g_strdup (key.pseudo_class);
 
-  pseudo_class = mx_stylable_get_style_pseudo_class (stylable);
+  g_hash_table_add (style_nodes, node);
 
-  string = g_string_sized_new (512);
+  return node;
+}
 
-  /* Add the actor hierarchy */
-  parent = clutter_actor_get_parent (actor);
+MxStyleNode *
+_mx_style_node_ref (MxStyleNode *node)
+{
+  node->ref_count++;
 
-  while (parent)
-    {
-      if (MX_IS_STYLABLE (parent))
-        _mx_stylable_prepend_style_string (string, (MxStylable*) parent);
+  return node;
+}
 
-      parent = clutter_actor_get_parent (parent);
-    }
+void
+_mx_style_node_unref (MxStyleNode *node)
+{
+  if (--node->ref_count > 0)
+    return;
 
-  g_string_append_printf (string, "%s#%s.%s:%s",
-                          type,
-                          id ? id : "",
-                          class ? class : "",
-                          pseudo_class ? pseudo_class : "");
+  g_hash_table_remove (style_nodes, node);
 
-  cstring = string->str;
-  g_string_free (string, FALSE);
+  if (node->parent)
+    _mx_style_node_unref (node->parent);
 
-  return cstring;
+  g_free (node->id);
+  g_free (node->class);
+  g_free (node->pseudo_class);
+  g_slice_free (MxStyleNode, node);
 }
 
 #if 0
@@ -415,6 +487,30 @@ mx_stylable_iface_install_property (MxStylableIface *iface,
   g_param_spec_pool_insert (style_property_spec_pool,
                             pspec,
                             owner_type);
+
+  if (pspec->flags & MX_PARAM_STYLE_INHERIT)
+    {
+      guint i;
+
+      if (!inherited_style_properties)
+        inherited_style_properties = g_ptr_array_new ();
+
+      for (i = 0; i < inherited_style_properties->len; i++)
+        if (g_str_equal (g_ptr_array_index (inherited_style_properties, i),
+                         pspec->name))
+          break;
+
+      if (i == inherited_style_properties->len)
+        g_ptr_array_add (inherited_style_properties, (gpointer) pspec->name);
+    }
+}
+
+/* Returns the names of all the style properties that are inherited from
+ * the parent when they are not set, or %NULL if there are none */
+GPtrArray *
+_mx_stylable_get_inherited_properties (void)
+{
+  return inherited_style_properties;
 }
 
 /**
@@ -1033,12 +1129,32 @@ mx_stylable_set_style_class (MxStylable  *stylable,
                g_type_name (G_OBJECT_TYPE (stylable)));
 }
 
+static void mx_stylable_queue_style_changed_internal (MxStylable *stylable,
+                                                      guint       queued);
+
 static void
 mx_stylable_property_changed_notify (MxStylable *stylable)
 {
+  mx_stylable_queue_style_changed_internal (stylable,
+                                            MX_STYLE_CHANGED_INVALIDATE_CACHE |
+                                            MX_STYLE_CHANGED_QUEUED_SUBTREE);
+}
+
+static void
+mx_stylable_realized_notify (MxStylable *stylable)
+{
+  /* the first style of the stylable is applied straight away, so that it
+   * is in place by the time it is first allocated */
   mx_stylable_style_changed (stylable, MX_STYLE_CHANGED_INVALIDATE_CACHE);
 }
 
+static void
+mx_stylable_selector_changed_notify (MxStylable *stylable)
+{
+  mx_stylable_queue_style_changed_internal (stylable,
+                                            MX_STYLE_CHANGED_INVALIDATE_CACHE);
+}
+
 static void
 mx_stylable_parent_set_notify (ClutterActor *actor,
                                ClutterActor *old_parent)
@@ -1048,42 +1164,60 @@ mx_stylable_parent_set_notify (ClutterActor *actor,
   /* check the actor has a new parent */
   if (new_parent)
     {
-      mx_stylable_style_changed (MX_STYLABLE (actor),
-                                 MX_STYLE_CHANGED_INVALIDATE_CACHE);
+      mx_stylable_property_changed_notify (MX_STYLABLE (actor));
     }
 }
 
-static void mx_stylable_style_changed_internal (MxStylable          *stylable,
-                                                MxStyleChangedFlags  flags);
-
-static void
-mx_stylable_style_changed_internal (MxStylable          *stylable,
-                                    MxStyleChangedFlags  flags)
+/* Restyles @stylable itself, returning %FALSE if it isn't realized and so
+ * neither it nor its children should be restyled */
+static gboolean
+mx_stylable_style_changed_self (MxStylable          *stylable,
+                                MxStyleChangedFlags *flags)
 {
-  ClutterActorIter iter;
-  MxStylable *child;
+  /* the cached style node is reset even on unrealized stylables, so that it
+   * gets rebuilt if the stylable is queried before it is realized */
+  if ((*flags & MX_STYLE_CHANGED_INVALIDATE_CACHE) && MX_IS_STYLABLE (stylable))
+    _mx_style_invalidate_cache (stylable);
 
   /* don't update stylables until they are realized (unless ensure is set) */
   if (G_LIKELY (CLUTTER_IS_ACTOR (stylable)) &&
       !CLUTTER_ACTOR_IS_REALIZED (CLUTTER_ACTOR (stylable)) &&
-      !(flags & MX_STYLE_CHANGED_FORCE))
-    return;
+      !(*flags & MX_STYLE_CHANGED_FORCE))
+    return FALSE;
 
   if (MX_IS_STYLABLE (stylable))
     {
-      if (flags & MX_STYLE_CHANGED_INVALIDATE_CACHE)
-        _mx_style_invalidate_cache (stylable);
-
       /* If the parent style has changed, child cache needs to be
        * invalidated. This needs to happen for internal children as
        * well, which is why it's here and not in the container block
        * lower down.
        */
-      flags |= MX_STYLE_CHANGED_INVALIDATE_CACHE;
+      *flags |= MX_STYLE_CHANGED_INVALIDATE_CACHE;
 
-      g_signal_emit (stylable, stylable_signals[STYLE_CHANGED], 0, flags);
+      g_signal_emit (stylable, stylable_signals[STYLE_CHANGED], 0, *flags);
     }
 
+  return TRUE;
+}
+
+static void
+mx_stylable_style_changed_internal (MxStylable          *stylable,
+                                    MxStyleChangedFlags  flags)
+{
+  ClutterActorIter iter;
+  MxStylable *child;
+
+  if (!mx_stylable_style_changed_self (stylable, &flags))
+    return;
+
+  if (clutter_actor_get_n_children (CLUTTER_ACTOR (stylable)) == 0)
+    return;
+
+  /* remember what the children were styled against, so that a later change
+   * to this stylable can tell whether they need restyling */
+  if (MX_IS_STYLABLE (stylable))
+    _mx_style_mark_descendants_styled (stylable);
+
   /* propagate the style-changed signal to children, since their style may
    * depend on one or more properties of the parent */
   clutter_actor_iter_init (&iter, CLUTTER_ACTOR (stylable));
@@ -1105,15 +1239,278 @@ mx_stylable_style_changed_internal (MxStylable          *stylable,
  * propagated to it's children, since their style may depend on one or more
  * properties of the parent.
  *
+ * The signal is emitted synchronously, and replaces any style change queued
+ * on @stylable with mx_stylable_queue_style_changed().
+ *
  */
 void
 mx_stylable_style_changed (MxStylable *stylable, MxStyleChangedFlags flags)
 {
+  ClutterActor *stage;
+  MxStyleQueue *queue;
+
   g_return_if_fail (MX_IS_STYLABLE (stylable));
 
+  /* any change queued on the stylable is superseded by this one */
+  stage = clutter_actor_get_stage (CLUTTER_ACTOR (stylable));
+  queue = stage ? g_object_get_qdata (G_OBJECT (stage), quark_style_queue) : NULL;
+  if (queue)
+    g_hash_table_remove (queue->pending, stylable);
+
   mx_stylable_style_changed_internal (stylable, flags);
 }
 
+static void
+mx_stylable_apply_queued_style_changed (MxStylable *stylable,
+                                        guint       queued)
+{
+  MxStyleChangedFlags flags = queued & ~MX_STYLE_CHANGED_QUEUED_SUBTREE;
+  MxStyle *style;
+
+  if (queued & MX_STYLE_CHANGED_QUEUED_SUBTREE)
+    {
+      mx_stylable_style_changed_internal (stylable, flags);
+      return;
+    }
+
+  /* If the name, class or pseudo-class change can't affect which selectors
+   * match the descendants, and none of the values they inherit changed,
+   * only this stylable needs to be restyled */
+  style = mx_stylable_get_style (stylable);
+  if (style &&
+      CLUTTER_ACTOR_IS_REALIZED (CLUTTER_ACTOR (stylable)) &&
+      !_mx_style_descendants_need_restyle (style, stylable))
+    mx_stylable_style_changed_self (stylable, &flags);
+  else
+    mx_stylable_style_changed_internal (stylable, flags);
+}
+
+/* Returns %TRUE if an ancestor of @stylable has a queued change that will
+ * restyle its whole subtree anyway, with all the flags queued on
+ * @stylable */
+static gboolean
+mx_stylable_has_queued_ancestor (GHashTable *pending,
+                                 MxStylable *stylable,
+                                 guint       queued)
+{
+  ClutterActor *parent;
+
+  /* the restyle of an ancestor invalidates the caches of its descendants */
+  queued &= ~(MX_STYLE_CHANGED_QUEUED_SUBTREE |
+              MX_STYLE_CHANGED_INVALIDATE_CACHE);
+
+  for (parent = clutter_actor_get_parent (CLUTTER_ACTOR (stylable));
+       parent;
+       parent = clutter_actor_get_parent (parent))
+    {
+      guint parent_queued =
+        GPOINTER_TO_UINT (g_hash_table_lookup (pending, parent));
+
+      if ((parent_queued & MX_STYLE_CHANGED_QUEUED_SUBTREE) &&
+          (queued & ~parent_queued) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gint
+mx_queued_style_change_compare (gconstpointer a,
+                                gconstpointer b)
+{
+  const MxQueuedStyleChange *change_a = a;
+  const MxQueuedStyleChange *change_b = b;
+
+  return (gint) change_a->depth - (gint) change_b->depth;
+}
+
+static void
+mx_style_queue_flush (MxStyleQueue *queue)
+{
+  /* restyling may queue further changes, which are resolved in the same
+   * pass */
+  while (g_hash_table_size (queue->pending))
+    {
+      GHashTable *pending = queue->pending;
+      GHashTableIter iter;
+      GArray *changes;
+      gpointer key, value;
+      guint i;
+
+      queue->pending = g_hash_table_new_full (NULL, NULL,
+                                              g_object_unref, NULL);
+
+      MX_NOTE (STYLE_CACHE, "Resolving %d queued style changes",
+               g_hash_table_size (pending));
+
+      /* Restyle ancestors before their descendants, so that the style of a
+       * descendant is never looked up against an ancestor that is still to
+       * be restyled */
+      changes = g_array_sized_new (FALSE, FALSE, sizeof (MxQueuedStyleChange),
+                                   g_hash_table_size (pending));
+      g_hash_table_iter_init (&iter, pending);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          MxQueuedStyleChange change;
+          ClutterActor *parent;
+
+          change.stylable = key;
+          change.queued = GPOINTER_TO_UINT (value);
+          change.depth = 0;
+          for (parent = clutter_actor_get_parent (key);
+               parent;
+               parent = clutter_actor_get_parent (parent))
+            change.depth++;
+
+          g_array_append_val (changes, change);
+        }
+      g_array_sort (changes, mx_queued_style_change_compare);
+
+      for (i = 0; i < changes->len; i++)
+        {
+          MxQueuedStyleChange *change =
+            &g_array_index (changes, MxQueuedStyleChange, i);
+
+          if (mx_stylable_has_queued_ancestor (pending, change->stylable,
+                                               change->queued))
+            continue;
+
+          mx_stylable_apply_queued_style_changed (change->stylable,
+                                                  change->queued);
+        }
+
+      g_array_free (changes, TRUE);
+      g_hash_table_unref (pending);
+    }
+}
+
+static gboolean
+mx_style_queue_repaint_cb (gpointer data)
+{
+  MxStyleQueue *queue = data;
+
+  mx_style_queue_flush (queue);
+  queue->repaint_id = 0;
+
+  return FALSE;
+}
+
+static void
+mx_style_queue_free (MxStyleQueue *queue)
+{
+  if (queue->repaint_id)
+    clutter_threads_remove_repaint_func (queue->repaint_id);
+
+  g_hash_table_unref (queue->pending);
+  g_slice_free (MxStyleQueue, queue);
+}
+
+static void
+mx_stylable_queue_style_changed_internal (MxStylable *stylable,
+                                          guint       queued)
+{
+  ClutterActor *stage;
+  MxStyleQueue *queue;
+
+  /* Style changes on stylables that aren't realized only reset their
+   * cached style, so there is nothing to gain from deferring them */
+  stage = clutter_actor_get_stage (CLUTTER_ACTOR (stylable));
+  if (!stage || !CLUTTER_ACTOR_IS_REALIZED (CLUTTER_ACTOR (stylable)))
+    {
+      mx_stylable_style_changed_internal (stylable,
+                                          queued &
+                                          ~MX_STYLE_CHANGED_QUEUED_SUBTREE);
+      return;
+    }
+
+  queue = g_object_get_qdata (G_OBJECT (stage), quark_style_queue);
+  if (!queue)
+    {
+      queue = g_slice_new0 (MxStyleQueue);
+      queue->pending = g_hash_table_new_full (NULL, NULL,
+                                              g_object_unref, NULL);
+      g_object_set_qdata_full (G_OBJECT (stage), quark_style_queue, queue,
+                               (GDestroyNotify) mx_style_queue_free);
+    }
+
+  if (g_hash_table_lookup_extended (queue->pending, stylable, NULL, NULL))
+    queued |= GPOINTER_TO_UINT (g_hash_table_lookup (queue->pending,
+                                                     stylable));
+  else
+    g_object_ref (stylable);
+
+  g_hash_table_insert (queue->pending, stylable, GUINT_TO_POINTER (queued));
+
+  /* Only the restyle is deferred. The cached style node is reset straight
+   * away, so that styles looked up before the queue is flushed, e.g. for
+   * its descendants, aren't matched against a node that no longer
+   * describes the stylable */
+  if (queued & MX_STYLE_CHANGED_INVALIDATE_CACHE)
+    _mx_style_invalidate_cache (stylable);
+
+  /* resolve the queued changes before the stage is next laid out */
+  if (!queue->repaint_id)
+    queue->repaint_id =
+      clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT |
+                                             CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD,
+                                             mx_style_queue_repaint_cb,
+                                             queue, NULL);
+}
+
+/**
+ * mx_stylable_queue_style_changed:
+ * @stylable: an MxStylable
+ * @flags: flags that control the style changing
+ *
+ * Queues a style change on @stylable. Unlike mx_stylable_style_changed(),
+ * the change is not applied straight away: the changes queued on a stage
+ * are coalesced and resolved in a single pass before the stage is next laid
+ * out and painted. Use mx_stylable_apply_style_changes() to resolve them
+ * synchronously.
+ *
+ * Since: 2.0
+ */
+void
+mx_stylable_queue_style_changed (MxStylable          *stylable,
+                                 MxStyleChangedFlags  flags)
+{
+  g_return_if_fail (MX_IS_STYLABLE (stylable));
+
+  mx_stylable_queue_style_changed_internal (stylable,
+                                            flags |
+                                            MX_STYLE_CHANGED_QUEUED_SUBTREE);
+}
+
+/**
+ * mx_stylable_apply_style_changes:
+ * @stylable: an MxStylable
+ *
+ * Resolves the style changes queued on the stage of @stylable straight
+ * away, rather than before the next frame. This can be used when the
+ * style of @stylable needs to be up to date, e.g. to measure it.
+ *
+ * Changes of the name, style class and style pseudo-class of a stylable,
+ * and of its #MxStyle, are queued.
+ *
+ * Since: 2.0
+ */
+void
+mx_stylable_apply_style_changes (MxStylable *stylable)
+{
+  ClutterActor *stage;
+  MxStyleQueue *queue;
+
+  g_return_if_fail (MX_IS_STYLABLE (stylable));
+
+  stage = clutter_actor_get_stage (CLUTTER_ACTOR (stylable));
+  if (!stage)
+    return;
+
+  queue = g_object_get_qdata (G_OBJECT (stage), quark_style_queue);
+  if (queue)
+    mx_style_queue_flush (queue);
+}
+
 void
 mx_stylable_connect_change_notifiers (MxStylable *stylable)
 {
@@ -1123,20 +1520,20 @@ mx_stylable_connect_change_notifiers (MxStylable *stylable)
 
   /* ClutterActor signals */
   g_signal_connect (stylable, "notify::name",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_selector_changed_notify), NULL);
   g_signal_connect (stylable, "parent-set",
                     G_CALLBACK (mx_stylable_parent_set_notify), NULL);
 
   /* style-changed is blocked until the actor is realized, so style-changed
    * needs to be sent as soon as the actor is mapped */
   g_signal_connect (stylable, "notify::realized",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_realized_notify), NULL);
 
   /* MxStylable notifiers */
   g_signal_connect (stylable, "notify::style-class",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_selector_changed_notify), NULL);
   g_signal_connect (stylable, "notify::style-pseudo-class",
-                    G_CALLBACK (mx_stylable_property_changed_notify), NULL);
+                    G_CALLBACK (mx_stylable_selector_changed_notify), NULL);
 
 }
 
@@ -1151,6 +1548,14 @@ mx_stylable_disconnect_change_notifiers (MxStylable *stylable)
                                         mx_stylable_property_changed_notify,
                                         NULL);
 
+  g_signal_handlers_disconnect_by_func (stylable,
+                                        mx_stylable_selector_changed_notify,
+                                        NULL);
+
+  g_signal_handlers_disconnect_by_func (stylable,
+                                        mx_stylable_realized_notify,
+                                        NULL);
+
   g_signal_handlers_disconnect_by_func (stylable, mx_stylable_parent_set_notify,
                                         NULL);
 }
@@ -55,6 +55,19 @@ enum
   LAST_SIGNAL
 };
 
+enum
+{
+  PROP_0,
+
+  PROP_CACHE_MAX_ENTRIES,
+  PROP_CACHE_MAX_BYTES,
+  PROP_CACHE_ENTRIES,
+  PROP_CACHE_BYTES,
+  PROP_CACHE_HITS,
+  PROP_CACHE_MISSES,
+  PROP_CACHE_EVICTIONS
+};
+
 #define MX_STYLE_GET_PRIVATE(obj) \
         (G_TYPE_INSTANCE_GET_PRIVATE ((obj), MX_TYPE_STYLE, MxStylePrivate))
 
@@ -75,14 +88,15 @@ enum
  */
 #define MX_STYLE_CACHE_SIZE 6
 
-/* A style cache entry is the unique string representing all the properties
+/* A style cache entry is the style node representing all the properties
  * that can be matched against in CSS, and the matched properties themselves.
  */
 typedef struct
 {
-  gchar      *style_string;
-  gint        age;
-  GHashTable *properties;
+  MxStyleNode *node;
+  gint         age;
+  GHashTable  *properties;
+  gsize        size;
 } MxStyleCacheEntry;
 
 /* This is the per-stylable cache store. We need a reference back to the
@@ -90,8 +104,11 @@ typedef struct
  */
 typedef struct
 {
-  GList   *styles;
-  gchar   *string;
+  GList       *styles;
+  MxStyleNode *node;
+
+  /* the node the stylable had when its children were last restyled */
+  MxStyleNode *descendants_node;
 } MxStylableCache;
 
 typedef struct {
@@ -111,6 +128,15 @@ struct _MxStylePrivate
   GQueue     *cached_matches;
   GHashTable *cache_hash;
   gint        age;
+
+  /* cache budgets, 0 means the default for entries and no limit for bytes */
+  guint       cache_max_entries;
+  guint       cache_max_bytes;
+
+  gsize       cache_bytes;
+  guint       cache_hits;
+  guint       cache_misses;
+  guint       cache_evictions;
 };
 
 static guint style_signals[LAST_SIGNAL] = { 0, };
@@ -155,10 +181,28 @@ css_file_changed (GFileMonitor      *monitor,
   g_signal_emit (style, style_signals[CHANGED], 0, NULL);
 }
 
+static void
+mx_style_monitor_file (MxStyle     *style,
+                       const gchar *filename)
+{
+  GFile *file;
+  GFileMonitor *monitor;
+
+  file = g_file_new_for_path (filename);
+  monitor = g_file_monitor (file, G_FILE_MONITOR_NONE, NULL, NULL);
+
+  if (monitor)
+    {
+      g_signal_connect (monitor, "changed", G_CALLBACK (css_file_changed),
+                        style);
+    }
+}
+
 static gboolean
 mx_style_real_load_from_file (MxStyle      *style,
                               const gchar  *filename,
                               const gchar  *data,
+                              GBytes       *compiled,
                               GError      **error,
                               gint          priority)
 {
@@ -183,12 +227,25 @@ mx_style_real_load_from_file (MxStyle      *style,
   if (!priv->stylesheet)
     priv->stylesheet = mx_style_sheet_new ();
 
+  /* Prefer the compiled form of the style sheet, which doesn't need to be
+   * parsed, as long as it is up to date */
   if (data)
-    result = mx_style_sheet_add_from_data (priv->stylesheet, filename, data,
-                                           NULL);
+    {
+      gsize length = 0;
+      const gchar *compiled_data =
+        compiled ? g_bytes_get_data (compiled, &length) : NULL;
+
+      result = (compiled_data &&
+                mx_style_sheet_add_from_compiled_data (priv->stylesheet,
+                                                       filename,
+                                                       compiled_data, length,
+                                                       data, strlen (data))) ||
+        mx_style_sheet_add_from_data (priv->stylesheet, filename, data, NULL);
+    }
   else
-    result = mx_style_sheet_add_from_file (priv->stylesheet, filename,
-                                           NULL);
+    result = mx_style_sheet_add_from_compiled_file (priv->stylesheet,
+                                                    filename) ||
+      mx_style_sheet_add_from_file (priv->stylesheet, filename, NULL);
 
   if (!result)
     {
@@ -205,19 +262,7 @@ mx_style_real_load_from_file (MxStyle      *style,
   g_signal_emit (style, style_signals[CHANGED], 0, NULL);
 
   if (!data)
-    {
-      GFile *file;
-      GFileMonitor *monitor;
-
-      file = g_file_new_for_path (filename);
-      monitor = g_file_monitor (file, G_FILE_MONITOR_NONE, NULL, NULL);
-
-      if (monitor)
-        {
-          g_signal_connect (monitor, "changed", G_CALLBACK (css_file_changed),
-                            style);
-        }
-    }
+    mx_style_monitor_file (style, filename);
 
   return TRUE;
 }
@@ -230,6 +275,10 @@ mx_style_real_load_from_file (MxStyle      *style,
  *
  * Load style information from the specified file.
  *
+ * If a compiled form of the file, as created by mx-compile-css, exists next
+ * to it with the ".compiled" suffix and is up to date, it is loaded instead
+ * of parsing the file.
+ *
  * returns: TRUE if the style information was loaded successfully. Returns
  * FALSE on error.
  */
@@ -238,7 +287,7 @@ mx_style_load_from_file (MxStyle      *style,
                          const gchar  *filename,
                          GError      **error)
 {
-  return mx_style_real_load_from_file (style, filename, NULL, error, 0);
+  return mx_style_real_load_from_file (style, filename, NULL, NULL, error, 0);
 }
 
 /**
@@ -261,7 +310,232 @@ mx_style_load_from_data (MxStyle      *style,
                          const gchar  *data,
                          GError      **error)
 {
-  return mx_style_real_load_from_file (style, id, data, error, 0);
+  return mx_style_real_load_from_file (style, id, data, NULL, error, 0);
+}
+
+/* State of a mx_style_load_from_files_async() call. Each file is parsed
+ * into a style sheet of its own on the parser thread pool, and the style
+ * sheets are merged on the main thread once they have all been parsed. */
+typedef struct
+{
+  gchar        **filenames;
+  MxStyleSheet **sheets;
+  GError       **errors;
+  gint           n_pending;
+} MxStyleLoadData;
+
+typedef struct
+{
+  GTask *task;
+  gint   index;
+} MxStyleParseJob;
+
+static GThreadPool *parse_pool = NULL;
+
+static void
+mx_style_load_data_free (MxStyleLoadData *load)
+{
+  gint i;
+
+  for (i = 0; load->filenames[i]; i++)
+    {
+      if (load->sheets[i])
+        mx_style_sheet_destroy (load->sheets[i]);
+      g_clear_error (&load->errors[i]);
+    }
+
+  g_free (load->sheets);
+  g_free (load->errors);
+  g_strfreev (load->filenames);
+  g_slice_free (MxStyleLoadData, load);
+}
+
+static gboolean
+mx_style_load_merge_cb (gpointer data)
+{
+  GTask *task = data;
+  MxStyle *style = g_task_get_source_object (task);
+  MxStylePrivate *priv = style->priv;
+  MxStyleLoadData *load = g_task_get_task_data (task);
+  GError *error = NULL;
+  gint i;
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return FALSE;
+    }
+
+  if (!priv->stylesheet)
+    priv->stylesheet = mx_style_sheet_new ();
+
+  /* Merging in the order the files were given gives the same priorities,
+   * and so the same cascade, as loading them one after the other */
+  for (i = 0; load->filenames[i]; i++)
+    {
+      if (load->errors[i] && !error)
+        error = g_error_copy (load->errors[i]);
+
+      if (!load->sheets[i])
+        continue;
+
+      mx_style_sheet_merge (priv->stylesheet, load->sheets[i]);
+      load->sheets[i] = NULL;
+
+      mx_style_monitor_file (style, load->filenames[i]);
+    }
+
+  /* Increment the age so we know if a style cache entry is valid */
+  priv->age ++;
+
+  g_signal_emit (style, style_signals[CHANGED], 0, NULL);
+
+  if (error)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+
+  return FALSE;
+}
+
+static void
+mx_style_parse_func (gpointer data,
+                     gpointer user_data)
+{
+  MxStyleParseJob *job = data;
+  MxStyleLoadData *load = g_task_get_task_data (job->task);
+  const gchar *filename = load->filenames[job->index];
+  GCancellable *cancellable = g_task_get_cancellable (job->task);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    ;
+  else if (!g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    {
+      load->errors[job->index] = g_error_new (MX_STYLE_ERROR,
+                                              MX_STYLE_ERROR_INVALID_FILE,
+                                              "Invalid theme file '%s'",
+                                              filename);
+    }
+  else
+    {
+      MxStyleSheet *sheet = mx_style_sheet_new ();
+
+      if (!mx_style_sheet_add_from_compiled_file (sheet, filename) &&
+          !mx_style_sheet_add_from_file (sheet, filename, NULL))
+        {
+          load->errors[job->index] = g_error_new (MX_STYLE_ERROR,
+                                                  MX_STYLE_ERROR_PARSE_ERROR,
+                                                  "Could not parse '%s'",
+                                                  filename);
+        }
+
+      /* like mx_style_load_from_file(), keep what could be parsed */
+      load->sheets[job->index] = sheet;
+    }
+
+  /* the last file to be parsed hands the style sheets to the main thread.
+   * g_main_context_invoke() would merge them right here if nothing owned
+   * the context yet, so always go through an idle source */
+  if (g_atomic_int_dec_and_test (&load->n_pending))
+    {
+      GSource *source = g_idle_source_new ();
+
+      g_source_set_priority (source, g_task_get_priority (job->task));
+      g_source_set_callback (source, mx_style_load_merge_cb, job->task, NULL);
+      g_source_attach (source, g_task_get_context (job->task));
+      g_source_unref (source);
+    }
+
+  g_slice_free (MxStyleParseJob, job);
+}
+
+/**
+ * mx_style_load_from_files_async:
+ * @style: a #MxStyle
+ * @filenames: (array zero-terminated=1): the style sheets to load
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the style
+ *   sheets are loaded
+ * @user_data: (closure): data to pass to @callback
+ *
+ * Loads style information from each of @filenames. The files are parsed
+ * in parallel on other threads, and are then added to @style on the main
+ * thread as though they had been loaded in order with
+ * mx_style_load_from_file(), so later files take precedence over earlier
+ * ones. #MxStyle::changed is emitted once, when they have all been added.
+ *
+ * Since: 2.0
+ */
+void
+mx_style_load_from_files_async (MxStyle             *style,
+                                const gchar * const *filenames,
+                                GCancellable        *cancellable,
+                                GAsyncReadyCallback  callback,
+                                gpointer             user_data)
+{
+  MxStyleLoadData *load;
+  GTask *task;
+  gint i, n_files;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+  g_return_if_fail (filenames != NULL);
+
+  task = g_task_new (style, cancellable, callback, user_data);
+
+  n_files = g_strv_length ((gchar **) filenames);
+  if (n_files == 0)
+    {
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  load = g_slice_new0 (MxStyleLoadData);
+  load->filenames = g_strdupv ((gchar **) filenames);
+  load->sheets = g_new0 (MxStyleSheet *, n_files);
+  load->errors = g_new0 (GError *, n_files);
+  load->n_pending = n_files;
+  g_task_set_task_data (task, load, (GDestroyNotify) mx_style_load_data_free);
+
+  if (!parse_pool)
+    parse_pool = g_thread_pool_new (mx_style_parse_func, NULL,
+                                    g_get_num_processors (), FALSE, NULL);
+
+  /* the task is kept alive by the jobs until the style sheets are merged */
+  for (i = 0; i < n_files; i++)
+    {
+      MxStyleParseJob *job = g_slice_new (MxStyleParseJob);
+
+      job->task = task;
+      job->index = i;
+      g_thread_pool_push (parse_pool, job, NULL);
+    }
+}
+
+/**
+ * mx_style_load_from_files_finish:
+ * @style: a #MxStyle
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a #GError or %NULL
+ *
+ * Finishes loading style sheets with mx_style_load_from_files_async().
+ * Style sheets that could be loaded are added to @style even if loading
+ * another failed.
+ *
+ * Returns: %TRUE if all the style sheets were loaded successfully
+ *
+ * Since: 2.0
+ */
+gboolean
+mx_style_load_from_files_finish (MxStyle       *style,
+                                 GAsyncResult  *result,
+                                 GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, style), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 gboolean
@@ -269,9 +543,9 @@ mx_style_load_from_resource (MxStyle      *style,
                              const gchar  *path,
                              GError      **error)
 {
-  GBytes *bytes;
+  GBytes *bytes, *compiled;
   GError *internal_error = NULL;
-  gchar *id;
+  gchar *id, *compiled_path;
 
   bytes = g_resources_lookup_data (path, G_RESOURCE_LOOKUP_FLAGS_NONE,
                                    &internal_error);
@@ -283,14 +557,22 @@ mx_style_load_from_resource (MxStyle      *style,
       return FALSE;
     }
 
+  /* a compiled form of the style sheet may be bundled alongside it */
+  compiled_path = g_strconcat (path, ".compiled", NULL);
+  compiled = g_resources_lookup_data (compiled_path,
+                                      G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  g_free (compiled_path);
+
   id = g_strconcat ("resource://", path, NULL);
 
   mx_style_real_load_from_file (style, id, g_bytes_get_data (bytes, NULL),
-                                error, 0);
+                                compiled, error, 0);
 
   g_free (id);
 
   g_bytes_unref (bytes);
+  if (compiled)
+    g_bytes_unref (compiled);
 
   return TRUE;
 }
@@ -311,7 +593,7 @@ mx_style_load (MxStyle *style)
   if (g_file_test (rc_file, G_FILE_TEST_EXISTS))
     {
       /* load the default theme with lowest priority */
-      if (!mx_style_real_load_from_file (style, rc_file, NULL, &error, 0))
+      if (!mx_style_real_load_from_file (style, rc_file, NULL, NULL, &error, 0))
         {
           g_critical ("Unable to load resource file '%s': %s",
                       rc_file,
@@ -338,16 +620,25 @@ mx_style_load (MxStyle *style)
 }
 
 static MxStyleCacheEntry *
-mx_style_cache_entry_new (const gchar *style_string,
+mx_style_cache_entry_new (MxStyleNode *node,
                           GHashTable  *properties,
                           gint         age)
 {
   MxStyleCacheEntry *entry = g_slice_new (MxStyleCacheEntry);
 
-  entry->style_string = g_strdup (style_string);
+  entry->node = _mx_style_node_ref (node);
   entry->properties = properties;
   entry->age = age;
 
+  /* Approximate memory used by the entry: the entry itself, its queue link
+   * and hash slot, and the cascaded property table. The declarations in the
+   * table are shared with the style sheet, so are not counted.
+   */
+  entry->size = sizeof (MxStyleCacheEntry) + sizeof (GList) +
+    3 * sizeof (gpointer);
+  if (properties)
+    entry->size += g_hash_table_size (properties) * 3 * sizeof (gpointer);
+
   return entry;
 }
 
@@ -355,7 +646,7 @@ static void
 mx_style_cache_entry_free (MxStyleCacheEntry *entry,
                            gboolean           free_struct)
 {
-  g_free (entry->style_string);
+  _mx_style_node_unref (entry->node);
   g_hash_table_unref (entry->properties);
   if (free_struct)
     g_slice_free (MxStyleCacheEntry, entry);
@@ -375,15 +666,140 @@ mx_style_finalize (GObject *gobject)
   G_OBJECT_CLASS (mx_style_parent_class)->finalize (gobject);
 }
 
+static void
+mx_style_get_gobject_property (GObject    *object,
+                               guint       prop_id,
+                               GValue     *value,
+                               GParamSpec *pspec)
+{
+  MxStylePrivate *priv = MX_STYLE (object)->priv;
+
+  switch (prop_id)
+    {
+    case PROP_CACHE_MAX_ENTRIES:
+      g_value_set_uint (value, priv->cache_max_entries);
+      break;
+
+    case PROP_CACHE_MAX_BYTES:
+      g_value_set_uint (value, priv->cache_max_bytes);
+      break;
+
+    case PROP_CACHE_ENTRIES:
+      g_value_set_uint (value, g_queue_get_length (priv->cached_matches));
+      break;
+
+    case PROP_CACHE_BYTES:
+      g_value_set_uint (value, priv->cache_bytes);
+      break;
+
+    case PROP_CACHE_HITS:
+      g_value_set_uint (value, priv->cache_hits);
+      break;
+
+    case PROP_CACHE_MISSES:
+      g_value_set_uint (value, priv->cache_misses);
+      break;
+
+    case PROP_CACHE_EVICTIONS:
+      g_value_set_uint (value, priv->cache_evictions);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+mx_style_set_gobject_property (GObject      *object,
+                               guint         prop_id,
+                               const GValue *value,
+                               GParamSpec   *pspec)
+{
+  MxStyle *style = MX_STYLE (object);
+
+  switch (prop_id)
+    {
+    case PROP_CACHE_MAX_ENTRIES:
+      mx_style_set_cache_max_entries (style, g_value_get_uint (value));
+      break;
+
+    case PROP_CACHE_MAX_BYTES:
+      mx_style_set_cache_max_bytes (style, g_value_get_uint (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 mx_style_class_init (MxStyleClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxStylePrivate));
 
+  gobject_class->get_property = mx_style_get_gobject_property;
+  gobject_class->set_property = mx_style_set_gobject_property;
   gobject_class->finalize = mx_style_finalize;
 
+  pspec = g_param_spec_uint ("cache-max-entries",
+                             "Cache Maximum Entries",
+                             "Maximum number of entries in the style match "
+                             "cache, or 0 to size it by the number of "
+                             "stylables",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_MAX_ENTRIES,
+                                   pspec);
+
+  pspec = g_param_spec_uint ("cache-max-bytes",
+                             "Cache Maximum Bytes",
+                             "Approximate maximum size of the style match "
+                             "cache in bytes, or 0 for no limit",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READWRITE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_MAX_BYTES, pspec);
+
+  pspec = g_param_spec_uint ("cache-entries",
+                             "Cache Entries",
+                             "Number of entries in the style match cache",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_ENTRIES, pspec);
+
+  pspec = g_param_spec_uint ("cache-bytes",
+                             "Cache Bytes",
+                             "Approximate size of the style match cache in "
+                             "bytes",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_BYTES, pspec);
+
+  pspec = g_param_spec_uint ("cache-hits",
+                             "Cache Hits",
+                             "Number of style lookups served from the cache",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_HITS, pspec);
+
+  pspec = g_param_spec_uint ("cache-misses",
+                             "Cache Misses",
+                             "Number of style lookups that had to be matched "
+                             "against the style sheet",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_MISSES, pspec);
+
+  pspec = g_param_spec_uint ("cache-evictions",
+                             "Cache Evictions",
+                             "Number of entries evicted from the cache to "
+                             "keep it within its budget",
+                             0, G_MAXUINT, 0,
+                             MX_PARAM_READABLE);
+  g_object_class_install_property (gobject_class, PROP_CACHE_EVICTIONS, pspec);
+
   /**
    * MxStyle::changed:
    *
@@ -410,7 +826,7 @@ mx_style_init (MxStyle *style)
   style->priv = priv = MX_STYLE_GET_PRIVATE (style);
 
   priv->cached_matches = g_queue_new ();
-  priv->cache_hash = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->cache_hash = g_hash_table_new (NULL, NULL);
 
   mx_style_load (style);
 }
@@ -450,11 +866,13 @@ mx_style_get_default (void)
 }
 
 
-static void
-mx_style_transform_css_value (MxStyleSheetValue *css_value,
-                              MxStylable        *stylable,
-                              GParamSpec        *pspec,
-                              GValue            *value)
+/* Returns FALSE if the parsed value depends on something other than the
+ * declaration and the property type, and so must not be cached. */
+static gboolean
+mx_style_parse_css_value (MxStyleSheetValue *css_value,
+                          MxStylable        *stylable,
+                          GParamSpec        *pspec,
+                          GValue            *value)
 {
   if (pspec->value_type == G_TYPE_INT)
     {
@@ -470,6 +888,10 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
               ClutterBackend *backend = clutter_get_default_backend ();
               gdouble res = clutter_backend_get_resolution (backend);
               number = number * res / 72.0;
+
+              /* depends on the current resolution of the backend */
+              g_value_set_int (value, number);
+              return FALSE;
             }
 
           g_value_set_int (value, number);
@@ -519,7 +941,7 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
       if (!g_strcmp0 (css_value->string, "none"))
         {
           g_value_set_string (value, NULL);
-          return;
+          return TRUE;
         }
 
 
@@ -587,6 +1009,39 @@ mx_style_transform_css_value (MxStyleSheetValue *css_value,
         }
       g_value_unset (&strval);
     }
+
+  return TRUE;
+}
+
+static void
+mx_style_transform_css_value (MxStyleSheetValue *css_value,
+                              MxStylable        *stylable,
+                              GParamSpec        *pspec,
+                              GValue            *value)
+{
+  const GValue *cached;
+
+  /* Declarations are parsed the first time they are requested as each
+   * property type and the result is kept on the declaration itself, so
+   * that further lookups are just a copy of the parsed value.
+   */
+  cached = mx_style_sheet_value_get_parsed (css_value, pspec->value_type);
+  if (!cached)
+    {
+      GValue parsed = { 0, };
+
+      if (!mx_style_parse_css_value (css_value, stylable, pspec, &parsed))
+        {
+          *value = parsed;
+          return;
+        }
+
+      cached = mx_style_sheet_value_add_parsed (css_value, pspec->value_type,
+                                                &parsed);
+    }
+
+  g_value_init (value, pspec->value_type);
+  g_value_copy (cached, value);
 }
 
 
@@ -642,7 +1097,10 @@ mx_style_stylable_cache_free (MxStylableCache *cache)
       cache->styles = g_list_delete_link (cache->styles, cache->styles);
     }
 
-  g_free (cache->string);
+  if (cache->node)
+    _mx_style_node_unref (cache->node);
+  if (cache->descendants_node)
+    _mx_style_node_unref (cache->descendants_node);
   g_slice_free (MxStylableCache, cache);
 }
 
@@ -652,11 +1110,116 @@ _mx_style_invalidate_cache (MxStylable *stylable)
   GObject *object = G_OBJECT (stylable);
   MxStylableCache *cache = g_object_get_qdata (object, MX_STYLE_CACHE);
 
-  /* Reset the cache string */
-  if (cache)
+  /* Reset the style node */
+  if (cache && cache->node)
+    {
+      _mx_style_node_unref (cache->node);
+      cache->node = NULL;
+    }
+}
+
+static MxStylableCache *
+mx_style_get_stylable_cache (MxStylable *stylable)
+{
+  MxStylableCache *cache;
+
+  cache = g_object_get_qdata (G_OBJECT (stylable), MX_STYLE_CACHE);
+
+  if (!cache)
     {
-      g_free (cache->string);
-      cache->string = NULL;
+      /* Use qdata to associate the cache entry with the stylable object */
+      cache = g_slice_new0 (MxStylableCache);
+      g_object_set_qdata_full (G_OBJECT (stylable), MX_STYLE_CACHE, cache,
+                               (GDestroyNotify)mx_style_stylable_cache_free);
+    }
+
+  return cache;
+}
+
+/* Returns the style node of @stylable, which is computed from the node of
+ * its closest stylable ancestor and its own matchable properties. */
+static MxStyleNode *
+mx_style_get_stylable_node (MxStylable *stylable)
+{
+  MxStylableCache *cache, *parent_cache;
+  MxStyleNode *parent_node;
+  ClutterActor *parent;
+
+  cache = mx_style_get_stylable_cache (stylable);
+
+  for (parent = clutter_actor_get_parent ((ClutterActor *) stylable);
+       parent;
+       parent = clutter_actor_get_parent (parent))
+    {
+      if (MX_IS_STYLABLE (parent))
+        break;
+    }
+
+  /* The node is reset when the stylable's style is invalidated, but the
+   * stylable may have changed while it was unrealized and not receiving
+   * style-changed, so check that it still describes the stylable and that
+   * it was built on the current node of the parent. This only looks at the
+   * parent, so it doesn't depend on the depth of the stylable.
+   */
+  if (cache->node)
+    {
+      parent_cache = parent ?
+        g_object_get_qdata (G_OBJECT (parent), MX_STYLE_CACHE) : NULL;
+      parent_node = parent_cache ? parent_cache->node : NULL;
+
+      if ((!parent || parent_node) &&
+          _mx_style_node_matches (cache->node, parent_node, stylable))
+        return cache->node;
+
+      _mx_style_node_unref (cache->node);
+      cache->node = NULL;
+    }
+
+  parent_node = parent ? mx_style_get_stylable_node ((MxStylable *) parent) : NULL;
+  cache->node = _mx_style_node_get (parent_node, stylable);
+
+  return cache->node;
+}
+
+static void
+mx_style_cache_remove_link (MxStyle *style,
+                            GList   *entry_link)
+{
+  MxStylePrivate *priv = style->priv;
+  MxStyleCacheEntry *entry = entry_link->data;
+
+  g_hash_table_remove (priv->cache_hash, entry->node);
+  g_queue_delete_link (priv->cached_matches, entry_link);
+  priv->cache_bytes -= entry->size;
+  mx_style_cache_entry_free (entry, TRUE);
+}
+
+static guint
+mx_style_cache_get_entry_budget (MxStyle *style)
+{
+  MxStylePrivate *priv = style->priv;
+
+  if (priv->cache_max_entries)
+    return priv->cache_max_entries;
+  else
+    return priv->alive_stylables * MX_STYLE_CACHE_SIZE;
+}
+
+/* Evict the least recently used entries until the cache is within its entry
+ * and byte budgets. The most recently used entry is always kept, as it may
+ * be about to be returned. */
+static void
+mx_style_cache_trim (MxStyle *style)
+{
+  MxStylePrivate *priv = style->priv;
+  guint max_entries = mx_style_cache_get_entry_budget (style);
+
+  while (g_queue_get_length (priv->cached_matches) > 1 &&
+         (g_queue_get_length (priv->cached_matches) > max_entries ||
+          (priv->cache_max_bytes && priv->cache_bytes > priv->cache_max_bytes)))
+    {
+      mx_style_cache_remove_link (style, priv->cached_matches->tail);
+      priv->cache_evictions ++;
     }
 }
 
@@ -666,113 +1229,211 @@ mx_style_get_style_sheet_properties (MxStyle    *style,
 {
   GList *entry_link;
   MxStylableCache *cache;
+  MxStyleNode *node;
 
   MxStyleCacheEntry *entry = NULL;
   MxStylePrivate *priv = style->priv;
 
-  /* see if we have a cached style and return that if possible */
+  /* Make sure that the style node is up-to-date. This is reset when
+   * invalidating the stylable's cache.
+   */
+  node = mx_style_get_stylable_node (stylable);
   cache = g_object_get_qdata (G_OBJECT (stylable), MX_STYLE_CACHE);
 
-  if (cache)
-    {
-      /* Make sure that the style string is up-to-date. We set this
-       * to NULL when invalidating the stylable's cache.
-       */
-      if (!cache->string)
-        cache->string = _mx_stylable_get_style_string (stylable);
-
-      /* Check that the stylable has a reference to us. If the stylable
-       * cache struct was created by another style, we need to add ourselves
-       * to the list.
-       */
-      if (!g_list_find (cache->styles, style))
-        {
-          cache->styles = g_list_prepend (cache->styles, style);
-          g_object_weak_ref (G_OBJECT (style), mx_style_cache_weak_ref_cb,
-                             cache);
-          priv->alive_stylables ++;
-        }
-    }
-  else
+  /* Check that the stylable has a reference to us. If the stylable
+   * cache struct was created by another style or for one of its
+   * descendants, we need to add ourselves to the list.
+   */
+  if (!g_list_find (cache->styles, style))
     {
-      /* This is the first time this stylable has tried to get style
-       * properties, initialise a cache.
-       */
-      cache = g_slice_new0 (MxStylableCache);
-      cache->string = _mx_stylable_get_style_string (stylable);
-      cache->styles = g_list_prepend (NULL, style);
-
-      /* Increase the alive-stylables count and add a weak reference so we
-       * can remove it.
-       */
+      cache->styles = g_list_prepend (cache->styles, style);
+      g_object_weak_ref (G_OBJECT (style), mx_style_cache_weak_ref_cb,
+                         cache);
       priv->alive_stylables ++;
-      g_object_weak_ref (G_OBJECT (style), mx_style_cache_weak_ref_cb, cache);
 
       MX_NOTE (STYLE_CACHE, "(%p) Alive stylables: %d",
                style, priv->alive_stylables);
-
-      /* Use qdata to associate the cache entry with the stylable object */
-      g_object_set_qdata_full (G_OBJECT (stylable), MX_STYLE_CACHE, cache,
-                               (GDestroyNotify)mx_style_stylable_cache_free);
     }
 
-  if ((entry_link = g_hash_table_lookup (priv->cache_hash, cache->string)))
+  if ((entry_link = g_hash_table_lookup (priv->cache_hash, node)))
     {
       entry = entry_link->data;
 
       /* If the entry is old, remove it from the cache */
       if (entry->age != priv->age)
         {
-          g_hash_table_remove (priv->cache_hash, entry->style_string);
-          g_queue_delete_link (priv->cached_matches, entry_link);
-          mx_style_cache_entry_free (entry, TRUE);
+          mx_style_cache_remove_link (style, entry_link);
           entry = NULL;
         }
+      else
+        {
+          /* Move the entry to the front of the queue, so the least recently
+           * used entries are at the tail and get evicted first */
+          g_queue_unlink (priv->cached_matches, entry_link);
+          g_queue_push_head_link (priv->cached_matches, entry_link);
 
-      /* As the cache is rarely emptied, FIFO is good enough for the
-       * eviction strategy (preferring speedy retrieval to efficient
-       * eviction)
-       *
-       * If we did want LRU though, for example, here would be the place
-       * to do it. You could remove the link from the queue using
-       * g_queue_unlink() and reinsert it with g_queue_push_head_link()
-       */
+          priv->cache_hits ++;
+        }
     }
 
   /* No cached style properties were found, or the entry found is out of date,
    * so look them up from the style-sheet and (re-)add them to the cache.
    */
-  if (!entry || (entry->age != priv->age))
+  if (!entry)
     {
       /* Look up style properties */
       GHashTable *properties = mx_style_sheet_get_properties (priv->stylesheet,
                                                               stylable);
 
+      priv->cache_misses ++;
+
       /* Append this to the style cache */
-      entry = mx_style_cache_entry_new (cache->string, properties, priv->age);
+      entry = mx_style_cache_entry_new (node, properties, priv->age);
       g_queue_push_head (priv->cached_matches, entry);
-      g_hash_table_insert (priv->cache_hash, entry->style_string,
+      g_hash_table_insert (priv->cache_hash, entry->node,
                            priv->cached_matches->head);
+      priv->cache_bytes += entry->size;
 
       /* Shrink the cache if its grown too large */
-      while (g_queue_get_length (priv->cached_matches) >
-             (priv->alive_stylables * MX_STYLE_CACHE_SIZE))
-        {
-          MxStyleCacheEntry *old_entry =
-            g_queue_pop_tail (priv->cached_matches);
+      mx_style_cache_trim (style);
 
-          g_hash_table_remove (priv->cache_hash, old_entry->style_string);
-          mx_style_cache_entry_free (old_entry, TRUE);
-        }
-
-      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, (Max-size: %d)",
+      MX_NOTE (STYLE_CACHE, "(%p) Cache size: %d, (Max-size: %d), %"
+               G_GSIZE_FORMAT " bytes",
                style, g_queue_get_length (priv->cached_matches),
-               priv->alive_stylables * MX_STYLE_CACHE_SIZE);
+               mx_style_cache_get_entry_budget (style), priv->cache_bytes);
     }
 
   return entry->properties ? g_hash_table_ref (entry->properties) : NULL;
 }
 
+/* Returns the cached properties matched for @node, or %NULL if they aren't
+ * in the cache or are out of date. */
+static GHashTable *
+mx_style_cache_lookup (MxStyle     *style,
+                       MxStyleNode *node)
+{
+  MxStylePrivate *priv = style->priv;
+  MxStyleCacheEntry *entry;
+  GList *entry_link;
+
+  entry_link = g_hash_table_lookup (priv->cache_hash, node);
+  if (!entry_link)
+    return NULL;
+
+  entry = entry_link->data;
+  if (entry->age != priv->age || !entry->properties)
+    return NULL;
+
+  return g_hash_table_ref (entry->properties);
+}
+
+void
+_mx_style_mark_descendants_styled (MxStylable *stylable)
+{
+  MxStylableCache *cache;
+  MxStyleNode *node;
+
+  node = mx_style_get_stylable_node (stylable);
+  cache = g_object_get_qdata (G_OBJECT (stylable), MX_STYLE_CACHE);
+
+  _mx_style_node_ref (node);
+  if (cache->descendants_node)
+    _mx_style_node_unref (cache->descendants_node);
+  cache->descendants_node = node;
+}
+
+/* Called when the name, style class or pseudo-class of @stylable changed,
+ * before its cache is invalidated. Returns %FALSE if restyling @stylable
+ * alone is enough, i.e. no selector that matches on an ancestor depends on
+ * what changed, and none of the inherited properties changed value. */
+gboolean
+_mx_style_descendants_need_restyle (MxStyle    *style,
+                                    MxStylable *stylable)
+{
+  MxStylePrivate *priv = style->priv;
+  GHashTable *old_properties, *new_properties;
+  MxStyleNode *old_node, *new_node;
+  MxStylableCache *cache;
+  ClutterActor *parent;
+  GPtrArray *inherited;
+  gboolean need_restyle;
+  guint i;
+
+  cache = g_object_get_qdata (G_OBJECT (stylable), MX_STYLE_CACHE);
+  if (!priv->stylesheet || !cache || !cache->descendants_node)
+    return TRUE;
+
+  old_node = cache->descendants_node;
+
+  /* the children were styled under another parent */
+  for (parent = clutter_actor_get_parent ((ClutterActor *) stylable);
+       parent && !MX_IS_STYLABLE (parent);
+       parent = clutter_actor_get_parent (parent));
+  if (parent)
+    {
+      MxStylableCache *parent_cache =
+        g_object_get_qdata (G_OBJECT (parent), MX_STYLE_CACHE);
+
+      if (!parent_cache || parent_cache->node != old_node->parent)
+        return TRUE;
+    }
+  else if (old_node->parent)
+    return TRUE;
+
+  if (mx_style_sheet_descendants_depend_on (priv->stylesheet, stylable,
+                                            old_node->id,
+                                            old_node->class,
+                                            old_node->pseudo_class))
+    return TRUE;
+
+  /* Check that the values the children may inherit are unchanged. The
+   * declarations are shared between lookups, so comparing them by pointer
+   * is enough. */
+  inherited = _mx_stylable_get_inherited_properties ();
+  if (!inherited)
+    return FALSE;
+
+  old_properties = mx_style_cache_lookup (style, old_node);
+  if (!old_properties)
+    return TRUE;
+
+  _mx_style_invalidate_cache (stylable);
+  new_node = mx_style_get_stylable_node (stylable);
+  new_properties = mx_style_get_style_sheet_properties (style, stylable);
+
+  need_restyle = FALSE;
+  for (i = 0; i < inherited->len; i++)
+    {
+      const gchar *name =
+        mx_style_normalize_property_name (g_ptr_array_index (inherited, i));
+      gpointer old_value, new_value;
+
+      old_value = g_hash_table_lookup (old_properties, name);
+      new_value = new_properties ?
+        g_hash_table_lookup (new_properties, name) : NULL;
+
+      if (old_value != new_value)
+        {
+          need_restyle = TRUE;
+          break;
+        }
+    }
+
+  g_hash_table_unref (old_properties);
+  if (new_properties)
+    g_hash_table_unref (new_properties);
+
+  /* the children are still styled correctly against the new node */
+  if (!need_restyle)
+    {
+      _mx_style_node_ref (new_node);
+      _mx_style_node_unref (cache->descendants_node);
+      cache->descendants_node = new_node;
+    }
+
+  return need_restyle;
+}
+
 /**
  * mx_style_get_property:
  * @style: the style data store object
@@ -999,3 +1660,100 @@ mx_style_get (MxStyle     *style,
   va_end (va_args);
 }
 
+/**
+ * mx_style_set_cache_max_entries:
+ * @style: a #MxStyle
+ * @max_entries: the maximum number of entries, or 0
+ *
+ * Sets the maximum number of matched styles kept in the style cache of
+ * @style. When the cache is full, the least recently used entries are
+ * evicted. If @max_entries is 0, the cache is sized by the number of
+ * stylables using @style.
+ *
+ * Since: 2.0
+ */
+void
+mx_style_set_cache_max_entries (MxStyle *style,
+                                guint    max_entries)
+{
+  MxStylePrivate *priv;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  priv = style->priv;
+
+  if (priv->cache_max_entries != max_entries)
+    {
+      priv->cache_max_entries = max_entries;
+      mx_style_cache_trim (style);
+
+      g_object_notify (G_OBJECT (style), "cache-max-entries");
+    }
+}
+
+/**
+ * mx_style_get_cache_max_entries:
+ * @style: a #MxStyle
+ *
+ * Gets the value set by mx_style_set_cache_max_entries().
+ *
+ * Returns: the maximum number of entries in the style cache, or 0
+ *
+ * Since: 2.0
+ */
+guint
+mx_style_get_cache_max_entries (MxStyle *style)
+{
+  g_return_val_if_fail (MX_IS_STYLE (style), 0);
+
+  return style->priv->cache_max_entries;
+}
+
+/**
+ * mx_style_set_cache_max_bytes:
+ * @style: a #MxStyle
+ * @max_bytes: the approximate maximum size in bytes, or 0
+ *
+ * Sets the approximate maximum amount of memory used by the style cache of
+ * @style. When the cache grows beyond this, the least recently used entries
+ * are evicted. If @max_bytes is 0, the cache size is only limited by the
+ * number of entries.
+ *
+ * Since: 2.0
+ */
+void
+mx_style_set_cache_max_bytes (MxStyle *style,
+                              guint    max_bytes)
+{
+  MxStylePrivate *priv;
+
+  g_return_if_fail (MX_IS_STYLE (style));
+
+  priv = style->priv;
+
+  if (priv->cache_max_bytes != max_bytes)
+    {
+      priv->cache_max_bytes = max_bytes;
+      mx_style_cache_trim (style);
+
+      g_object_notify (G_OBJECT (style), "cache-max-bytes");
+    }
+}
+
+/**
+ * mx_style_get_cache_max_bytes:
+ * @style: a #MxStyle
+ *
+ * Gets the value set by mx_style_set_cache_max_bytes().
+ *
+ * Returns: the approximate maximum size of the style cache in bytes, or 0
+ *
+ * Since: 2.0
+ */
+guint
+mx_style_get_cache_max_bytes (MxStyle *style)
+{
+  g_return_val_if_fail (MX_IS_STYLE (style), 0);
+
+  return style->priv->cache_max_bytes;
+}
@@ -95,6 +95,15 @@ gboolean mx_style_load_from_data (MxStyle      *style,
                                   const gchar  *data,
                                   GError      **error);
 
+void     mx_style_load_from_files_async  (MxStyle             *style,
+                                          const gchar * const *filenames,
+                                          GCancellable        *cancellable,
+                                          GAsyncReadyCallback  callback,
+                                          gpointer             user_data);
+gboolean mx_style_load_from_files_finish (MxStyle             *style,
+                                          GAsyncResult        *result,
+                                          GError             **error);
+
 gboolean mx_style_load_from_resource (MxStyle      *style,
                                       const gchar  *path,
                                       GError      **error);
@@ -112,6 +121,13 @@ void     mx_style_get_valist     (MxStyle      *style,
                                   const gchar  *first_property_name,
                                   va_list       va_args);
 
+void     mx_style_set_cache_max_entries (MxStyle *style,
+                                         guint    max_entries);
+guint    mx_style_get_cache_max_entries (MxStyle *style);
+void     mx_style_set_cache_max_bytes   (MxStyle *style,
+                                         guint    max_bytes);
+guint    mx_style_get_cache_max_bytes   (MxStyle *style);
+
 G_END_DECLS
 
 #endif /* __MX_STYLE_H__ */
@@ -0,0 +1,88 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * mx-texture-cache-index.h: on-disk format of texture cache atlases
+ *
+ * Copyright 2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef __MX_TEXTURE_CACHE_INDEX_H__
+#define __MX_TEXTURE_CACHE_INDEX_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* An atlas index describes where a set of images was packed into one or
+ * more atlas images, or pages. It is written by mx-create-image-cache and
+ * read by mx_texture_cache_load_cache(), which maps it rather than reading
+ * it, so it is laid out to be used in place:
+ *
+ *   MxTextureCacheIndexHeader
+ *   guint32[n_pages], the paths of the pages
+ *   MxTextureCacheIndexEntry[n_entries], sorted by hash and then by URI
+ *   a string table of nul-terminated strings
+ *
+ * All strings, the paths of the pages and the URIs of the images, are
+ * offsets into the string table. Everything is stored in the byte order of
+ * the machine that wrote the index.
+ */
+
+#define MX_TEXTURE_CACHE_INDEX_MAGIC      "MXATLAS\0"
+#define MX_TEXTURE_CACHE_INDEX_VERSION    2
+#define MX_TEXTURE_CACHE_INDEX_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 n_pages;
+  guint32 n_entries;
+  guint32 strings_size;
+  guint32 reserved;
+} MxTextureCacheIndexHeader;
+
+typedef struct
+{
+  guint32 hash;
+  guint32 uri;
+  guint32 page;
+  guint32 x;
+  guint32 y;
+  guint32 width;
+  guint32 height;
+} MxTextureCacheIndexEntry;
+
+/* FNV-1a, which unlike g_str_hash() is guaranteed not to change */
+static inline guint32
+mx_texture_cache_index_hash (const gchar *uri)
+{
+  guint32 hash = 2166136261u;
+
+  for (; *uri; uri++)
+    {
+      hash ^= (guchar) *uri;
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+G_END_DECLS
+
+#endif /* __MX_TEXTURE_CACHE_INDEX_H__ */
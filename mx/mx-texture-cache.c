@@ -50,6 +50,7 @@ extern unsigned char *stbi_load_from_memory (unsigned char const *buffer,
 #endif
 
 #include "mx-texture-cache.h"
+#include "mx-texture-cache-index.h"
 #include "mx-marshal.h"
 #include "mx-private.h"
 
@@ -64,6 +65,27 @@ struct _MxTextureCachePrivate
 {
   GHashTable *cache;
   GRegex     *is_uri;
+
+  /* the atlas pages that small images are packed into */
+  GPtrArray  *atlas_pages;
+
+  /* Items whose texture isn't held by anyone outside of the cache, most
+   * recently used first. These are evicted once the cache is over its
+   * byte budget. */
+  GQueue     *unused;
+
+  guint64     max_bytes;
+  guint64     current_bytes;
+  guint64     peak_bytes;
+  guint64     evicted_bytes;
+
+  /* the requests waiting for each URI that is being decoded */
+  GHashTable *pending;
+
+  /* atlas indexes loaded with mx_texture_cache_load_cache() */
+  GPtrArray  *indexes;
+
+  CoglHandle  placeholder;
 };
 
 typedef struct FinalizedClosure
@@ -75,54 +97,252 @@ typedef struct FinalizedClosure
 enum
 {
   PROP_0,
+
+  PROP_MAX_BYTES,
+  PROP_CURRENT_BYTES,
+  PROP_PEAK_BYTES,
+  PROP_EVICTED_BYTES
 };
 
 static MxTextureCache* __cache_singleton = NULL;
 
+/* Images no larger than MX_TEXTURE_ATLAS_MAX_IMAGE in either dimension are
+ * packed into shared atlas pages, so that widgets using them can be drawn
+ * from the same texture. Each image is surrounded by a one pixel border
+ * that repeats its edges and corners, so that filtering doesn't pick up its
+ * neighbours.
+ */
+#define MX_TEXTURE_ATLAS_SIZE      1024
+#define MX_TEXTURE_ATLAS_MAX_IMAGE 256
+#define MX_TEXTURE_ATLAS_PADDING   1
+
+/* Pages are packed in shelves: rows of images that are no taller than the
+ * row, filled from left to right */
+typedef struct
+{
+  gint y;
+  gint height;
+  gint x;
+} MxTextureAtlasShelf;
+
+typedef struct
+{
+  CoglHandle  texture;
+  GArray     *shelves;
+  gint        next_y;
+
+  /* each image packed into the page holds a reference on it, and the page
+   * is removed from @pages when they are all gone */
+  gint        ref_count;
+  GPtrArray  *pages;
+
+  /* the cache the memory of the page is accounted to */
+  MxTextureCache *cache;
+} MxTextureAtlasPage;
+
 /*
  * Convention: posX with a value of -1 indicates whole texture
  */
 typedef struct MxTextureCacheItem {
-  char          filename[256];
   int           width, height;
   int           posX, posY;
   CoglHandle    ptr;
   GHashTable   *meta;
+
+  /* the atlas page the image was packed into, or the atlas index it was
+   * cut from, if any. The memory of these pages is accounted for once for
+   * the page rather than for each image on it. */
+  MxTextureAtlasPage          *page;
+  struct _MxTextureCacheIndex *index;
+
+  /* The texture handed out for ptr. The cache doesn't hold a reference on
+   * it, so that it can tell when nobody is using the texture any more. */
+  CoglHandle    view;
+  struct _MxTextureCacheViewClosure *view_closure;
+
+  /* the number of textures handed out for ptr and the meta textures that
+   * are still alive; the item can only be evicted when there are none */
+  guint         n_views;
+
+  MxTextureCache *cache;
+  gchar          *uri;
+  gsize           size;
+  GList          *unused_link;
 } MxTextureCacheItem;
 
+typedef struct _MxTextureCacheViewClosure
+{
+  MxTextureCacheItem *item;
+
+  /* the meta texture the view is of, or %NULL for the view of ptr */
+  struct _MxTextureCacheMetaEntry *entry;
+} MxTextureCacheViewClosure;
+
+static CoglUserDataKey view_key;
+
+/* A page of an atlas index. The index doesn't hold a reference on the
+ * texture, the images cut from it keep it alive. */
 typedef struct
+{
+  CoglHandle      texture;
+  gboolean        failed;
+
+  /* the memory of the loaded page, accounted to @cache */
+  MxTextureCache *cache;
+  gsize           size;
+} MxTextureCacheIndexPage;
+
+/* An atlas index loaded with mx_texture_cache_load_cache(). The index is
+ * mapped rather than read, and its images only become cache items when
+ * they are first looked up, which is also when the page they are on is
+ * loaded. */
+typedef struct _MxTextureCacheIndex
+{
+  gchar                           *filename;
+  GMappedFile                     *mapped_file;
+  const MxTextureCacheIndexHeader *header;
+  const guint32                   *page_names;
+  const MxTextureCacheIndexEntry  *entries;
+  const gchar                     *strings;
+
+  MxTextureCacheIndexPage         *pages;
+} MxTextureCacheIndex;
+
+static CoglUserDataKey atlas_key;
+
+typedef struct _MxTextureCacheMetaEntry
 {
   gpointer        ident;
   CoglHandle     *texture;
   GDestroyNotify  destroy_func;
+
+  /* the texture handed out for @texture, as for the view of an item */
+  MxTextureCacheItem        *item;
+  CoglHandle                 view;
+  MxTextureCacheViewClosure *view_closure;
 } MxTextureCacheMetaEntry;
 
+static gsize
+mx_texture_cache_texture_size (CoglHandle texture)
+{
+  return (gsize) cogl_texture_get_width (texture) *
+    cogl_texture_get_height (texture) * 4;
+}
+
+static void
+mx_texture_cache_add_bytes (MxTextureCache *self,
+                            gsize           size)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+
+  priv->current_bytes += size;
+  priv->peak_bytes = MAX (priv->peak_bytes, priv->current_bytes);
+}
+
 static MxTextureCacheItem *
 mx_texture_cache_item_new (void)
 {
   return g_slice_new0 (MxTextureCacheItem);
 }
 
+static void
+mx_texture_atlas_page_unref (MxTextureAtlasPage *page)
+{
+  if (--page->ref_count > 0)
+    return;
+
+  /* Nothing uses the page any more, so drop it rather than keep packing
+   * into it; the space left by the images that were evicted from it can't
+   * be reused otherwise */
+  if (page->pages)
+    g_ptr_array_remove_fast (page->pages, page);
+
+  if (page->cache)
+    TEXTURE_CACHE_PRIVATE (page->cache)->current_bytes -=
+      mx_texture_cache_texture_size (page->texture);
+
+  MX_NOTE (TEXTURE_CACHE, "Freeing atlas page %p", page);
+
+  cogl_handle_unref (page->texture);
+  g_array_free (page->shelves, TRUE);
+  g_slice_free (MxTextureAtlasPage, page);
+}
+
 static void
 mx_texture_cache_item_free (MxTextureCacheItem *item)
 {
+  if (item->cache)
+    {
+      MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (item->cache);
+
+      priv->current_bytes -= item->size;
+
+      if (item->unused_link)
+        g_queue_delete_link (priv->unused, item->unused_link);
+    }
+
+  /* the texture may still be in use, but it is no longer cached */
+  if (item->view_closure)
+    item->view_closure->item = NULL;
+
+  g_free (item->uri);
+
   if (item->ptr)
     cogl_handle_unref (item->ptr);
 
   if (item->meta)
     g_hash_table_unref (item->meta);
 
+  if (item->page)
+    mx_texture_atlas_page_unref (item->page);
+
   g_slice_free (MxTextureCacheItem, item);
 }
 
+static void
+mx_texture_cache_index_page_destroyed (void *user_data)
+{
+  MxTextureCacheIndexPage *page = user_data;
+
+  TEXTURE_CACHE_PRIVATE (page->cache)->current_bytes -= page->size;
+  page->size = 0;
+  page->texture = COGL_INVALID_HANDLE;
+}
+
+static void
+mx_texture_cache_index_free (MxTextureCacheIndex *index)
+{
+  guint i;
+
+  /* The pages may outlive the index if their images are still in use, but
+   * they are no longer accounted to the cache. Replacing the user data
+   * calls mx_texture_cache_index_page_destroyed(), which takes the page
+   * out of the cache's size */
+  for (i = 0; i < index->header->n_pages; i++)
+    if (index->pages[i].texture)
+      cogl_object_set_user_data (index->pages[i].texture, &atlas_key,
+                                 NULL, NULL);
+
+  g_free (index->pages);
+  g_free (index->filename);
+  g_mapped_file_unref (index->mapped_file);
+  g_slice_free (MxTextureCacheIndex, index);
+}
+
 static void
 mx_texture_cache_set_property (GObject      *object,
                                guint         prop_id,
                                const GValue *value,
                                GParamSpec   *pspec)
 {
+  MxTextureCache *self = MX_TEXTURE_CACHE (object);
+
   switch (prop_id)
     {
+    case PROP_MAX_BYTES:
+      mx_texture_cache_set_max_bytes (self, g_value_get_uint64 (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -135,8 +355,26 @@ mx_texture_cache_get_property (GObject    *object,
                                GValue     *value,
                                GParamSpec *pspec)
 {
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (object);
+
   switch (prop_id)
     {
+    case PROP_MAX_BYTES:
+      g_value_set_uint64 (value, priv->max_bytes);
+      break;
+
+    case PROP_CURRENT_BYTES:
+      g_value_set_uint64 (value, priv->current_bytes);
+      break;
+
+    case PROP_PEAK_BYTES:
+      g_value_set_uint64 (value, priv->peak_bytes);
+      break;
+
+    case PROP_EVICTED_BYTES:
+      g_value_set_uint64 (value, priv->evicted_bytes);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -154,10 +392,30 @@ static void
 mx_texture_cache_finalize (GObject *object)
 {
   MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(object);
+  guint i;
+
+  /* the pages outlive the cache if their sub-textures are still in use */
+  for (i = 0; i < priv->atlas_pages->len; i++)
+    {
+      MxTextureAtlasPage *page = g_ptr_array_index (priv->atlas_pages, i);
+      page->pages = NULL;
+      page->cache = NULL;
+    }
 
   if (priv->cache)
     g_hash_table_unref (priv->cache);
 
+  g_ptr_array_free (priv->atlas_pages, TRUE);
+  g_queue_free (priv->unused);
+
+  /* requests keep the cache alive, so none can be pending here */
+  g_hash_table_unref (priv->pending);
+
+  g_ptr_array_free (priv->indexes, TRUE);
+
+  if (priv->placeholder)
+    cogl_handle_unref (priv->placeholder);
+
   if (priv->is_uri)
     g_regex_unref (priv->is_uri);
 
@@ -168,6 +426,7 @@ static void
 mx_texture_cache_class_init (MxTextureCacheClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *pspec;
 
   g_type_class_add_private (klass, sizeof (MxTextureCachePrivate));
 
@@ -176,6 +435,72 @@ mx_texture_cache_class_init (MxTextureCacheClass *klass)
   object_class->dispose = mx_texture_cache_dispose;
   object_class->finalize = mx_texture_cache_finalize;
 
+  /**
+   * MxTextureCache:max-bytes:
+   *
+   * The amount of texture memory, in bytes, that the cache may hold on to.
+   * When it holds more, the least recently used textures that are not in
+   * use outside of the cache are evicted. 0 means there is no limit.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint64 ("max-bytes",
+                               "Maximum bytes",
+                               "The amount of texture memory the cache may "
+                               "hold on to",
+                               0, G_MAXUINT64, 0,
+                               MX_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_MAX_BYTES, pspec);
+
+  /**
+   * MxTextureCache:current-bytes:
+   *
+   * The amount of texture memory, in bytes, held by the cache. This
+   * includes the textures added with mx_texture_cache_insert_meta(). Small
+   * images share atlas textures, which are counted as a whole for as long
+   * as any of their images is cached or in use.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint64 ("current-bytes",
+                               "Current bytes",
+                               "The amount of texture memory held by the "
+                               "cache",
+                               0, G_MAXUINT64, 0,
+                               MX_PARAM_READABLE);
+  g_object_class_install_property (object_class, PROP_CURRENT_BYTES, pspec);
+
+  /**
+   * MxTextureCache:peak-bytes:
+   *
+   * The largest amount of texture memory, in bytes, that the cache has
+   * held.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint64 ("peak-bytes",
+                               "Peak bytes",
+                               "The largest amount of texture memory held "
+                               "by the cache",
+                               0, G_MAXUINT64, 0,
+                               MX_PARAM_READABLE);
+  g_object_class_install_property (object_class, PROP_PEAK_BYTES, pspec);
+
+  /**
+   * MxTextureCache:evicted-bytes:
+   *
+   * The total amount of texture memory, in bytes, that has been evicted
+   * from the cache to keep it within #MxTextureCache:max-bytes.
+   *
+   * Since: 2.0
+   */
+  pspec = g_param_spec_uint64 ("evicted-bytes",
+                               "Evicted bytes",
+                               "The amount of texture memory evicted from "
+                               "the cache",
+                               0, G_MAXUINT64, 0,
+                               MX_PARAM_READABLE);
+  g_object_class_install_property (object_class, PROP_EVICTED_BYTES, pspec);
 }
 
 static void
@@ -188,6 +513,13 @@ mx_texture_cache_init (MxTextureCache *self)
     g_hash_table_new_full (g_str_hash, g_str_equal,
                            g_free, (GDestroyNotify)mx_texture_cache_item_free);
 
+  priv->atlas_pages = g_ptr_array_new ();
+  priv->unused = g_queue_new ();
+  priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+  priv->indexes =
+    g_ptr_array_new_with_free_func ((GDestroyNotify)mx_texture_cache_index_free);
+
   priv->is_uri = g_regex_new ("^([a-zA-Z0-9+.-]+)://.*",
                               G_REGEX_OPTIMIZE, 0, &error);
   if (!priv->is_uri)
@@ -226,6 +558,181 @@ on_texure_finalized (gpointer data,
 }
 #endif
 
+/* Recomputes the memory used by @item, including its meta textures. The
+ * pages of atlases are accounted for separately. */
+static void
+mx_texture_cache_item_update_size (MxTextureCache     *self,
+                                   MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  gsize size = 0;
+
+  if (item->ptr && !item->page && !item->index)
+    size += mx_texture_cache_texture_size (item->ptr);
+
+  if (item->meta)
+    {
+      MxTextureCacheMetaEntry *entry;
+      GHashTableIter iter;
+
+      g_hash_table_iter_init (&iter, item->meta);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+        if (entry->texture)
+          size += mx_texture_cache_texture_size (entry->texture);
+    }
+
+  priv->current_bytes -= item->size;
+  mx_texture_cache_add_bytes (self, size);
+  item->size = size;
+}
+
+/* Evicts the least recently used items that aren't in use until the cache
+ * is within its budget */
+static void
+mx_texture_cache_trim (MxTextureCache *self)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+
+  while (priv->max_bytes && priv->current_bytes > priv->max_bytes &&
+         priv->unused->tail)
+    {
+      MxTextureCacheItem *item = priv->unused->tail->data;
+      guint64 bytes = priv->current_bytes;
+
+      MX_NOTE (TEXTURE_CACHE, "Evicting '%s' (%" G_GSIZE_FORMAT " bytes)",
+               item->uri, item->size);
+
+      /* this also frees the page the item was on if it was the last image
+       * on it */
+      g_hash_table_remove (priv->cache, item->uri);
+      priv->evicted_bytes += bytes - priv->current_bytes;
+    }
+}
+
+/* Marks @item as not being used outside of the cache, or as the most
+ * recently used of those items if it already is */
+static void
+mx_texture_cache_item_set_unused (MxTextureCache     *self,
+                                  MxTextureCacheItem *item)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (item->n_views)
+    return;
+
+  if (item->unused_link)
+    {
+      g_queue_unlink (priv->unused, item->unused_link);
+      g_queue_push_head_link (priv->unused, item->unused_link);
+    }
+  else
+    {
+      g_queue_push_head (priv->unused, item);
+      item->unused_link = priv->unused->head;
+    }
+}
+
+static void
+mx_texture_cache_view_destroyed (void *user_data)
+{
+  MxTextureCacheViewClosure *closure = user_data;
+  MxTextureCacheItem *item = closure->item;
+  MxTextureCacheMetaEntry *entry = closure->entry;
+
+  g_slice_free (MxTextureCacheViewClosure, closure);
+
+  /* the item or meta texture was removed from the cache while the texture
+   * was in use */
+  if (!item)
+    return;
+
+  if (entry)
+    {
+      entry->view = NULL;
+      entry->view_closure = NULL;
+    }
+  else
+    {
+      item->view = NULL;
+      item->view_closure = NULL;
+    }
+
+  if (--item->n_views == 0)
+    {
+      mx_texture_cache_item_set_unused (item->cache, item);
+      mx_texture_cache_trim (item->cache);
+    }
+}
+
+/* Creates a texture covering the whole of @texture, which is destroyed when
+ * the last user releases it. @item is kept in the cache while it is
+ * alive. Views of sub-textures refer to the full texture directly, so this
+ * doesn't add any indirection when painting. */
+static CoglHandle
+mx_texture_cache_item_new_view (MxTextureCache          *self,
+                                MxTextureCacheItem      *item,
+                                MxTextureCacheMetaEntry *entry,
+                                CoglHandle               texture)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureCacheViewClosure *closure;
+  CoglHandle view;
+
+  view = cogl_texture_new_from_sub_texture (texture, 0, 0,
+                                            cogl_texture_get_width (texture),
+                                            cogl_texture_get_height (texture));
+
+  closure = g_slice_new (MxTextureCacheViewClosure);
+  closure->item = item;
+  closure->entry = entry;
+  cogl_object_set_user_data (view, &view_key, closure,
+                             mx_texture_cache_view_destroyed);
+
+  if (entry)
+    {
+      entry->view = view;
+      entry->view_closure = closure;
+    }
+  else
+    {
+      item->view = view;
+      item->view_closure = closure;
+    }
+
+  item->n_views++;
+  if (item->unused_link)
+    {
+      g_queue_delete_link (priv->unused, item->unused_link);
+      item->unused_link = NULL;
+    }
+
+  return view;
+}
+
+/* Returns a new reference to the texture handed out for @item */
+static CoglHandle
+mx_texture_cache_item_get_view (MxTextureCache     *self,
+                                MxTextureCacheItem *item)
+{
+  if (item->view)
+    return cogl_handle_ref (item->view);
+
+  return mx_texture_cache_item_new_view (self, item, NULL, item->ptr);
+}
+
+/* Returns a new reference to the texture handed out for the meta texture
+ * @entry of @item */
+static CoglHandle
+mx_texture_cache_meta_entry_get_view (MxTextureCache          *self,
+                                      MxTextureCacheItem      *item,
+                                      MxTextureCacheMetaEntry *entry)
+{
+  if (entry->view)
+    return cogl_handle_ref (entry->view);
+
+  return mx_texture_cache_item_new_view (self, item, entry, entry->texture);
+}
+
 /**
  * mx_texture_cache_get_size:
  * @self: A #MxTextureCache
@@ -250,8 +757,15 @@ add_texture_to_cache (MxTextureCache     *self,
   /*  FinalizedClosure        *closure; */
   MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE(self);
 
+  item->cache = self;
+  item->uri = g_strdup (uri);
+
+  /* this may replace an item, which is freed straight away */
   g_hash_table_insert (priv->cache, g_strdup (uri), item);
 
+  mx_texture_cache_item_update_size (self, item);
+  mx_texture_cache_item_set_unused (self, item);
+
 #if 0
   /* Make sure we can remove from hash */
   closure = g_new0 (FinalizedClosure, 1);
@@ -327,6 +841,351 @@ mx_texture_cache_error_quark (void)
 }
 #endif
 
+static MxTextureAtlasPage *
+mx_texture_atlas_page_new (MxTextureCache *self)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureAtlasPage *page;
+  guint8 *data;
+
+  /* start from a transparent page, so that any unused space that ends up
+   * being sampled is invisible */
+  data = g_malloc0 (MX_TEXTURE_ATLAS_SIZE * MX_TEXTURE_ATLAS_SIZE * 4);
+
+  page = g_slice_new0 (MxTextureAtlasPage);
+  page->texture = cogl_texture_new_from_data (MX_TEXTURE_ATLAS_SIZE,
+                                              MX_TEXTURE_ATLAS_SIZE,
+                                              COGL_TEXTURE_NO_SLICING |
+                                              COGL_TEXTURE_NO_ATLAS,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                              MX_TEXTURE_ATLAS_SIZE * 4,
+                                              data);
+  g_free (data);
+
+  if (page->texture == COGL_INVALID_HANDLE)
+    {
+      g_slice_free (MxTextureAtlasPage, page);
+      return NULL;
+    }
+
+  page->shelves = g_array_new (FALSE, FALSE, sizeof (MxTextureAtlasShelf));
+  page->pages = priv->atlas_pages;
+  g_ptr_array_add (priv->atlas_pages, page);
+
+  /* the page is accounted for as a whole, until its last image is gone */
+  page->cache = self;
+  mx_texture_cache_add_bytes (self,
+                              mx_texture_cache_texture_size (page->texture));
+
+  MX_NOTE (TEXTURE_CACHE, "Created atlas page %p (%d pages)",
+           page, priv->atlas_pages->len);
+
+  return page;
+}
+
+/* Finds room for a @width x @height rectangle in @page */
+static gboolean
+mx_texture_atlas_page_allocate (MxTextureAtlasPage *page,
+                                gint                width,
+                                gint                height,
+                                gint               *x,
+                                gint               *y)
+{
+  MxTextureAtlasShelf *best = NULL;
+  guint i;
+
+  /* use the shortest shelf the rectangle fits on */
+  for (i = 0; i < page->shelves->len; i++)
+    {
+      MxTextureAtlasShelf *shelf =
+        &g_array_index (page->shelves, MxTextureAtlasShelf, i);
+
+      if (shelf->height >= height &&
+          shelf->x + width <= MX_TEXTURE_ATLAS_SIZE &&
+          (!best || shelf->height < best->height))
+        best = shelf;
+    }
+
+  /* start a new shelf rather than waste most of a much taller one */
+  if ((!best || best->height > height * 2) &&
+      page->next_y + height <= MX_TEXTURE_ATLAS_SIZE)
+    {
+      MxTextureAtlasShelf shelf = { page->next_y, height, 0 };
+
+      g_array_append_val (page->shelves, shelf);
+      page->next_y += height;
+      best = &g_array_index (page->shelves, MxTextureAtlasShelf,
+                             page->shelves->len - 1);
+    }
+
+  if (!best)
+    return FALSE;
+
+  *x = best->x;
+  *y = best->y;
+  best->x += width;
+
+  return TRUE;
+}
+
+/* Packs @pixbuf into an atlas page and returns a sub-texture of the page
+ * for it, or %COGL_INVALID_HANDLE if it couldn't be packed */
+static CoglHandle
+mx_texture_cache_atlas_add (MxTextureCache     *self,
+                            MxTextureCacheItem *item,
+                            GdkPixbuf          *pixbuf)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureAtlasPage *page = NULL;
+  CoglPixelFormat format;
+  const guint8 *pixels;
+  gint width, height, rowstride, x, y;
+  guint i;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  if (width > MX_TEXTURE_ATLAS_MAX_IMAGE ||
+      height > MX_TEXTURE_ATLAS_MAX_IMAGE ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    return COGL_INVALID_HANDLE;
+
+  for (i = 0; i < priv->atlas_pages->len; i++)
+    {
+      MxTextureAtlasPage *candidate = g_ptr_array_index (priv->atlas_pages, i);
+
+      if (mx_texture_atlas_page_allocate (candidate,
+                                          width + MX_TEXTURE_ATLAS_PADDING * 2,
+                                          height + MX_TEXTURE_ATLAS_PADDING * 2,
+                                          &x, &y))
+        {
+          page = candidate;
+          break;
+        }
+    }
+
+  if (!page)
+    {
+      page = mx_texture_atlas_page_new (self);
+
+      if (!page ||
+          !mx_texture_atlas_page_allocate (page,
+                                           width + MX_TEXTURE_ATLAS_PADDING * 2,
+                                           height + MX_TEXTURE_ATLAS_PADDING * 2,
+                                           &x, &y))
+        return COGL_INVALID_HANDLE;
+    }
+
+  format = gdk_pixbuf_get_has_alpha (pixbuf) ?
+    COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  x += MX_TEXTURE_ATLAS_PADDING;
+  y += MX_TEXTURE_ATLAS_PADDING;
+
+  cogl_texture_set_region (page->texture, 0, 0, x, y, width, height,
+                           width, height, format, rowstride, pixels);
+
+  /* repeat the edges into the padding */
+  cogl_texture_set_region (page->texture, 0, 0, x, y - 1, width, 1,
+                           width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, 0, height - 1, x, y + height,
+                           width, 1, width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, 0, 0, x - 1, y, 1, height,
+                           width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, width - 1, 0, x + width, y,
+                           1, height, width, height, format, rowstride, pixels);
+
+  /* and the corners, which linear filtering samples at the image corners */
+  cogl_texture_set_region (page->texture, 0, 0, x - 1, y - 1, 1, 1,
+                           width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, width - 1, 0, x + width, y - 1,
+                           1, 1, width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, 0, height - 1, x - 1, y + height,
+                           1, 1, width, height, format, rowstride, pixels);
+  cogl_texture_set_region (page->texture, width - 1, height - 1,
+                           x + width, y + height, 1, 1,
+                           width, height, format, rowstride, pixels);
+
+  page->ref_count ++;
+  item->page = page;
+  item->posX = x;
+  item->posY = y;
+  item->width = width;
+  item->height = height;
+
+  return cogl_texture_new_from_sub_texture (page->texture, x, y,
+                                            width, height);
+}
+
+/* Creates the texture for a decoded image, packing it into an atlas page
+ * if it is small enough */
+static CoglHandle
+mx_texture_cache_texture_from_pixbuf (MxTextureCache     *self,
+                                      MxTextureCacheItem *item,
+                                      GdkPixbuf          *pixbuf)
+{
+  CoglHandle texture;
+
+  texture = mx_texture_cache_atlas_add (self, item, pixbuf);
+  if (texture != COGL_INVALID_HANDLE)
+    return texture;
+
+  return cogl_texture_new_from_data (gdk_pixbuf_get_width (pixbuf),
+                                     gdk_pixbuf_get_height (pixbuf),
+                                     COGL_TEXTURE_NONE,
+                                     gdk_pixbuf_get_has_alpha (pixbuf) ?
+                                     COGL_PIXEL_FORMAT_RGBA_8888 :
+                                     COGL_PIXEL_FORMAT_RGB_888,
+                                     COGL_PIXEL_FORMAT_ANY,
+                                     gdk_pixbuf_get_rowstride (pixbuf),
+                                     gdk_pixbuf_get_pixels (pixbuf));
+}
+
+static const MxTextureCacheIndexEntry *
+mx_texture_cache_index_lookup (MxTextureCacheIndex *index,
+                               const gchar         *uri,
+                               guint32              hash)
+{
+  guint32 lower, upper;
+
+  lower = 0;
+  upper = index->header->n_entries;
+
+  while (lower < upper)
+    {
+      const MxTextureCacheIndexEntry *entry;
+      guint32 middle = lower + (upper - lower) / 2;
+      gint result;
+
+      entry = &index->entries[middle];
+
+      if (hash != entry->hash)
+        result = (hash < entry->hash) ? -1 : 1;
+      else if (entry->uri < index->header->strings_size)
+        result = strcmp (uri, index->strings + entry->uri);
+      else
+        return NULL;
+
+      if (result == 0)
+        return entry;
+      else if (result < 0)
+        upper = middle;
+      else
+        lower = middle + 1;
+    }
+
+  return NULL;
+}
+
+/* Returns a new reference to a page of @index, loading it if none of its
+ * images are in use */
+static CoglHandle
+mx_texture_cache_index_get_texture (MxTextureCacheIndex *index,
+                                    guint32              n)
+{
+  MxTextureCacheIndexPage *page = &index->pages[n];
+  const gchar *filename;
+  GError *error = NULL;
+
+  if (page->texture)
+    return cogl_handle_ref (page->texture);
+
+  if (page->failed)
+    return COGL_INVALID_HANDLE;
+
+  filename = index->strings + index->page_names[n];
+
+  MX_NOTE (TEXTURE_CACHE, "Loading atlas page '%s'", filename);
+
+  page->texture = cogl_texture_new_from_file (filename, COGL_TEXTURE_NONE,
+                                              COGL_PIXEL_FORMAT_ANY,
+                                              &error);
+  if (!page->texture)
+    {
+      g_warning ("Error loading image cache: %s", error->message);
+      g_error_free (error);
+
+      /* don't try again for every image on the page */
+      page->failed = TRUE;
+
+      return COGL_INVALID_HANDLE;
+    }
+
+  cogl_object_set_user_data (page->texture, &atlas_key, page,
+                             mx_texture_cache_index_page_destroyed);
+
+  /* the page is accounted for until the last image cut from it is gone */
+  page->size = mx_texture_cache_texture_size (page->texture);
+  mx_texture_cache_add_bytes (page->cache, page->size);
+
+  return page->texture;
+}
+
+/* Adds the image at @uri to the cache from the first atlas index that
+ * contains it, if any */
+static MxTextureCacheItem *
+mx_texture_cache_get_indexed_item (MxTextureCache *self,
+                                   const gchar    *uri)
+{
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  guint32 hash;
+  guint i;
+
+  if (!priv->indexes->len)
+    return NULL;
+
+  hash = mx_texture_cache_index_hash (uri);
+
+  for (i = 0; i < priv->indexes->len; i++)
+    {
+      MxTextureCacheIndex *index = g_ptr_array_index (priv->indexes, i);
+      const MxTextureCacheIndexEntry *entry;
+      MxTextureCacheItem *item;
+      CoglHandle texture;
+
+      entry = mx_texture_cache_index_lookup (index, uri, hash);
+      if (!entry || entry->page >= index->header->n_pages)
+        continue;
+
+      texture = mx_texture_cache_index_get_texture (index, entry->page);
+      if (!texture)
+        continue;
+
+      if ((guint64) entry->x + entry->width > cogl_texture_get_width (texture) ||
+          (guint64) entry->y + entry->height > cogl_texture_get_height (texture) ||
+          !entry->width || !entry->height)
+        {
+          g_warning ("Image cache entry for '%s' is outside the atlas", uri);
+          cogl_handle_unref (texture);
+          continue;
+        }
+
+      MX_NOTE (TEXTURE_CACHE, "Found '%s' in image cache", uri);
+
+      item = mx_texture_cache_item_new ();
+      item->width = entry->width;
+      item->height = entry->height;
+      item->posX = entry->x;
+      item->posY = entry->y;
+      item->index = index;
+      item->ptr = cogl_texture_new_from_sub_texture (texture,
+                                                     entry->x, entry->y,
+                                                     entry->width,
+                                                     entry->height);
+      add_texture_to_cache (self, uri, item);
+
+      /* the sub-texture keeps the atlas alive */
+      cogl_handle_unref (texture);
+
+      return item;
+    }
+
+  return NULL;
+}
+
 static MxTextureCacheItem *
 mx_texture_cache_get_item (MxTextureCache *self,
                            const gchar    *uri,
@@ -366,6 +1225,8 @@ mx_texture_cache_get_item (MxTextureCache *self,
     }
 
   item = g_hash_table_lookup (priv->cache, uri);
+  if (!item)
+    item = mx_texture_cache_get_indexed_item (self, uri);
 
   if ((!item || !item->ptr) && create_if_not_exists)
     {
@@ -384,7 +1245,6 @@ mx_texture_cache_get_item (MxTextureCache *self,
         {
           GdkPixbuf *pixbuf;
           GInputStream *stream = NULL;
-          gint width, height, has_alpha, rowstride;
 
           stream = g_resources_open_stream (&uri[11],
                                             G_RESOURCE_LOOKUP_FLAGS_NONE,
@@ -392,21 +1252,14 @@ mx_texture_cache_get_item (MxTextureCache *self,
 
           if (stream)
             {
-
               pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, &err);
 
-
-              width = gdk_pixbuf_get_width (pixbuf);
-              height = gdk_pixbuf_get_height (pixbuf);
-              has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-              rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-
-              item->ptr = cogl_texture_new_from_data (width, height,
-                                                      COGL_TEXTURE_NONE,
-                                                      has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888,
-                                                      COGL_PIXEL_FORMAT_ANY,
-                                                      rowstride,
-                                                      gdk_pixbuf_get_pixels (pixbuf));
+              if (pixbuf)
+                {
+                  item->ptr = mx_texture_cache_texture_from_pixbuf (self, item,
+                                                                    pixbuf);
+                  g_object_unref (pixbuf);
+                }
 
               g_object_unref (stream);
             }
@@ -460,9 +1313,27 @@ mx_texture_cache_get_item (MxTextureCache *self,
             err = g_error_new (mx_texture_cache_error_quark (), 0,
                                "Could not open %s", file);
 #else
-          item->ptr = cogl_texture_new_from_file (file, COGL_TEXTURE_NONE,
-                                                  COGL_PIXEL_FORMAT_ANY,
-                                                  &err);
+          gint width, height;
+
+          /* small images are decoded here so that they can be packed into
+           * an atlas, larger ones get a texture of their own */
+          if (gdk_pixbuf_get_file_info (file, &width, &height) &&
+              width <= MX_TEXTURE_ATLAS_MAX_IMAGE &&
+              height <= MX_TEXTURE_ATLAS_MAX_IMAGE)
+            {
+              GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file (file, &err);
+
+              if (pixbuf)
+                {
+                  item->ptr = mx_texture_cache_texture_from_pixbuf (self, item,
+                                                                    pixbuf);
+                  g_object_unref (pixbuf);
+                }
+            }
+          else
+            item->ptr = cogl_texture_new_from_file (file, COGL_TEXTURE_NONE,
+                                                    COGL_PIXEL_FORMAT_ANY,
+                                                    &err);
 #endif
         }
 
@@ -485,6 +1356,8 @@ mx_texture_cache_get_item (MxTextureCache *self,
 
       if (created)
         add_texture_to_cache (self, uri, item);
+      else
+        mx_texture_cache_item_update_size (self, item);
     }
 
   g_free (new_file);
@@ -517,11 +1390,321 @@ mx_texture_cache_get_cogl_texture (MxTextureCache *self,
   item = mx_texture_cache_get_item (self, uri, TRUE);
 
   if (item)
-    return cogl_handle_ref (item->ptr);
+    {
+      CoglHandle texture = mx_texture_cache_item_get_view (self, item);
+
+      /* the item is in use now, so it can't be evicted */
+      mx_texture_cache_trim (self);
+
+      return texture;
+    }
   else
     return NULL;
 }
 
+/* Asynchronous loading
+ *
+ * Images are decoded into a GdkPixbuf on a worker thread, and only the
+ * texture upload happens on the main thread. Requests for a URI that is
+ * already being decoded wait for that decode rather than starting another.
+ */
+
+typedef struct
+{
+  gchar    *uri;
+  gchar    *file;
+  gboolean  is_resource;
+} MxTextureCacheDecode;
+
+static void
+mx_texture_cache_decode_free (MxTextureCacheDecode *decode)
+{
+  g_free (decode->uri);
+  g_free (decode->file);
+  g_slice_free (MxTextureCacheDecode, decode);
+}
+
+static void
+mx_texture_cache_decode_thread (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+  MxTextureCacheDecode *decode = task_data;
+  GdkPixbuf *pixbuf = NULL;
+  GError *error = NULL;
+
+  if (decode->is_resource)
+    {
+      GInputStream *stream;
+
+      stream = g_resources_open_stream (&decode->uri[11],
+                                        G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                        &error);
+      if (stream)
+        {
+          pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, &error);
+          g_object_unref (stream);
+        }
+    }
+  else
+    pixbuf = gdk_pixbuf_new_from_file (decode->file, &error);
+
+  if (pixbuf)
+    g_task_return_pointer (task, pixbuf, g_object_unref);
+  else
+    g_task_return_error (task, error);
+}
+
+static void
+mx_texture_cache_decode_done (GObject      *source_object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  MxTextureCache *self = MX_TEXTURE_CACHE (source_object);
+  MxTextureCachePrivate *priv = TEXTURE_CACHE_PRIVATE (self);
+  MxTextureCacheDecode *decode = g_task_get_task_data (G_TASK (result));
+  MxTextureCacheItem *item;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+  GList *requests, *l;
+
+  pixbuf = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* the image may have been loaded synchronously in the meantime */
+  item = g_hash_table_lookup (priv->cache, decode->uri);
+
+  if (pixbuf && (!item || !item->ptr))
+    {
+      gboolean created = !item;
+
+      if (created)
+        item = mx_texture_cache_item_new ();
+
+      item->ptr = mx_texture_cache_texture_from_pixbuf (self, item, pixbuf);
+
+      if (!item->ptr)
+        {
+          g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       "Could not create a texture for '%s'", decode->uri);
+          if (created)
+            mx_texture_cache_item_free (item);
+          item = NULL;
+        }
+      else if (created)
+        add_texture_to_cache (self, decode->uri, item);
+      else
+        mx_texture_cache_item_update_size (self, item);
+    }
+
+  if (pixbuf)
+    g_object_unref (pixbuf);
+
+  if (error)
+    g_warning ("Error loading image: %s", error->message);
+
+  requests = g_hash_table_lookup (priv->pending, decode->uri);
+  g_hash_table_remove (priv->pending, decode->uri);
+
+  for (l = requests; l; l = l->next)
+    {
+      GTask *request = l->data;
+
+      if (g_task_return_error_if_cancelled (request))
+        ;
+      else if (item && item->ptr)
+        g_task_return_pointer (request,
+                               mx_texture_cache_item_get_view (self, item),
+                               (GDestroyNotify) cogl_handle_unref);
+      else
+        g_task_return_error (request, g_error_copy (error));
+
+      g_object_unref (request);
+    }
+
+  g_list_free (requests);
+  g_clear_error (&error);
+
+  mx_texture_cache_trim (self);
+}
+
+/**
+ * mx_texture_cache_get_cogl_texture_async:
+ * @self: A #MxTextureCache
+ * @uri: A URI or path to an image file
+ * @cancellable: (allow-none): a #GCancellable or %NULL
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the texture
+ *   is ready
+ * @user_data: (closure): data to pass to @callback
+ *
+ * Asynchronously retrieves the texture of the specified image, like
+ * mx_texture_cache_get_cogl_texture(). If the image isn't in the cache, it
+ * is decoded on a worker thread and only uploaded from the main loop, so
+ * loading it doesn't block the main loop. Concurrent requests for the
+ * same image share a single decode.
+ *
+ * In the meantime, mx_texture_cache_get_placeholder_cogl_texture() can be
+ * shown in place of the image.
+ *
+ * Since: 2.0
+ */
+void
+mx_texture_cache_get_cogl_texture_async (MxTextureCache      *self,
+                                         const gchar         *uri,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  MxTextureCachePrivate *priv;
+  MxTextureCacheDecode *decode;
+  MxTextureCacheItem *item;
+  GTask *task, *decode_task;
+  gchar *file = NULL, *new_uri = NULL;
+  gboolean is_resource = FALSE;
+  GList *requests;
+
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+  g_return_if_fail (uri != NULL);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+  task = g_task_new (self, cancellable, callback, user_data);
+
+  /* Make sure we have the URI, and the path to decode */
+  if (g_str_has_prefix (uri, "resource://"))
+    is_resource = TRUE;
+  else if (g_regex_match (priv->is_uri, uri, 0, NULL))
+    file = mx_texture_cache_uri_to_filename (uri);
+  else
+    {
+      file = g_strdup (uri);
+      uri = new_uri = mx_texture_cache_filename_to_uri (file);
+    }
+
+  if (!uri || (!is_resource && !file))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                               "Invalid image location");
+      goto out;
+    }
+
+  item = g_hash_table_lookup (priv->cache, uri);
+  if (!item)
+    item = mx_texture_cache_get_indexed_item (self, uri);
+  if (item && item->ptr)
+    {
+      g_task_return_pointer (task, mx_texture_cache_item_get_view (self, item),
+                             (GDestroyNotify) cogl_handle_unref);
+      goto out;
+    }
+
+#if defined(__ANDROID__) || defined(ANDROID)
+  /* images are decoded from the asset manager, which isn't thread-safe */
+  {
+    CoglHandle texture = mx_texture_cache_get_cogl_texture (self, uri);
+
+    if (texture)
+      g_task_return_pointer (task, texture,
+                             (GDestroyNotify) cogl_handle_unref);
+    else
+      g_task_return_new_error (task, mx_texture_cache_error_quark (), 0,
+                               "Could not load image %s", uri);
+    goto out;
+  }
+#endif
+
+  /* wait for the decode in progress, if there is one */
+  if (g_hash_table_lookup_extended (priv->pending, uri,
+                                    NULL, (gpointer *) &requests))
+    {
+      g_hash_table_insert (priv->pending, g_strdup (uri),
+                           g_list_append (requests, task));
+      task = NULL;
+      goto out;
+    }
+
+  g_hash_table_insert (priv->pending, g_strdup (uri),
+                       g_list_append (NULL, task));
+  task = NULL;
+
+  decode = g_slice_new0 (MxTextureCacheDecode);
+  decode->uri = g_strdup (uri);
+  decode->file = file;
+  decode->is_resource = is_resource;
+  file = NULL;
+
+  MX_NOTE (TEXTURE_CACHE, "Decoding '%s' asynchronously", decode->uri);
+
+  decode_task = g_task_new (self, NULL, mx_texture_cache_decode_done, NULL);
+  g_task_set_task_data (decode_task, decode,
+                        (GDestroyNotify) mx_texture_cache_decode_free);
+  g_task_run_in_thread (decode_task, mx_texture_cache_decode_thread);
+  g_object_unref (decode_task);
+
+out:
+  if (task)
+    g_object_unref (task);
+  g_free (file);
+  g_free (new_uri);
+}
+
+/**
+ * mx_texture_cache_get_cogl_texture_finish:
+ * @self: A #MxTextureCache
+ * @result: the #GAsyncResult passed to the callback
+ * @error: a #GError or %NULL
+ *
+ * Finishes retrieving a texture with
+ * mx_texture_cache_get_cogl_texture_async().
+ *
+ * Returns: (transfer full): a #CoglHandle to the cached texture, or %NULL
+ *   on error
+ *
+ * Since: 2.0
+ */
+CoglHandle
+mx_texture_cache_get_cogl_texture_finish (MxTextureCache  *self,
+                                          GAsyncResult    *result,
+                                          GError         **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * mx_texture_cache_get_placeholder_cogl_texture:
+ * @self: A #MxTextureCache
+ *
+ * Retrieves a transparent texture that can be shown while an image is being
+ * loaded with mx_texture_cache_get_cogl_texture_async().
+ *
+ * Returns: (transfer full): a #CoglHandle to the placeholder texture
+ *
+ * Since: 2.0
+ */
+CoglHandle
+mx_texture_cache_get_placeholder_cogl_texture (MxTextureCache *self)
+{
+  MxTextureCachePrivate *priv;
+
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  if (!priv->placeholder)
+    {
+      static const guint8 transparent[4] = { 0, 0, 0, 0 };
+
+      priv->placeholder =
+        cogl_texture_new_from_data (1, 1, COGL_TEXTURE_NO_SLICING,
+                                    COGL_PIXEL_FORMAT_RGBA_8888_PRE,
+                                    COGL_PIXEL_FORMAT_ANY,
+                                    4, transparent);
+    }
+
+  return cogl_handle_ref (priv->placeholder);
+}
+
 /**
  * mx_texture_cache_get_meta_cogl_texture:
  * @self: A #MxTextureCache
@@ -544,21 +1727,27 @@ mx_texture_cache_get_meta_cogl_texture (MxTextureCache *self,
                                         gpointer        ident)
 {
   MxTextureCacheItem *item;
+  CoglHandle texture = NULL;
 
   g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), NULL);
   g_return_val_if_fail (uri != NULL, NULL);
 
-  item = mx_texture_cache_get_item (self, uri, TRUE);
+  item = mx_texture_cache_get_item (self, uri, FALSE);
 
   if (item && item->meta)
     {
       MxTextureCacheMetaEntry *entry = g_hash_table_lookup (item->meta, ident);
 
-      if (entry->texture)
-        return cogl_handle_ref (entry->texture);
+      if (entry && entry->texture)
+        texture = mx_texture_cache_meta_entry_get_view (self, item, entry);
     }
 
-  return NULL;
+  if (item)
+    mx_texture_cache_item_set_unused (self, item);
+
+  mx_texture_cache_trim (self);
+
+  return texture;
 }
 
 /**
@@ -656,6 +1845,7 @@ mx_texture_cache_insert (MxTextureCache *self,
   item = mx_texture_cache_item_new ();
   item->ptr = cogl_handle_ref (texture);
   add_texture_to_cache (self, uri, item);
+  mx_texture_cache_trim (self);
 
   g_free (new_uri);
 }
@@ -665,6 +1855,13 @@ mx_texture_cache_destroy_meta_entry (gpointer data)
 {
   MxTextureCacheMetaEntry *entry = data;
 
+  /* the view may still be in use, but it no longer keeps the item */
+  if (entry->view_closure)
+    {
+      entry->view_closure->item = NULL;
+      entry->item->n_views--;
+    }
+
   if (entry->destroy_func)
     entry->destroy_func (entry->ident);
 
@@ -730,94 +1927,197 @@ mx_texture_cache_insert_meta (MxTextureCache *self,
                                         mx_texture_cache_destroy_meta_entry);
 
   entry = g_slice_new0 (MxTextureCacheMetaEntry);
+  entry->item = item;
   entry->ident = ident;
   entry->texture = cogl_handle_ref (texture);
   entry->destroy_func = destroy_func;
 
   g_hash_table_insert (item->meta, ident, entry);
+
+  mx_texture_cache_item_update_size (self, item);
+  mx_texture_cache_item_set_unused (self, item);
+  mx_texture_cache_trim (self);
 }
 
+/**
+ * mx_texture_cache_set_max_bytes:
+ * @self: A #MxTextureCache
+ * @max_bytes: the budget in bytes, or 0 for no limit
+ *
+ * Sets the amount of texture memory the cache may hold on to. See
+ * #MxTextureCache:max-bytes.
+ *
+ * Since: 2.0
+ */
 void
-mx_texture_cache_load_cache (MxTextureCache *self,
-                             const gchar    *filename)
+mx_texture_cache_set_max_bytes (MxTextureCache *self,
+                                guint64         max_bytes)
 {
-  FILE *file;
-  MxTextureCacheItem *element, head;
-  int ret;
-  CoglHandle full_texture;
   MxTextureCachePrivate *priv;
 
   g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
-  g_return_if_fail (filename != NULL);
 
   priv = TEXTURE_CACHE_PRIVATE (self);
 
-  file = fopen(filename, "rm");
-  if (!file)
-    return;
-
-  ret = fread (&head, sizeof(MxTextureCacheItem), 1, file);
-  if (ret < 0)
+  if (priv->max_bytes != max_bytes)
     {
-      fclose (file);
-      return;
-    }
+      priv->max_bytes = max_bytes;
+      mx_texture_cache_trim (self);
 
-  /* check if we already if this texture in the cache */
-  if (g_hash_table_lookup (priv->cache, head.filename))
-    {
-      /* skip it, we're done */
-      fclose (file);
-      return;
+      g_object_notify (G_OBJECT (self), "max-bytes");
     }
+}
 
-  full_texture = mx_texture_cache_get_cogl_texture (self, head.filename);
+/**
+ * mx_texture_cache_get_max_bytes:
+ * @self: A #MxTextureCache
+ *
+ * Gets the amount of texture memory the cache may hold on to.
+ *
+ * Returns: the budget in bytes, or 0 if there is no limit
+ *
+ * Since: 2.0
+ */
+guint64
+mx_texture_cache_get_max_bytes (MxTextureCache *self)
+{
+  g_return_val_if_fail (MX_IS_TEXTURE_CACHE (self), 0);
 
-  if (full_texture == COGL_INVALID_HANDLE)
-    {
-      g_critical (G_STRLOC ": Error opening cache image file");
-      fclose (file);
-      return;
-    }
+  return TEXTURE_CACHE_PRIVATE (self)->max_bytes;
+}
 
-  while (!feof (file))
-    {
-      gchar *uri;
 
-      element = mx_texture_cache_item_new ();
-      ret = fread (element, sizeof (MxTextureCacheItem), 1, file);
+static gboolean
+mx_texture_cache_item_is_from_index (gpointer key,
+                                     gpointer value,
+                                     gpointer user_data)
+{
+  MxTextureCacheItem *item = value;
 
-      if (ret < 1)
-        {
-          /* end of file */
-          mx_texture_cache_item_free (element);
-          break;
-        }
+  return item->index == user_data;
+}
 
-      uri = mx_texture_cache_filename_to_uri (element->filename);
-      if (!uri)
-        {
-          /* Couldn't resolve path */
-          mx_texture_cache_item_free (element);
-          continue;
-        }
+/**
+ * mx_texture_cache_load_cache:
+ * @self: A #MxTextureCache
+ * @filename: the path of an image cache index
+ *
+ * Makes the images of an image cache created by mx-create-image-cache
+ * available through the texture cache. The index is mapped into memory,
+ * and each image is only cut from the page of the atlas it is on when it
+ * is first used.
+ *
+ * Loading the index again after the cache was updated replaces the index
+ * loaded before.
+ */
+void
+mx_texture_cache_load_cache (MxTextureCache *self,
+                             const gchar    *filename)
+{
+  const MxTextureCacheIndexHeader *header;
+  MxTextureCachePrivate *priv;
+  MxTextureCacheIndex *index;
+  GMappedFile *mapped_file;
+  const guint32 *page_names;
+  const gchar *contents, *strings;
+  gsize length;
+  guint32 n;
+  guint i;
 
-      if (g_hash_table_lookup (priv->cache, uri))
-        {
-          /* URI is already in the cache.... */
-          mx_texture_cache_item_free (element);
-          g_free (uri);
-        }
-      else
+  g_return_if_fail (MX_IS_TEXTURE_CACHE (self));
+  g_return_if_fail (filename != NULL);
+
+  priv = TEXTURE_CACHE_PRIVATE (self);
+
+  mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+  if (!mapped_file)
+    return;
+
+  contents = g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+  header = (const MxTextureCacheIndexHeader *) contents;
+
+  if (length < sizeof (MxTextureCacheIndexHeader) ||
+      memcmp (header->magic, MX_TEXTURE_CACHE_INDEX_MAGIC,
+              sizeof (header->magic)) != 0 ||
+      header->version != MX_TEXTURE_CACHE_INDEX_VERSION ||
+      header->byte_order != MX_TEXTURE_CACHE_INDEX_BYTE_ORDER ||
+      length != sizeof (MxTextureCacheIndexHeader) +
+      (guint64) header->n_pages * sizeof (guint32) +
+      (guint64) header->n_entries * sizeof (MxTextureCacheIndexEntry) +
+      header->strings_size ||
+      header->n_pages == 0 ||
+      header->strings_size == 0)
+    goto invalid;
+
+  /* The entries are only checked when they are looked up. As the string
+   * table is nul-terminated, any offset into it is a valid string. */
+  strings = contents + length - header->strings_size;
+  if (strings[header->strings_size - 1] != '\0')
+    goto invalid;
+
+  page_names = (const guint32 *) (header + 1);
+  for (n = 0; n < header->n_pages; n++)
+    if (page_names[n] >= header->strings_size)
+      goto invalid;
+
+  /* Check if we already have this atlas. An index loaded from the same
+   * file before the cache was rebuilt is replaced. The pages of each
+   * generation of a cache are written to new files, so an index loaded
+   * from elsewhere is the same atlas if it starts with the same page. */
+  for (i = 0; i < priv->indexes->len; i++)
+    {
+      MxTextureCacheIndex *other = g_ptr_array_index (priv->indexes, i);
+
+      if (g_str_equal (other->filename, filename))
         {
-          element->ptr = cogl_texture_new_from_sub_texture (full_texture,
-                                                            element->posX,
-                                                            element->posY,
-                                                            element->width,
-                                                            element->height);
-          g_hash_table_insert (priv->cache, uri, element);
+          if (g_mapped_file_get_length (other->mapped_file) != length ||
+              memcmp (g_mapped_file_get_contents (other->mapped_file),
+                      contents, length) != 0)
+            break;
         }
+      else if (!g_str_equal (other->strings + other->page_names[0],
+                             strings + page_names[0]))
+        continue;
+
+      g_mapped_file_unref (mapped_file);
+      return;
     }
 
-  fclose (file);
+  MX_NOTE (TEXTURE_CACHE, "Loaded image cache '%s' with %u images on %u "
+           "pages", filename, header->n_entries, header->n_pages);
+
+  index = g_slice_new0 (MxTextureCacheIndex);
+  index->filename = g_strdup (filename);
+  index->mapped_file = mapped_file;
+  index->header = header;
+  index->page_names = page_names;
+  index->entries =
+    (const MxTextureCacheIndexEntry *) (page_names + header->n_pages);
+  index->strings = strings;
+  index->pages = g_new0 (MxTextureCacheIndexPage, header->n_pages);
+  for (n = 0; n < header->n_pages; n++)
+    index->pages[n].cache = self;
+
+  if (i < priv->indexes->len)
+    {
+      MxTextureCacheIndex *old_index = g_ptr_array_index (priv->indexes, i);
+
+      /* The cache was rebuilt, so the new index replaces the old one in
+       * the same place. The images cut from the old one may be out of date
+       * and are dropped; those still in use keep their page alive. */
+      g_hash_table_foreach_remove (priv->cache,
+                                   mx_texture_cache_item_is_from_index,
+                                   old_index);
+      g_ptr_array_index (priv->indexes, i) = index;
+      mx_texture_cache_index_free (old_index);
+    }
+  else
+    g_ptr_array_add (priv->indexes, index);
+
+  return;
+
+invalid:
+  g_warning (G_STRLOC ": '%s' is not a valid image cache", filename);
+  g_mapped_file_unref (mapped_file);
 }
@@ -29,6 +29,7 @@
 #define _MX_TEXTURE_CACHE
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <clutter/clutter.h>
 
 G_BEGIN_DECLS
@@ -84,6 +85,17 @@ MxTextureCache* mx_texture_cache_get_default (void);
 CoglHandle      mx_texture_cache_get_cogl_texture (MxTextureCache *self,
                                                    const gchar    *uri);
 
+void            mx_texture_cache_get_cogl_texture_async  (MxTextureCache      *self,
+                                                          const gchar         *uri,
+                                                          GCancellable        *cancellable,
+                                                          GAsyncReadyCallback  callback,
+                                                          gpointer             user_data);
+CoglHandle      mx_texture_cache_get_cogl_texture_finish (MxTextureCache      *self,
+                                                          GAsyncResult        *result,
+                                                          GError             **error);
+
+CoglHandle      mx_texture_cache_get_placeholder_cogl_texture (MxTextureCache *self);
+
 CoglHandle      mx_texture_cache_get_meta_cogl_texture (MxTextureCache *self,
                                                         const gchar    *uri,
                                                         gpointer        ident);
@@ -107,6 +119,10 @@ void            mx_texture_cache_insert_meta (MxTextureCache *self,
                                               CoglHandle     *texture,
                                               GDestroyNotify  destroy_func);
 
+void            mx_texture_cache_set_max_bytes (MxTextureCache *self,
+                                                guint64         max_bytes);
+guint64         mx_texture_cache_get_max_bytes (MxTextureCache *self);
+
 void mx_texture_cache_load_cache (MxTextureCache *self,
                                   const char     *filename);
 G_END_DECLS
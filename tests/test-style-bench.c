@@ -0,0 +1,230 @@
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Styles a large widget tree against a large style sheet and reports how
+ * long it took. A style sheet is loaded before each run, which makes every
+ * cached match stale, so each restyle has to go through selector matching
+ * rather than being served from the style cache.
+ *
+ * The tree is styled once using the selector index, and once more by a
+ * copy of the benchmark run with MX_DEBUG=no-css-index, which disables the
+ * index so that each widget is tested against every selector. The ratio of
+ * the two times is reported.
+ */
+
+#include <mx/mx.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_ROWS     500
+#define N_COLUMNS  20
+#define N_CLASSES  50
+#define N_RULES    2000
+#define N_RUNS     5
+
+static gchar *
+create_style_sheet (void)
+{
+  GString *css;
+  gint i;
+
+  css = g_string_new (NULL);
+
+  for (i = 0; i < N_RULES; i++)
+    {
+      switch (i % 4)
+        {
+        case 0:
+          g_string_append_printf (css, "#item-%d { padding: %dpx; }\n",
+                                  i * 5, i % 10);
+          break;
+        case 1:
+          g_string_append_printf (css, ".row-%d { color: #%06x; }\n",
+                                  i % N_CLASSES, i);
+          break;
+        case 2:
+          g_string_append_printf (css,
+                                  "MxBoxLayout .row-%d:hover MxLabel "
+                                  "{ font-size: %dpx; }\n",
+                                  i % N_CLASSES, 8 + i % 10);
+          break;
+        default:
+          g_string_append_printf (css, "MxFrame#item-%d:active "
+                                  "{ border-width: %dpx; }\n",
+                                  i * 3, i % 4);
+          break;
+        }
+    }
+
+  g_string_append (css, "* { color: black; }\n");
+  g_string_append (css, "MxLabel { font-size: 10px; }\n");
+
+  return g_string_free (css, FALSE);
+}
+
+static gdouble
+time_restyle (MxStyle      *style,
+              ClutterActor *root)
+{
+  GTimer *timer;
+  gdouble total = 0;
+  gint i;
+
+  timer = g_timer_new ();
+  for (i = 0; i < N_RUNS; i++)
+    {
+      mx_style_load_from_data (style, "test-style-bench-run.css",
+                               "MxLabel { color: red; }", NULL);
+
+      g_timer_start (timer);
+      mx_stylable_style_changed (MX_STYLABLE (root),
+                                 MX_STYLE_CHANGED_FORCE |
+                                 MX_STYLE_CHANGED_INVALIDATE_CACHE);
+      total += g_timer_elapsed (timer, NULL);
+    }
+  g_timer_destroy (timer);
+
+  return total / N_RUNS;
+}
+
+static ClutterActor *
+create_tree (void)
+{
+  ClutterActor *root;
+  gint row, column, n = 0;
+
+  root = mx_box_layout_new ();
+  mx_box_layout_set_orientation (MX_BOX_LAYOUT (root), MX_ORIENTATION_VERTICAL);
+
+  for (row = 0; row < N_ROWS; row++)
+    {
+      ClutterActor *box;
+      gchar *class;
+
+      box = mx_box_layout_new ();
+      class = g_strdup_printf ("row-%d", row % N_CLASSES);
+      mx_stylable_set_style_class (MX_STYLABLE (box), class);
+      g_free (class);
+
+      for (column = 0; column < N_COLUMNS; column++)
+        {
+          ClutterActor *frame, *label;
+          gchar *name;
+
+          frame = mx_frame_new ();
+          name = g_strdup_printf ("item-%d", n++);
+          clutter_actor_set_name (frame, name);
+          g_free (name);
+
+          label = mx_label_new_with_text ("Item");
+          clutter_actor_add_child (frame, label);
+
+          clutter_actor_add_child (box, frame);
+        }
+
+      clutter_actor_add_child (root, box);
+    }
+
+  return root;
+}
+
+/* Runs a copy of the benchmark with the selector index disabled. The
+ * debug flags are read once by libmx, so this can't be done in-process */
+static gdouble
+time_linear_restyle (const gchar *program)
+{
+  gchar *argv[] = { (gchar *) program, "--linear", NULL };
+  gchar **envp, *output = NULL;
+  GError *error = NULL;
+  gdouble linear = 0;
+  gint status;
+
+  envp = g_environ_setenv (g_get_environ (), "MX_DEBUG", "no-css-index",
+                           TRUE);
+
+  if (g_spawn_sync (NULL, argv, envp, 0, NULL, NULL, &output, NULL,
+                    &status, &error) && status == 0)
+    linear = g_ascii_strtod (output, NULL);
+  else if (error)
+    {
+      g_warning ("Could not run the linear scan: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (output);
+  g_strfreev (envp);
+
+  return linear;
+}
+
+int
+main (int argc, char *argv[])
+{
+  MxStyle *style;
+  ClutterActor *root;
+  GError *error = NULL;
+  gchar *css;
+  gdouble indexed, linear;
+  gboolean linear_only;
+
+  linear_only = (argc > 1 && !strcmp (argv[argc - 1], "--linear"));
+
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS)
+    return EXIT_FAILURE;
+
+  css = create_style_sheet ();
+  style = mx_style_new ();
+  if (!mx_style_load_from_data (style, "test-style-bench.css", css, &error))
+    {
+      g_warning ("Could not load style sheet: %s", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+  g_free (css);
+
+  root = create_tree ();
+  g_object_ref_sink (root);
+
+  mx_stylable_set_style (MX_STYLABLE (root), style);
+
+  if (linear_only)
+    {
+      gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+      g_print ("%s\n", g_ascii_dtostr (buf, sizeof (buf),
+                                       time_restyle (style, root)));
+      return EXIT_SUCCESS;
+    }
+
+  indexed = time_restyle (style, root);
+  linear = time_linear_restyle (argv[0]);
+
+  g_print ("Restyled %d widgets (average of %d runs):\n"
+           "  indexed selectors: %.3fs\n"
+           "  linear scan:       %.3fs\n"
+           "  speedup:           %.1fx\n",
+           N_ROWS * (N_COLUMNS * 2 + 1) + 1, N_RUNS,
+           indexed, linear, indexed > 0 ? linear / indexed : 0.0);
+
+  clutter_actor_destroy (root);
+  g_object_unref (root);
+  g_object_unref (style);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright 2012 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Compiles a CSS style sheet into the binary form that MxStyle loads
+ * without parsing. The result is written next to the style sheet with the
+ * ".compiled" suffix, where mx_style_load_from_file() looks for it, unless
+ * another output file is given. When bundling a style sheet in a
+ * GResource, the compiled form should be added with the same suffix.
+ */
+
+#include <mx/mx.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "mx-css.h"
+
+int
+main (int argc, char *argv[])
+{
+  MxStyleSheet *sheet;
+  GStatBuf info;
+  GError *error = NULL;
+  gchar *source, *compiled, *output;
+  gsize source_length, length;
+  gint result = EXIT_SUCCESS;
+
+  if (argc < 2 || argc > 3)
+    {
+      g_printerr ("Usage: %s STYLE-SHEET [OUTPUT]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_get_contents (argv[1], &source, &source_length, &error) ||
+      g_stat (argv[1], &info) != 0)
+    {
+      g_printerr ("Could not read '%s': %s\n", argv[1],
+                  error ? error->message : g_strerror (errno));
+      g_clear_error (&error);
+      return EXIT_FAILURE;
+    }
+
+  sheet = mx_style_sheet_new ();
+  if (!mx_style_sheet_add_from_file (sheet, argv[1], NULL))
+    {
+      g_printerr ("Could not parse '%s'\n", argv[1]);
+      mx_style_sheet_destroy (sheet);
+      g_free (source);
+      return EXIT_FAILURE;
+    }
+
+  compiled = mx_style_sheet_compile (sheet, argv[1], source, source_length,
+                                     info.st_mtime, &length);
+
+  output = (argc == 3) ? g_strdup (argv[2])
+    : g_strconcat (argv[1], ".compiled", NULL);
+
+  if (!g_file_set_contents (output, compiled, length, &error))
+    {
+      g_printerr ("Could not write '%s': %s\n", output, error->message);
+      g_error_free (error);
+      result = EXIT_FAILURE;
+    }
+
+  g_free (output);
+  g_free (compiled);
+  g_free (source);
+  mx_style_sheet_destroy (sheet);
+
+  return result;
+}